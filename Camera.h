@@ -4,7 +4,6 @@
 #include "algebra3.h"
 #include "Ray.h"
 #include "Sampler.h"
-#include "randomc.h"
 #include <vector>
 
 /* Camera objects store information about the viewer and
@@ -45,15 +44,12 @@ class PinholeCamera: public Camera {
 class LensCamera: public Camera {
     public:
         LensCamera(const vec3& point, const vec3& edge1, const vec3& edge2,
-                   const vec3& ul, const vec3& ll, const vec3& ur, const vec3& lr,
-                   int sampleRate);
+                   const vec3& ul, const vec3& ll, const vec3& ur, const vec3& lr);
         Ray createViewingRay(const Sample& normSamp);
     private:
         vec3 position;
         vec3 edge1;
         vec3 edge2;
-        vector< vector<vec3> > jitteredPoints;
-        CRandomMersenne* randGen;
 };
 
 #endif
\ No newline at end of file
@@ -0,0 +1,505 @@
+#include "CompactMesh.h"
+#include "algebra3f.h"
+#include <map>
+#include <cmath>
+#include <cstring>
+
+// Most triangles in one leaf.
+#define MAX_LEAF_SIZE 4
+// Largest quantized coordinate and octahedral component.
+#define QUANTIZED_MAX 65535
+#define OCTAHEDRAL_MAX 32767
+
+
+// Slab test in single precision, as LinearBoundingBoxTree does it.
+static inline bool hitsNode(const LinearNode& node, const vec3f& org, const vec3f& inv,
+							scalar tMin, scalar tMax) {
+
+	box3f box(vec3f(float4::load(node.bounds[0])), vec3f(float4::load(node.bounds[1])));
+	float tNear, tFar;
+	box.slabs(org, inv, tNear, tFar);
+	return tNear <= tFar && tNear < tMax && tFar > tMin;
+}
+
+static inline bool onWireframe(scalar beta, scalar gamma) {
+
+	return gamma < WIREFRAME_THRESHOLD || beta < WIREFRAME_THRESHOLD || gamma + beta > 1 - WIREFRAME_THRESHOLD;
+}
+
+// IEEE half float nearest to "value", for values in the half range (UVs).
+static unsigned short floatToHalf(float value) {
+
+	unsigned int bits;
+	memcpy(&bits, &value, sizeof(bits));
+	unsigned int sign = (bits >> 16) & 0x8000;
+	int exponent = (int)((bits >> 23) & 0xff) - 127 + 15;
+	unsigned int mantissa = bits & 0x7fffff;
+
+	// CASE: Too small for a normal half; shift in the implicit bit.
+	if (exponent <= 0) {
+		if (exponent < -10)
+			return sign;
+		mantissa |= 0x800000;
+		int shift = 14 - exponent;
+		unsigned int half = mantissa >> shift;
+		if ((mantissa >> (shift - 1)) & 1)
+			half++;
+		return sign | half;
+	}
+	if (exponent >= 31)
+		return sign | 0x7bff;				// Largest finite half
+
+	// Rounding may carry into the exponent, which is still right.
+	unsigned int half = sign | (exponent << 10) | (mantissa >> 13);
+	if (mantissa & 0x1000)
+		half++;
+	return half;
+}
+
+static inline float halfToFloat(unsigned short half) {
+
+	unsigned int sign = (half & 0x8000) << 16;
+	unsigned int exponent = (half >> 10) & 0x1f;
+	unsigned int mantissa = half & 0x3ff;
+	if (exponent == 0) {
+		float value = ldexpf((float)mantissa, -24);
+		return sign ? -value : value;
+	}
+	unsigned int bits = sign | ((exponent + 127 - 15) << 23) | (mantissa << 13);
+	float value;
+	memcpy(&value, &bits, sizeof(value));
+	return value;
+}
+
+static inline scalar signOf(scalar x) {
+
+	return x < 0 ? -1 : 1;
+}
+
+// Octahedral encoding (Cigolle et al. 2014): the unit sphere is projected
+// onto the octahedron |x| + |y| + |z| = 1, whose lower half is folded over
+// the upper one, and x and y are kept as 16-bit fixed point.
+static void encodeNormal(const vec3& normal, short encoded[2]) {
+
+	scalar norm = fabs(normal[VX]) + fabs(normal[VY]) + fabs(normal[VZ]);
+	scalar x = norm > 0 ? normal[VX] / norm : 0;
+	scalar y = norm > 0 ? normal[VY] / norm : 0;
+	if (norm > 0 && normal[VZ] < 0) {
+		scalar folded = (1 - fabs(y)) * signOf(x);
+		y = (1 - fabs(x)) * signOf(y);
+		x = folded;
+	}
+	encoded[0] = (short)floor(x * OCTAHEDRAL_MAX + 0.5);
+	encoded[1] = (short)floor(y * OCTAHEDRAL_MAX + 0.5);
+}
+
+static inline vec3 decodeNormal(const short encoded[2]) {
+
+	scalar x = encoded[0] / (scalar)OCTAHEDRAL_MAX;
+	scalar y = encoded[1] / (scalar)OCTAHEDRAL_MAX;
+	scalar z = 1 - fabs(x) - fabs(y);
+	if (z < 0) {
+		scalar unfolded = (1 - fabs(y)) * signOf(x);
+		y = (1 - fabs(x)) * signOf(y);
+		x = unfolded;
+	}
+	vec3 normal(x, y, z);
+	normal.normalize();
+	return normal;
+}
+
+
+/* Constructors */
+
+// Takes three corners per triangle, indexing into "mesh". Corners that
+// share a vertex, normal and texture coordinate become one vertex, and
+// positions and normals are transformed once here. Nothing of "mesh" is
+// kept, so the caller may delete it.
+CompactMesh::CompactMesh(Mesh* mesh, const vector<MeshCorner>& corners, const mat4& transform, Material* mat,
+						 bool wireframe, bool watertight, bool quantized) {
+
+	this->mat = mat;
+	this->wireframe = wireframe;
+	this->watertight = watertight;
+	this->quantized = quantized;
+	mat4 normalTransform = transform.inverse().transpose();
+
+	map<pair<int, pair<int, int> >, unsigned int> vertexIndex;
+	vector<vec3> vertexPositions, vertexNormals;
+	vector<vec2> vertexTextures;
+	indices.resize(corners.size());
+	for (unsigned int i = 0; i < corners.size(); i++) {
+		pair<int, pair<int, int> > key(corners[i].vertex, pair<int, int>(corners[i].normal, corners[i].texture));
+		map<pair<int, pair<int, int> >, unsigned int>::iterator found = vertexIndex.find(key);
+		if (found != vertexIndex.end()) {
+			indices[i] = found->second;
+			continue;
+		}
+		unsigned int vertex = vertexPositions.size();
+		vertexIndex[key] = vertex;
+		indices[i] = vertex;
+
+		vec3 normal = vec3(normalTransform * vec4(mesh->normals[corners[i].normal], 0.0), VW);
+		normal.normalize();
+		vertexPositions.push_back(vec3(transform * vec4(mesh->vertices[corners[i].vertex], 1.0)));
+		vertexNormals.push_back(normal);
+		vertexTextures.push_back(mesh->textures[corners[i].texture]);
+	}
+	setVertices(vertexPositions, vertexNormals, vertexTextures);
+
+	// Build the hierarchy, then put the index buffer in leaf order.
+	unsigned int count = getTriangleCount();
+	vector<BuildEntry> entries(count);
+	for (unsigned int i = 0; i < count; i++) {
+		entries[i].primitive = NULL;
+		entries[i].index = i;
+		entries[i].box = getTriangleBox(i);
+		for (int axis = 0; axis < 3; axis++)
+			entries[i].centroid[axis] = (entries[i].box.minCoordinate(axis) + entries[i].box.maxCoordinate(axis)) / 2;
+	}
+	vector<unsigned int> order;
+	nodes.reserve(2 * count);
+	if (count > 0)
+		build(entries, 0, count, order);
+	vector<LinearNode>(nodes).swap(nodes);
+	depth = count > 0 ? LinearBoundingBoxTree::treeDepth(&nodes[0], nodes.size()) : 0;
+
+	vector<unsigned int> sorted(indices.size());
+	for (unsigned int i = 0; i < count; i++)
+		for (int k = 0; k < 3; k++)
+			sorted[3 * i + k] = indices[3 * order[i] + k];
+	indices.swap(sorted);
+	refit();
+}
+
+// For instances: a transformed copy that keeps the original's hierarchy,
+// with its bounds refitted. A quantized copy is quantized afresh over its
+// own bounds.
+CompactMesh::CompactMesh(CompactMesh* otherMesh, const mat4& transform, Material* mat) {
+
+	this->mat = mat;
+	wireframe = otherMesh->wireframe;
+	watertight = otherMesh->watertight;
+	quantized = otherMesh->quantized;
+	indices = otherMesh->indices;
+	nodes = otherMesh->nodes;
+	depth = otherMesh->depth;
+
+	mat4 normalTransform = transform.inverse().transpose();
+	unsigned int count = otherMesh->getVertexCount();
+	vector<vec3> vertexPositions(count), vertexNormals(count);
+	vector<vec2> vertexTextures(count);
+	for (unsigned int i = 0; i < count; i++) {
+		vertexPositions[i] = vec3(transform * vec4(otherMesh->getPosition(i), 1.0));
+		vertexNormals[i] = vec3(normalTransform * vec4(otherMesh->getNormal(i), 0.0), VW);
+		vertexNormals[i].normalize();
+		vertexTextures[i] = otherMesh->getTextureCoordinate(i);
+	}
+	setVertices(vertexPositions, vertexNormals, vertexTextures);
+	refit();
+}
+
+
+/* Instance methods */
+
+// Closest-hit traversal, as in LinearBoundingBoxTree. Only the triangle
+// and its barycentric weights are kept while searching; the hit point and
+// normal are worked out once, for the closest hit.
+bool CompactMesh::intersect(Ray& ray, IntersectRecord* rec) {
+
+	if (nodes.empty())
+		return false;
+
+	vec3 origin = ray.getOrigin();
+	vec3 inverse = ray.getInverseDirection();
+	vec3f rayOrg((float)origin[VX], (float)origin[VY], (float)origin[VZ]);
+	vec3f rayInv((float)inverse[VX], (float)inverse[VY], (float)inverse[VZ]);
+	scalar tMin = ray.getLowerBound();
+	scalar oldMax = ray.getUpperBound();
+
+	bool hit = false;
+	unsigned int hitTriangle = 0;
+	scalar hitT = 0, hitBeta = 0, hitGamma = 0;
+	TraversalStack<unsigned int> stack(depth);
+	unsigned int current = 0;
+
+	while (true) {
+		const LinearNode& node = nodes[current];
+
+		if (hitsNode(node, rayOrg, rayInv, tMin, ray.getUpperBound())) {
+			if (node.count > 0) {
+				for (unsigned int i = node.offset; i < node.offset + node.count; i++) {
+					scalar t, beta, gamma;
+					if (intersectTriangle(i, ray, &t, &beta, &gamma)) {
+						hit = true;
+						hitTriangle = i;
+						hitT = t;
+						hitBeta = beta;
+						hitGamma = gamma;
+						ray.setBounds(tMin, t);
+					}
+				}
+			} else {
+				// Visit the near child first; save the far one for later.
+				if (ray.getSign(node.axis)) {
+					stack.push(current + 1);
+					current = node.offset;
+				} else {
+					stack.push(node.offset);
+					current = current + 1;
+				}
+				continue;
+			}
+		}
+		if (stack.empty())
+			break;
+		current = stack.pop();
+	}
+	ray.setBounds(tMin, oldMax);		// Reset ray bounds before returning
+	if (!hit)
+		return false;
+
+	const unsigned int* corner = &indices[3 * hitTriangle];
+	rec->t = hitT;
+	rec->point = ray.intersectionPoint(hitT);
+	rec->surfaceNormal = (1 - hitBeta - hitGamma) * getNormal(corner[0]) +
+		hitBeta * getNormal(corner[1]) + hitGamma * getNormal(corner[2]);
+	rec->surfaceNormal.normalize();
+	rec->primitive = this;
+	rec->leafPrimitive = this;
+	rec->element = hitTriangle;
+	rec->beta = hitBeta;
+	rec->gamma = hitGamma;
+	return true;
+}
+
+bool CompactMesh::intersectAny(Ray& ray) {
+
+	// The whole mesh is excluded when it's the last hit, as for MeshPrimitive.
+	if (nodes.empty() || this == ray.getLastHitPrim())
+		return false;
+
+	vec3 origin = ray.getOrigin();
+	vec3 inverse = ray.getInverseDirection();
+	vec3f rayOrg((float)origin[VX], (float)origin[VY], (float)origin[VZ]);
+	vec3f rayInv((float)inverse[VX], (float)inverse[VY], (float)inverse[VZ]);
+	scalar tMin = ray.getLowerBound();
+	scalar tMax = ray.getUpperBound();
+	TraversalStack<unsigned int> stack(depth);
+	unsigned int current = 0;
+
+	while (true) {
+		const LinearNode& node = nodes[current];
+
+		if (hitsNode(node, rayOrg, rayInv, tMin, tMax)) {
+			if (node.count > 0) {
+				for (unsigned int i = node.offset; i < node.offset + node.count; i++) {
+					scalar t, beta, gamma;
+					if (intersectTriangle(i, ray, &t, &beta, &gamma))
+						return true;
+				}
+			} else {
+				if (ray.getSign(node.axis)) {
+					stack.push(current + 1);
+					current = node.offset;
+				} else {
+					stack.push(node.offset);
+					current = current + 1;
+				}
+				continue;
+			}
+		}
+		if (stack.empty())
+			return false;
+		current = stack.pop();
+	}
+}
+
+// Without a hit record we can't tell which triangle "point" lies on, so
+// this returns the untextured coefficients, as MeshPrimitive does.
+Reflectance CompactMesh::getReflectance(const vec3& point) {
+
+	return mat->Material::getReflectance(point, NULL);
+}
+
+Reflectance CompactMesh::getHitReflectance(const IntersectRecord& rec) {
+
+	const unsigned int* corner = &indices[3 * rec.element];
+	vec2 textureCoordinate = (1 - rec.beta - rec.gamma) * getTextureCoordinate(corner[0]) +
+		rec.beta * getTextureCoordinate(corner[1]) + rec.gamma * getTextureCoordinate(corner[2]);
+	return mat->getReflectance(textureCoordinate);
+}
+
+BoundingBox CompactMesh::getBoundingBox() {
+
+	return box;
+}
+
+void CompactMesh::addMemoryUsage(MemoryUsage& usage) {
+
+	usage.geometry += sizeof(CompactMesh) + (positions.capacity() + normals.capacity() + textures.capacity()) * sizeof(float) +
+		(quantizedPositions.capacity() + octahedralNormals.capacity() + halfTextures.capacity()) * sizeof(short) +
+		indices.capacity() * sizeof(unsigned int);
+	usage.acceleration += nodes.capacity() * sizeof(LinearNode);
+	usage.triangles += getTriangleCount();
+}
+
+Primitive* CompactMesh::instance(const mat4& transform, Material* mat) {
+
+	return new CompactMesh(this, transform, mat);
+}
+
+unsigned int CompactMesh::getTriangleCount() {
+
+	return indices.size() / 3;
+}
+
+bool CompactMesh::intersectTriangle(unsigned int triangle, Ray& ray, scalar* t, scalar* beta, scalar* gamma) {
+
+	const unsigned int* corner = &indices[3 * triangle];
+	if (!TriangleKernel::intersect(ray, getPosition(corner[0]), getPosition(corner[1]), getPosition(corner[2]),
+								   watertight, t, beta, gamma))
+		return false;
+	return !wireframe || onWireframe(*beta, *gamma);
+}
+
+vec3 CompactMesh::getPosition(unsigned int vertex) {
+
+	if (quantized) {
+		const unsigned short* q = &quantizedPositions[3 * vertex];
+		return vec3(gridOrigin[VX] + q[0] * gridStep[VX], gridOrigin[VY] + q[1] * gridStep[VY],
+					gridOrigin[VZ] + q[2] * gridStep[VZ]);
+	}
+	return vec3(positions[3 * vertex], positions[3 * vertex + 1], positions[3 * vertex + 2]);
+}
+
+vec3 CompactMesh::getNormal(unsigned int vertex) {
+
+	if (quantized)
+		return decodeNormal(&octahedralNormals[2 * vertex]);
+	return vec3(normals[3 * vertex], normals[3 * vertex + 1], normals[3 * vertex + 2]);
+}
+
+vec2 CompactMesh::getTextureCoordinate(unsigned int vertex) {
+
+	if (quantized)
+		return vec2(halfToFloat(halfTextures[2 * vertex]), halfToFloat(halfTextures[2 * vertex + 1]));
+	return vec2(textures[2 * vertex], textures[2 * vertex + 1]);
+}
+
+unsigned int CompactMesh::getVertexCount() {
+
+	return quantized ? quantizedPositions.size() / 3 : positions.size() / 3;
+}
+
+// Stores the vertices in the mesh's format: as floats, or quantized. Each
+// quantized coordinate is the nearest of QUANTIZED_MAX + 1 evenly spaced
+// values across the vertices' bounds along its axis.
+void CompactMesh::setVertices(const vector<vec3>& vertexPositions, const vector<vec3>& vertexNormals,
+							  const vector<vec2>& vertexTextures) {
+
+	unsigned int count = vertexPositions.size();
+	positions.clear();
+	normals.clear();
+	textures.clear();
+	quantizedPositions.clear();
+	octahedralNormals.clear();
+	halfTextures.clear();
+
+	if (!quantized) {
+		positions.resize(3 * count);
+		normals.resize(3 * count);
+		textures.resize(2 * count);
+		for (unsigned int i = 0; i < count; i++) {
+			for (int k = 0; k < 3; k++) {
+				positions[3 * i + k] = (float)vertexPositions[i][k];
+				normals[3 * i + k] = (float)vertexNormals[i][k];
+			}
+			textures[2 * i] = (float)vertexTextures[i][0];
+			textures[2 * i + 1] = (float)vertexTextures[i][1];
+		}
+		return;
+	}
+
+	vec3 hi = count > 0 ? vertexPositions[0] : vec3(0, 0, 0);
+	gridOrigin = hi;
+	for (unsigned int i = 1; i < count; i++)
+		for (int k = 0; k < 3; k++) {
+			gridOrigin[k] = MIN(gridOrigin[k], vertexPositions[i][k]);
+			hi[k] = MAX(hi[k], vertexPositions[i][k]);
+		}
+	for (int k = 0; k < 3; k++)
+		gridStep[k] = (hi[k] - gridOrigin[k]) / QUANTIZED_MAX;
+
+	quantizedPositions.resize(3 * count);
+	octahedralNormals.resize(2 * count);
+	halfTextures.resize(2 * count);
+	for (unsigned int i = 0; i < count; i++) {
+		for (int k = 0; k < 3; k++) {
+			scalar q = gridStep[k] > 0 ? floor((vertexPositions[i][k] - gridOrigin[k]) / gridStep[k] + 0.5) : 0;
+			quantizedPositions[3 * i + k] = (unsigned short)MIN(MAX(q, 0), QUANTIZED_MAX);
+		}
+		encodeNormal(vertexNormals[i], &octahedralNormals[2 * i]);
+		halfTextures[2 * i] = floatToHalf((float)vertexTextures[i][0]);
+		halfTextures[2 * i + 1] = floatToHalf((float)vertexTextures[i][1]);
+	}
+}
+
+BoundingBox CompactMesh::getTriangleBox(unsigned int triangle) {
+
+	vec3 lo = getPosition(indices[3 * triangle]);
+	vec3 hi = lo;
+	for (int i = 1; i < 3; i++) {
+		vec3 p = getPosition(indices[3 * triangle + i]);
+		for (int k = 0; k < 3; k++) {
+			lo[k] = MIN(lo[k], p[k]);
+			hi[k] = MAX(hi[k], p[k]);
+		}
+	}
+	return BoundingBox(lo, hi);
+}
+
+// Builds the subtree over entries[begin, end) with the binned SAH and
+// returns its root's index. Leaves take the next run of "order", the
+// triangles in the order the index buffer is to be rearranged into. Node
+// bounds are left for refit().
+unsigned int CompactMesh::build(vector<BuildEntry>& entries, unsigned int begin, unsigned int end, vector<unsigned int>& order) {
+
+	unsigned int index = nodes.size();
+	LinearNode node = { { { 0, 0, 0 }, { 0, 0, 0 } }, 0, 0, 0, 0 };
+	nodes.push_back(node);
+
+	if (end - begin <= MAX_LEAF_SIZE) {
+		nodes[index].offset = order.size();
+		nodes[index].count = end - begin;
+		for (unsigned int i = begin; i < end; i++)
+			order.push_back(entries[i].index);
+		return index;
+	}
+
+	int axis;
+	unsigned int mid = BoundingBoxTree::partitionSAH(entries, begin, end, &axis);
+	nodes[index].axis = axis;
+	build(entries, begin, mid, order);
+	unsigned int second = build(entries, mid, end, order);
+	nodes[index].offset = second;
+	return index;
+}
+
+// Recomputes every node's bounds from the positions, children before
+// parents (they come later in the array), and the mesh's bounds with them.
+void CompactMesh::refit() {
+
+	vector<BoundingBox> bounds(nodes.size());
+	for (int i = (int)nodes.size() - 1; i >= 0; i--) {
+		LinearNode& node = nodes[i];
+		if (node.count > 0) {
+			bounds[i] = getTriangleBox(node.offset);
+			for (unsigned int j = node.offset + 1; j < node.offset + node.count; j++)
+				bounds[i] = BoundingBox::combine(bounds[i], getTriangleBox(j));
+		} else bounds[i] = BoundingBox::combine(bounds[i + 1], bounds[node.offset]);
+		LinearBoundingBoxTree::setNodeBounds(node, bounds[i]);
+	}
+	if (!nodes.empty())
+		box = bounds[0];
+}
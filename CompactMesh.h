@@ -0,0 +1,100 @@
+#ifndef COMPACTMESHH
+#define COMPACTMESHH
+
+#include "Primitives.h"
+#include "LinearBoundingBoxTree.h"
+#include "Ray.h"
+#include "IntersectRecord.h"
+#include <vector>
+
+using namespace std;
+
+
+/* How ObjParser stores a mesh that has normals and texture coordinates. */
+enum MeshFormat {
+	objectMesh,				// MeshPrimitive: a Shape and a GeoPrimitive per triangle
+	compactMesh,			// CompactMesh: shared float arrays and an index buffer
+	quantizedMesh			// CompactMesh with its vertices quantized to 16 bits
+};
+
+/* One corner of an OBJ face: indices into a Mesh's vertices, normals and
+   texture coordinates. */
+typedef struct mesh_corner_struct {
+
+	int vertex;
+	int normal;
+	int texture;
+
+} MeshCorner;
+
+
+/* A triangle mesh stored as flat arrays instead of one object per
+   triangle: float positions, normals and texture coordinates shared by
+   the triangles, and three 32-bit vertex indices per triangle. Nothing
+   else is kept per triangle; intersection works from the vertices, and
+   the barycentric weights of the hit interpolate the normal and, at
+   shading time, the texture coordinate. The mesh has its own hierarchy of
+   LinearNodes, whose leaves are runs of the index buffer; it is always
+   built by SAH, whatever split method the rest of the scene uses.
+   Quantized, a vertex takes 14 bytes instead of 32: each coordinate is a
+   16-bit step across the mesh's bounds, the normal is octahedrally encoded
+   in two 16-bit values and the texture coordinate is two half floats.
+   Vertices are decoded as they're read, and triangles sharing a vertex
+   decode it the same way, so the mesh stays closed. */
+class CompactMesh : public Primitive {
+
+public:
+
+	/* Constructor */
+	CompactMesh(Mesh* mesh, const vector<MeshCorner>& corners, const mat4& transform, Material* mat,
+				bool wireframe, bool watertight, bool quantized);
+
+	/* Instance methods */
+	bool intersect(Ray& ray, IntersectRecord* rec);
+	bool intersectAny(Ray& ray);
+	Reflectance getReflectance(const vec3& point);
+	Reflectance getHitReflectance(const IntersectRecord& rec);
+	BoundingBox getBoundingBox();
+	void addMemoryUsage(MemoryUsage& usage);
+	Primitive* instance(const mat4& transform, Material* mat);
+	unsigned int getTriangleCount();
+
+private:
+
+	/* Constructor */
+	CompactMesh(CompactMesh* otherMesh, const mat4& transform, Material* mat);
+
+	/* Instance methods */
+	bool intersectTriangle(unsigned int triangle, Ray& ray, scalar* t, scalar* beta, scalar* gamma);
+	vec3 getPosition(unsigned int vertex);
+	vec3 getNormal(unsigned int vertex);
+	vec2 getTextureCoordinate(unsigned int vertex);
+	unsigned int getVertexCount();
+	void setVertices(const vector<vec3>& vertexPositions, const vector<vec3>& vertexNormals,
+					 const vector<vec2>& vertexTextures);
+	BoundingBox getTriangleBox(unsigned int triangle);
+	unsigned int build(vector<BuildEntry>& entries, unsigned int begin, unsigned int end, vector<unsigned int>& order);
+	void refit();
+
+	/* Instance vars */
+	vector<float> positions;		// Three per vertex
+	vector<float> normals;			// Three per vertex
+	vector<float> textures;			// Two per vertex
+	vector<unsigned short> quantizedPositions;		// Three per vertex, when quantized
+	vector<short> octahedralNormals;				// Two per vertex
+	vector<unsigned short> halfTextures;			// Two per vertex
+	vec3 gridOrigin;				// A quantized coordinate q stands for
+	vec3 gridStep;					// gridOrigin + q * gridStep
+	bool quantized;
+	vector<unsigned int> indices;	// Three per triangle, grouped by leaf
+	vector<LinearNode> nodes;		// Depth-first, as in LinearBoundingBoxTree
+	unsigned int depth;				// Most interior nodes above any leaf
+	BoundingBox box;
+	Material* mat;
+	bool wireframe;
+	bool watertight;
+
+};
+
+
+#endif
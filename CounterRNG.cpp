@@ -0,0 +1,100 @@
+#include "CounterRNG.h"
+#include "algebra3.h"
+
+// Philox4x32 multipliers and Weyl key increments
+#define PHILOX_M0 0xD2511F53u
+#define PHILOX_M1 0xCD9E8D57u
+#define PHILOX_W0 0x9E3779B9u
+#define PHILOX_W1 0xBB67AE85u
+
+
+/* Constructors */
+
+CounterRNG::CounterRNG(uint32 seed) {
+
+	key[0] = seed;
+	key[1] = seed ^ 0xA511E9B3u;
+
+}
+
+
+/* Instance methods */
+
+void CounterRNG::generate(uint32 c0, uint32 c1, uint32 c2, uint32 c3, uint32 out[4]) const {
+
+	uint32 k0 = key[0], k1 = key[1];
+	for (int round = 0; round < PHILOX_ROUNDS; round++) {
+		unsigned long long p0 = (unsigned long long)PHILOX_M0 * c0;
+		unsigned long long p1 = (unsigned long long)PHILOX_M1 * c2;
+		c0 = (uint32)(p1 >> 32) ^ c1 ^ k0;
+		c2 = (uint32)(p0 >> 32) ^ c3 ^ k1;
+		c1 = (uint32)p1;
+		c3 = (uint32)p0;
+		k0 += PHILOX_W0;
+		k1 += PHILOX_W1;
+	}
+	out[0] = c0;
+	out[1] = c1;
+	out[2] = c2;
+	out[3] = c3;
+}
+
+// Same rounds as generate(), over the PHILOX_BATCH counters (c0, c1, c2,
+// firstBlock + lane) held in structure-of-arrays form, so that each step
+// is one loop over the lanes. The lanes live in local arrays while the
+// rounds run, so the compiler can see they don't alias.
+void CounterRNG::generateLanes(uint32 c0, uint32 c1, uint32 c2, uint32 firstBlock, uint32 words[PHILOX_BATCH * 4]) const {
+
+	uint32 x0[PHILOX_BATCH], x1[PHILOX_BATCH], x2[PHILOX_BATCH], x3[PHILOX_BATCH];
+	for (int lane = 0; lane < PHILOX_BATCH; lane++) {
+		x0[lane] = c0;
+		x1[lane] = c1;
+		x2[lane] = c2;
+		x3[lane] = firstBlock + lane;
+	}
+
+	uint32 k0 = key[0], k1 = key[1];
+	for (int round = 0; round < PHILOX_ROUNDS; round++) {
+		for (int lane = 0; lane < PHILOX_BATCH; lane++) {
+			unsigned long long p0 = (unsigned long long)PHILOX_M0 * x0[lane];
+			unsigned long long p1 = (unsigned long long)PHILOX_M1 * x2[lane];
+			uint32 next0 = (uint32)(p1 >> 32) ^ x1[lane] ^ k0;
+			uint32 next2 = (uint32)(p0 >> 32) ^ x3[lane] ^ k1;
+			x1[lane] = (uint32)p1;
+			x3[lane] = (uint32)p0;
+			x0[lane] = next0;
+			x2[lane] = next2;
+		}
+		k0 += PHILOX_W0;
+		k1 += PHILOX_W1;
+	}
+
+	for (int lane = 0; lane < PHILOX_BATCH; lane++) {
+		words[4 * lane] = x0[lane];
+		words[4 * lane + 1] = x1[lane];
+		words[4 * lane + 2] = x2[lane];
+		words[4 * lane + 3] = x3[lane];
+	}
+}
+
+void CounterRNG::generateBatch(uint32 c0, uint32 c1, uint32 c2, uint32* out, unsigned int count) const {
+
+	uint32 words[PHILOX_BATCH * 4];
+	for (unsigned int first = 0; first < count; first += PHILOX_BATCH * 4) {
+		generateLanes(c0, c1, c2, first / 4, words);
+		unsigned int n = MIN(count - first, (unsigned int)PHILOX_BATCH * 4);
+		for (unsigned int k = 0; k < n; k++)
+			out[first + k] = words[k];
+	}
+}
+
+void CounterRNG::uniformBatch(uint32 c0, uint32 c1, uint32 c2, double* out, unsigned int count) const {
+
+	uint32 words[PHILOX_BATCH * 4];
+	for (unsigned int first = 0; first < count; first += PHILOX_BATCH * 4) {
+		generateLanes(c0, c1, c2, first / 4, words);
+		unsigned int n = MIN(count - first, (unsigned int)PHILOX_BATCH * 4);
+		for (unsigned int k = 0; k < n; k++)
+			out[first + k] = words[k] / 4294967296.0;
+	}
+}
@@ -0,0 +1,51 @@
+#ifndef COUNTERRNGH
+#define COUNTERRNGH
+
+#include "randomc.h"
+
+#define PHILOX_ROUNDS 10
+#define PHILOX_BATCH 16				// Blocks generated side by side by the batch calls
+
+
+/* Counter-based random numbers (Philox4x32-10, Salmon et al. 2011). Every
+   call hashes a 128-bit counter, e.g. (pixel x, pixel y, sample, dimension),
+   with the 64-bit key into four random words. There is no state to advance
+   or share: any thread may draw any number in any order, and the same
+   counter always gives the same numbers. Replaces CRandomMersenne, whose
+   2.5KB of state had to be owned per object and seeded from the clock. */
+class CounterRNG {
+
+public:
+
+	CounterRNG(uint32 seed = 0);
+
+	// The four random words for one counter.
+	void generate(uint32 c0, uint32 c1, uint32 c2, uint32 c3, uint32 out[4]) const;
+
+	inline uint32 bits(uint32 c0, uint32 c1, uint32 c2, uint32 c3) const {
+		uint32 out[4];
+		generate(c0, c1, c2, c3, out);
+		return out[0];
+	}
+
+	// A uniform number in [0, 1).
+	inline double uniform(uint32 c0, uint32 c1, uint32 c2, uint32 c3) const {
+		return bits(c0, c1, c2, c3) / 4294967296.0;
+	}
+
+	// "count" words (or uniforms) from the counters (c0, c1, c2, 0),
+	// (c0, c1, c2, 1), ..., four per counter. The blocks are computed
+	// PHILOX_BATCH at a time in independent lanes, which vectorizes.
+	void generateBatch(uint32 c0, uint32 c1, uint32 c2, uint32* out, unsigned int count) const;
+	void uniformBatch(uint32 c0, uint32 c1, uint32 c2, double* out, unsigned int count) const;
+
+private:
+
+	uint32 key[2];
+
+	void generateLanes(uint32 c0, uint32 c1, uint32 c2, uint32 firstBlock, uint32 words[PHILOX_BATCH * 4]) const;
+
+};
+
+
+#endif
@@ -1,6 +1,20 @@
 #include "Film.h"
 #include "FreeImage.h"
+#include "algebra3.h"
 #include <iostream>
+#include <cstdio>
+#include <cstdlib>
+#include <cfloat>
+#include <cmath>
+#include <algorithm>
+
+// Number of locks guarding commits. Row j uses lock j % FILM_LOCKS, so
+// threads working on different tiles rarely contend.
+#define FILM_LOCKS 64
+
+// Luminance added to a pixel's mean before relating its error to it, so
+// that near-black pixels aren't held to an unreachable relative error.
+#define ERROR_BLACK_LEVEL 0.1
 
 using namespace std;
 
@@ -9,13 +23,19 @@ using namespace std;
 
 Film::Film(unsigned int imageWidth, unsigned int imageHeight) {
 
-	sampleGrid = new vector<rgb>*[imageWidth];
-	for(unsigned int i = 0; i < imageWidth; i++)
-		sampleGrid[i] = new vector<rgb>[imageHeight];
-
 	pixelWidth = imageWidth;
 	pixelHeight = imageHeight;
 
+	colorSums.assign(imageWidth * imageHeight, rgb(0,0,0));
+	weights.assign(imageWidth * imageHeight, 0.0);
+	lumSums.assign(imageWidth * imageHeight, 0.0);
+	lumSquares.assign(imageWidth * imageHeight, 0.0);
+	sampleCounts.assign(imageWidth * imageHeight, 0);
+
+	rowLocks.resize(FILM_LOCKS);
+	for (unsigned int i = 0; i < rowLocks.size(); i++)
+		pthread_mutex_init(&rowLocks[i], NULL);
+
 }
 
 
@@ -23,9 +43,8 @@ Film::Film(unsigned int imageWidth, unsigned int imageHeight) {
 
 Film::~Film() {
 
-	for (unsigned int i = 0; i < pixelWidth; i++)
-		delete [] sampleGrid[i];
-	delete [] sampleGrid;
+	for (unsigned int i = 0; i < rowLocks.size(); i++)
+		pthread_mutex_destroy(&rowLocks[i]);
 
 }
 
@@ -34,15 +53,73 @@ Film::~Film() {
 
 void Film::commit(const Sample& samp, const rgb& color) {
 
+	commit(samp, color, 1.0);
+
+}
+
+// Adds a sample with the given filter weight. Safe to call from several
+// threads at once.
+void Film::commit(const Sample& samp, const rgb& color, double weight) {
+
 	unsigned int i = (unsigned int)samp.horiz;
 	unsigned int j = (unsigned int)samp.vert;
-	sampleGrid[i][j].push_back(color);
+	unsigned int index = j * pixelWidth + i;
+	double luminance = 0.2126 * color[0] + 0.7152 * color[1] + 0.0722 * color[2];
+
+	pthread_mutex_t* lock = &rowLocks[j % rowLocks.size()];
+	pthread_mutex_lock(lock);
+	colorSums[index] += weight * color;
+	weights[index] += weight;
+	lumSums[index] += luminance;
+	lumSquares[index] += luminance * luminance;
+	sampleCounts[index]++;
+	pthread_mutex_unlock(lock);
+
+}
+
+unsigned int Film::getSampleCount(unsigned int i, unsigned int j) const {
+
+	return sampleCounts[j * pixelWidth + i];
+}
+
+// The standard error of pixel (i, j)'s mean luminance, relative to that
+// mean (plus ERROR_BLACK_LEVEL). Pixels with fewer than two samples have
+// no estimate and report an infinite error.
+double Film::estimateError(unsigned int i, unsigned int j) const {
+
+	unsigned int index = j * pixelWidth + i;
+	unsigned int n = sampleCounts[index];
+	if (n < 2)
+		return DBL_MAX;
+
+	double mean = lumSums[index] / n;
+	double variance = MAX(0.0, (lumSquares[index] - n * mean * mean) / (n - 1));
+	return sqrt(variance / n) / (fabs(mean) + ERROR_BLACK_LEVEL);
+}
+
+// The error that the given fraction of pixels are at or below. A mean
+// would mostly measure how much of the image is flat background.
+double Film::errorPercentile(double fraction) const {
+
+	vector<double> errors(pixelWidth * pixelHeight);
+	for (unsigned int j = 0; j < pixelHeight; j++)
+		for (unsigned int i = 0; i < pixelWidth; i++)
+			errors[j * pixelWidth + i] = estimateError(i, j);
+	if (errors.empty())
+		return 0;
 
+	unsigned int k = (unsigned int)MIN(errors.size() - 1.0, MAX(0.0, fraction * errors.size()));
+	nth_element(errors.begin(), errors.begin() + k, errors.end());
+	return errors[k];
 }
 
+// Writes to a temporary file and renames it over "filename", so a render
+// killed mid-write (progressive renders rewrite the image every pass)
+// leaves the previous image whole.
 void Film::writeImage(string filename) {
 
 	filename += ".png";
+	string partial = filename + ".part";
 	// [START] WRITE IMAGE
 	cout << "Writing to file \"" << filename << "\"...";
 
@@ -51,18 +128,22 @@ void Film::writeImage(string filename) {
 	
 	for (unsigned int i = 0; i < pixelWidth; i++)
 		for (unsigned int j = 0; j < pixelHeight; j++) {
-			vector<rgb> colorSamples = sampleGrid[i][j];
-			rgb pixelColor(0,0,0);
-			for (unsigned int k = 0; k < colorSamples.size(); k++)
-				pixelColor += colorSamples[k];
-			pixelColor /= colorSamples.size();
+			unsigned int index = j * pixelWidth + i;
+			rgb pixelColor = colorSums[index];
+			if (weights[index] > 0)
+				pixelColor /= weights[index];
 			pixelColor.normalize();
 			pixel.rgbRed = (BYTE)(pixelColor[0] * 255);
 			pixel.rgbGreen = (BYTE)(pixelColor[1] * 255);
 			pixel.rgbBlue = (BYTE)(pixelColor[2] * 255);
 			FreeImage_SetPixelColor(image, i, j, &pixel);
 		}
-	FreeImage_Save(FIF_PNG, image, filename.c_str(), PNG_IGNOREGAMMA);
+	bool saved = FreeImage_Save(FIF_PNG, image, partial.c_str(), PNG_IGNOREGAMMA);
+	FreeImage_Unload(image);
+	if (!saved || rename(partial.c_str(), filename.c_str()) != 0) {
+		cerr << "Error: Could not write " << filename << endl;
+		exit(1);
+	}
 
 	// [END] WRITE IMAGE
 	cout << "DONE" << endl;
@@ -3,13 +3,17 @@
 
 #include "rgb.h"
 #include "Sampler.h"
+#include <pthread.h>
 #include <string>
 #include <vector>
 
 using namespace std;
 
 /* Film objects collect samples to eventually write to a
-   file. */
+   file. Each pixel only keeps a running weighted sum of its
+   samples, so memory doesn't grow with the sample count. It also
+   keeps the sum of squared sample luminances, from which the
+   error of each pixel can be estimated for adaptive sampling. */
 class Film {
 
 private:
@@ -17,7 +21,12 @@ private:
 	/* Instance vars */
 	unsigned int pixelWidth;				// Image width in pixels
 	unsigned int pixelHeight;				// Image width in pixels
-	vector<rgb>** sampleGrid;				// Stores accumulated samples
+	vector<rgb> colorSums;					// Weighted sum of samples, row-major
+	vector<double> weights;					// Sum of sample weights, row-major
+	vector<double> lumSums;					// Sum of sample luminances, row-major
+	vector<double> lumSquares;				// Sum of squared sample luminances, row-major
+	vector<unsigned int> sampleCounts;		// Samples committed, row-major
+	vector<pthread_mutex_t> rowLocks;		// Guard commits; shared by every Nth row
 
 public:
 
@@ -29,6 +38,10 @@ public:
 
 	/* Instance methods */
 	void commit(const Sample& samp, const rgb& color);		// Stores one sample
+	void commit(const Sample& samp, const rgb& color, double weight);
+	unsigned int getSampleCount(unsigned int i, unsigned int j) const;
+	double estimateError(unsigned int i, unsigned int j) const;
+	double errorPercentile(double fraction) const;
 	void writeImage(string filename);						// Writes to a file
 };
 
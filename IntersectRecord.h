@@ -13,10 +13,15 @@ class Primitive;
    a ray and a primitive. */
 typedef struct intersect_record_struct {
 
-	double t;					// t-value at which ray intersected
+	scalar t;					// t-value at which ray intersected
 	vec3 point;					// Point at which ray intersected
 	vec3 surfaceNormal;			// Surface normal at intersection point
 	Primitive* primitive;		// Primitive that was intersected
+	Primitive* leafPrimitive;	// Innermost primitive hit (differs from
+								// primitive for meshes); use for shading
+	unsigned int element;		// Triangle hit, for primitives that hold
+	scalar beta;				// many without a Shape each (CompactMesh),
+	scalar gamma;				// and its barycentric weights at the hit
 	// ...etc.
 
 } IntersectRecord;
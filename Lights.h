@@ -12,7 +12,6 @@
 #include "Ray.h"
 #include "rgb.h"
 #include "algebra3.h"
-#include "randomc.h"
 #include <vector>
 
 using namespace std;
@@ -96,8 +95,7 @@ class AreaLight: public Light {
 
 public:
 	
-	AreaLight(const vec3& position, const vec3& edge1, const vec3& edge2, const rgb color, int sampleRate);
-	~AreaLight();
+	AreaLight(const vec3& position, const vec3& edge1, const vec3& edge2, const rgb color);
 	Ray getShadowRay(const vec3& startPoint, double bias, Ray& viewRay);
 
 private:
@@ -105,8 +103,6 @@ private:
 	vec3 position;
 	vec3 edge1;
 	vec3 edge2;
-	CRandomMersenne* randGen;
-	vector< vector<vec3> > jitteredPoints;
 	vec3 getIncidence(const vec3 &point, Ray& viewRay);
 
 };
@@ -0,0 +1,532 @@
+#include "LinearBoundingBoxTree.h"
+#include "TriangleGroup.h"
+#include "algebra3f.h"
+#include <cfloat>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+
+// Most primitives the list builder puts in one leaf.
+#define MAX_LEAF_SIZE 4
+// Fewest rays of a packet worth keeping together; below this, the ray
+// left in a node finishes its subtree alone.
+#define PACKET_MIN_ACTIVE 2
+
+
+/* The rays of a packet in structure-of-arrays form, so one node can be
+   tested against all of them at once. Lanes without an active ray get
+   empty bounds. */
+typedef struct packet_lanes_struct {
+
+	float org[3][PACKET_SIZE];
+	float inv[3][PACKET_SIZE];
+	float tMin[PACKET_SIZE], tMax[PACKET_SIZE];
+
+} PacketLanes;
+
+
+// Converts the ray to the single-precision form the slab test uses.
+static inline void setupRay(Ray& ray, float org[3], float inv[3], int dirIsNeg[3]) {
+
+	vec3 origin = ray.getOrigin();
+	vec3 inverse = ray.getInverseDirection();
+	for (int k = 0; k < 3; k++) {
+		org[k] = (float)origin[k];
+		inv[k] = (float)inverse[k];
+		dirIsNeg[k] = ray.getSign(k);
+	}
+}
+
+// Slab test in single precision. A node's corners are loaded four floats
+// at a time; the stray fourth lanes (the max corner's x, then the offset)
+// are ignored by box3f.
+static inline bool hitsNode(const LinearNode& node, const vec3f& org, const vec3f& inv,
+							double tMin, double tMax) {
+
+	box3f box(vec3f(float4::load(node.bounds[0])), vec3f(float4::load(node.bounds[1])));
+	float tNear, tFar;
+	box.slabs(org, inv, tNear, tFar);
+	return tNear <= tFar && tNear < tMax && tFar > tMin;
+}
+
+// Slab test of the node against the lanes in ACTIVE, four at a time. The
+// lanes' float bounds are rounded outwards, so this accepts everything
+// hitsNode() would.
+static inline unsigned int lanesHitNode(const LinearNode& node, const PacketLanes& lanes, unsigned int active) {
+
+	float4 lo[3], hi[3];
+	for (int axis = 0; axis < 3; axis++) {
+		lo[axis] = float4(node.bounds[0][axis]);
+		hi[axis] = float4(node.bounds[1][axis]);
+	}
+
+	unsigned int mask = 0;
+	for (int k = 0; k < PACKET_SIZE; k += 4) {
+		if (((active >> k) & 15) == 0)
+			continue;
+		float4 slabNear(-FLT_MAX), slabFar(FLT_MAX);
+		for (int axis = 0; axis < 3; axis++) {
+			float4 org = float4::load(&lanes.org[axis][k]);
+			float4 inv = float4::load(&lanes.inv[axis][k]);
+			float4 t0 = (lo[axis] - org) * inv;
+			float4 t1 = (hi[axis] - org) * inv;
+			slabNear = vmax(slabNear, vmin(t0, t1));
+			slabFar = vmin(slabFar, vmax(t0, t1));
+		}
+		slabFar = slabFar * float4(1.0000004f);
+		float4 hit = (slabNear <= slabFar) & (slabNear < float4::load(&lanes.tMax[k]))
+			& (slabFar > float4::load(&lanes.tMin[k]));
+		mask |= (unsigned int)movemask(hit) << k;
+	}
+	return mask & active;
+}
+
+// Nearest floats at or beyond a double bound, for the lanes' ray bounds.
+static inline float floatBelow(double value) {
+
+	float result = (float)value;
+	return result > value ? nextafterf(result, -FLT_MAX) : result;
+}
+
+static inline float floatAbove(double value) {
+
+	float result = (float)value;
+	return result < value ? nextafterf(result, FLT_MAX) : result;
+}
+
+static inline unsigned int countBits(unsigned int mask) {
+
+	unsigned int count = 0;
+	for (; mask != 0; mask &= mask - 1)
+		count++;
+	return count;
+}
+
+
+/* Constructors */
+
+// Compiles an existing tree. The new tree takes over the old tree's
+// primitives and deletes its nodes; "tree" must not be used afterwards.
+LinearBoundingBoxTree::LinearBoundingBoxTree(BoundingBoxTree* tree) {
+
+	nodes = NULL;
+	nodeCount = nodeCapacity = 0;
+	box = tree->getBoundingBox();
+
+	flatten(tree);
+	depth = treeDepth(nodes, nodeCount);
+	tree->releasePrimitives();
+	delete tree;
+}
+
+// Builds directly from a list of primitives with the binned SAH, putting
+// up to MAX_LEAF_SIZE primitives in each leaf.
+LinearBoundingBoxTree::LinearBoundingBoxTree(const vector<Primitive*>& objects) {
+
+	nodes = NULL;
+	nodeCount = nodeCapacity = 0;
+
+	vector<BuildEntry> entries(objects.size());
+	for (unsigned int i = 0; i < objects.size(); i++) {
+		entries[i].primitive = objects[i];
+		entries[i].box = objects[i]->getBoundingBox();
+		for (int axis = 0; axis < 3; axis++)
+			entries[i].centroid[axis] = (entries[i].box.minCoordinate(axis) + entries[i].box.maxCoordinate(axis)) / 2;
+		box = i == 0 ? entries[i].box : BoundingBox::combine(box, entries[i].box);
+	}
+	allocateNodes(2 * objects.size());
+	if (objects.size() > 0)
+		build(entries, 0, objects.size());
+	depth = treeDepth(nodes, nodeCount);
+}
+
+LinearBoundingBoxTree::~LinearBoundingBoxTree() {
+
+	for (unsigned int i = 0; i < primitives.size(); i++)
+		delete primitives[i];
+	free(nodes);
+}
+
+
+/* Instance methods */
+
+bool LinearBoundingBoxTree::intersect(Ray& ray, IntersectRecord* rec) {
+
+	if (nodeCount == 0)
+		return false;
+
+	double tMin = ray.getLowerBound();
+	double oldMax = ray.getUpperBound();
+	rec->t = oldMax;
+	bool hit = intersectFrom(0, ray, rec);
+	ray.setBounds(tMin, oldMax);		// Reset ray bounds before returning
+	return hit;
+}
+
+// Closest-hit traversal of the subtree at "root". Every hit narrows the
+// ray's upper bound to rec->t, and the bounds are left that way.
+bool LinearBoundingBoxTree::intersectFrom(unsigned int root, Ray& ray, IntersectRecord* rec) {
+
+	double tMin = ray.getLowerBound();
+	float org[3], inv[3];
+	int dirIsNeg[3];
+	setupRay(ray, org, inv, dirIsNeg);
+	vec3f rayOrg(org[VX], org[VY], org[VZ]), rayInv(inv[VX], inv[VY], inv[VZ]);
+
+	bool hit = false;
+	TraversalStack<unsigned int> stack(depth);
+	unsigned int current = root;
+
+	while (true) {
+		const LinearNode& node = nodes[current];
+
+		if (hitsNode(node, rayOrg, rayInv, tMin, ray.getUpperBound())) {
+			if (node.count > 0) {
+				for (unsigned int i = node.offset; i < node.offset + node.count; i++)
+					if (primitives[i]->intersect(ray, rec)) {
+						hit = true;
+						ray.setBounds(tMin, rec->t);
+					}
+				if (stack.empty())
+					break;
+				current = stack.pop();
+			} else {
+				// Visit the near child first; save the far one for later.
+				if (dirIsNeg[node.axis]) {
+					stack.push(current + 1);
+					current = node.offset;
+				} else {
+					stack.push(node.offset);
+					current = current + 1;
+				}
+			}
+		} else {
+			if (stack.empty())
+				break;
+			current = stack.pop();
+		}
+	}
+	return hit;
+}
+
+// Closest-hit traversal for a packet of rays. Each node is tested against
+// all the rays still active in it at once, and the packet descends into it
+// if any of them hit. Children are visited in the order that suits the
+// first ray. Once fewer than PACKET_MIN_ACTIVE rays remain in a node, they
+// go on alone.
+unsigned int LinearBoundingBoxTree::intersectPacket(RayPacket& packet, unsigned int mask) {
+
+	if (nodeCount == 0 || mask == 0)
+		return 0;
+
+	PacketLanes lanes;
+	double tMin[PACKET_SIZE], oldMax[PACKET_SIZE];
+	int dirIsNeg[3];
+	bool first = true;
+
+	for (unsigned int k = 0; k < PACKET_SIZE; k++) {
+		if (k >= packet.size || !(mask & (1u << k))) {
+			for (int axis = 0; axis < 3; axis++)
+				lanes.org[axis][k] = lanes.inv[axis][k] = 0;
+			lanes.tMin[k] = FLT_MAX;
+			lanes.tMax[k] = -FLT_MAX;
+			continue;
+		}
+		Ray& ray = *packet.rays[k];
+		float org[3], inv[3];
+		int neg[3];
+		setupRay(ray, org, inv, neg);
+		tMin[k] = ray.getLowerBound();
+		oldMax[k] = ray.getUpperBound();
+		packet.records[k]->t = oldMax[k];
+		for (int axis = 0; axis < 3; axis++) {
+			lanes.org[axis][k] = org[axis];
+			lanes.inv[axis][k] = inv[axis];
+		}
+		lanes.tMin[k] = floatBelow(tMin[k]);
+		lanes.tMax[k] = floatAbove(oldMax[k]);
+
+		if (first) {
+			first = false;
+			for (int axis = 0; axis < 3; axis++)
+				dirIsNeg[axis] = neg[axis];
+		}
+	}
+
+	unsigned int hits = 0;
+	TraversalStack<unsigned int> stack(depth);
+	TraversalStack<unsigned int> stackMask(depth);
+	unsigned int current = 0;
+	unsigned int active = mask;
+
+	while (true) {
+		const LinearNode& node = nodes[current];
+
+		unsigned int inside = lanesHitNode(node, lanes, active);
+		if (inside != 0) {
+			if (node.count > 0) {
+				for (unsigned int i = node.offset; i < node.offset + node.count; i++) {
+					unsigned int found = primitives[i]->intersectPacket(packet, inside);
+					hits |= found;
+					for (unsigned int k = 0; k < packet.size; k++)
+						if (found & (1u << k)) {
+							packet.rays[k]->setBounds(tMin[k], packet.records[k]->t);
+							lanes.tMax[k] = floatAbove(packet.records[k]->t);
+						}
+				}
+			} else if (countBits(inside) < PACKET_MIN_ACTIVE) {
+				for (unsigned int k = 0; k < packet.size; k++)
+					if ((inside & (1u << k)) && intersectFrom(current, *packet.rays[k], packet.records[k])) {
+						hits |= 1u << k;
+						lanes.tMax[k] = floatAbove(packet.records[k]->t);
+					}
+			} else {
+				if (dirIsNeg[node.axis]) {
+					stack.push(current + 1);
+					current = node.offset;
+				} else {
+					stack.push(node.offset);
+					current = current + 1;
+				}
+				stackMask.push(inside);
+				active = inside;
+				continue;
+			}
+		}
+		if (stack.empty())
+			break;
+		current = stack.pop();
+		active = stackMask.pop();
+	}
+
+	for (unsigned int k = 0; k < packet.size; k++)
+		if (mask & (1u << k))
+			packet.rays[k]->setBounds(tMin[k], oldMax[k]);		// Reset ray bounds before returning
+	return hits;
+}
+
+// Same traversal as intersect(), but stops at the first occluder and
+// never touches the ray's bounds.
+bool LinearBoundingBoxTree::intersectAny(Ray& ray) {
+
+	if (nodeCount == 0)
+		return false;
+
+	float org[3], inv[3];
+	int dirIsNeg[3];
+	setupRay(ray, org, inv, dirIsNeg);
+	vec3f rayOrg(org[VX], org[VY], org[VZ]), rayInv(inv[VX], inv[VY], inv[VZ]);
+
+	double tMin = ray.getLowerBound();
+	double tMax = ray.getUpperBound();
+	TraversalStack<unsigned int> stack(depth);
+	unsigned int current = 0;
+
+	while (true) {
+		const LinearNode& node = nodes[current];
+
+		if (hitsNode(node, rayOrg, rayInv, tMin, tMax)) {
+			if (node.count > 0) {
+				for (unsigned int i = node.offset; i < node.offset + node.count; i++)
+					if (primitives[i]->intersectAny(ray))
+						return true;
+			} else {
+				if (dirIsNeg[node.axis]) {
+					stack.push(current + 1);
+					current = node.offset;
+				} else {
+					stack.push(node.offset);
+					current = current + 1;
+				}
+				continue;
+			}
+		}
+		if (stack.empty())
+			return false;
+		current = stack.pop();
+	}
+}
+
+Reflectance LinearBoundingBoxTree::getReflectance(const vec3& point) {
+
+	// This should never be called.
+	throw "LinearBoundingBoxTree does not implement this method.";
+}
+
+BoundingBox LinearBoundingBoxTree::getBoundingBox() {
+
+	return box;
+}
+
+void LinearBoundingBoxTree::addMemoryUsage(MemoryUsage& usage) {
+
+	usage.acceleration += sizeof(LinearBoundingBoxTree) + nodeCapacity * sizeof(LinearNode) +
+		primitives.capacity() * sizeof(Primitive*);
+	for (unsigned int i = 0; i < primitives.size(); i++)
+		primitives[i]->addMemoryUsage(usage);
+}
+
+Primitive* LinearBoundingBoxTree::instance(const mat4& transform, Material* mat) {
+
+	vector<Primitive*> copies;
+	for (unsigned int i = 0; i < primitives.size(); i++)
+		copies.push_back(primitives[i]->instance(transform, mat));
+	return new LinearBoundingBoxTree(copies);
+}
+
+unsigned int LinearBoundingBoxTree::getNodeCount() {
+
+	return nodeCount;
+}
+
+// Appends the subtree rooted at "tree" in depth-first order and returns the
+// index of its root. A node whose children are both primitives becomes a
+// single leaf, as does a subtree small enough to be one TriangleGroup.
+unsigned int LinearBoundingBoxTree::flatten(BoundingBoxTree* tree) {
+
+	Primitive* children[2] = { tree->low, tree->high };
+	BoundingBoxTree* subtrees[2];
+	for (int i = 0; i < 2; i++)
+		subtrees[i] = dynamic_cast<BoundingBoxTree*>(children[i]);
+
+	// CASE: Only one child, which is a subtree; it needs no node of its own.
+	if (children[0] == NULL && subtrees[1] != NULL)
+		return flatten(subtrees[1]);
+	if (children[1] == NULL && subtrees[0] != NULL)
+		return flatten(subtrees[0]);
+
+	unsigned int index = allocateNode(tree->box);
+
+	// CASE: A few mesh triangles, intersected together.
+	vector<Primitive*> triangles;
+	if (TriangleGroup::gather(tree, triangles) && triangles.size() > 1) {
+		nodes[index].offset = primitives.size();
+		nodes[index].count = 1;
+		primitives.push_back(new TriangleGroup(triangles));
+		return index;
+	}
+
+	// CASE: No subtrees, so this node becomes a single leaf.
+	if (subtrees[0] == NULL && subtrees[1] == NULL) {
+		nodes[index].offset = primitives.size();
+		for (int i = 0; i < 2; i++)
+			if (children[i] != NULL)
+				primitives.push_back(children[i]);
+		nodes[index].count = primitives.size() - nodes[index].offset;
+		return index;
+	}
+
+	nodes[index].axis = tree->splitAxis;
+	for (int i = 0; i < 2; i++) {
+		unsigned int child = subtrees[i] != NULL ? flatten(subtrees[i]) : flattenLeaf(children[i]);
+		if (i == 1)
+			nodes[index].offset = child;
+	}
+	return index;
+}
+
+unsigned int LinearBoundingBoxTree::flattenLeaf(Primitive* prim) {
+
+	unsigned int index = allocateNode(prim->getBoundingBox());
+	nodes[index].offset = primitives.size();
+	nodes[index].count = 1;
+	primitives.push_back(prim);
+	return index;
+}
+
+// Builds the subtree over entries[begin, end) and returns its root's index.
+unsigned int LinearBoundingBoxTree::build(vector<BuildEntry>& entries, unsigned int begin, unsigned int end) {
+
+	BoundingBox bounds = entries[begin].box;
+	for (unsigned int i = begin + 1; i < end; i++)
+		bounds = BoundingBox::combine(bounds, entries[i].box);
+	unsigned int index = allocateNode(bounds);
+
+	if (end - begin <= MAX_LEAF_SIZE) {
+		nodes[index].offset = primitives.size();
+		vector<Primitive*> triangles;
+		vec3 vertices[3];
+		for (unsigned int i = begin; i < end; i++)
+			if (TriangleGroup::getVertices(entries[i].primitive, vertices))
+				triangles.push_back(entries[i].primitive);
+		// CASE: All mesh triangles, intersected together.
+		if (triangles.size() == end - begin && triangles.size() > 1 && triangles.size() <= TRIANGLE_GROUP_SIZE)
+			primitives.push_back(new TriangleGroup(triangles));
+		else for (unsigned int i = begin; i < end; i++)
+			primitives.push_back(entries[i].primitive);
+		nodes[index].count = primitives.size() - nodes[index].offset;
+		return index;
+	}
+
+	int axis;
+	unsigned int mid = BoundingBoxTree::partitionSAH(entries, begin, end, &axis);
+	nodes[index].axis = axis;
+	build(entries, begin, mid);
+	unsigned int second = build(entries, mid, end);
+	nodes[index].offset = second;
+	return index;
+}
+
+// Appends a node with the given bounds, rounded outwards to floats.
+unsigned int LinearBoundingBoxTree::allocateNode(const BoundingBox& bounds) {
+
+	if (nodeCount == nodeCapacity)
+		allocateNodes(MAX(64, 2 * nodeCapacity));
+
+	LinearNode& node = nodes[nodeCount];
+	setNodeBounds(node, bounds);
+	node.offset = 0;
+	node.count = 0;
+	node.axis = 0;
+	node.pad = 0;
+	return nodeCount++;
+}
+
+// Number of interior nodes above the deepest leaf of a depth-first node
+// array, which is the most a traversal stack can hold at once. Children
+// come after their parents, so one pass in order finds every node's level.
+unsigned int LinearBoundingBoxTree::treeDepth(const LinearNode* nodes, unsigned int count) {
+
+	vector<unsigned int> level(count, 0);
+	unsigned int deepest = 0;
+	for (unsigned int i = 0; i < count; i++) {
+		deepest = MAX(deepest, level[i]);
+		if (nodes[i].count == 0) {
+			level[i + 1] = level[i] + 1;
+			level[nodes[i].offset] = level[i] + 1;
+		}
+	}
+	return deepest;
+}
+
+// Stores "bounds" in the node, rounded outwards to floats.
+void LinearBoundingBoxTree::setNodeBounds(LinearNode& node, const BoundingBox& bounds) {
+
+	BoundingBox b = bounds;
+	for (int k = 0; k < 3; k++) {
+		float lo = (float)b.minCoordinate(k);
+		float hi = (float)b.maxCoordinate(k);
+		if (lo > b.minCoordinate(k))
+			lo = nextafterf(lo, -FLT_MAX);
+		if (hi < b.maxCoordinate(k))
+			hi = nextafterf(hi, FLT_MAX);
+		node.bounds[0][k] = lo;
+		node.bounds[1][k] = hi;
+	}
+}
+
+// Grows the node array to hold at least "count" nodes.
+void LinearBoundingBoxTree::allocateNodes(unsigned int count) {
+
+	if (count <= nodeCapacity)
+		return;
+	void* memory;
+	if (posix_memalign(&memory, 32, count * sizeof(LinearNode)) != 0)
+		throw "LinearBoundingBoxTree could not allocate nodes.";
+	if (nodes != NULL) {
+		memcpy(memory, nodes, nodeCount * sizeof(LinearNode));
+		free(nodes);
+	}
+	nodes = (LinearNode*)memory;
+	nodeCapacity = count;
+}
@@ -0,0 +1,79 @@
+#ifndef LINEARBOUNDINGBOXTREEH
+#define LINEARBOUNDINGBOXTREEH
+
+#include "Primitives.h"
+#include "Ray.h"
+#include "IntersectRecord.h"
+#include "TraversalStack.h"
+#include <vector>
+
+using namespace std;
+
+
+/* One node of a LinearBoundingBoxTree, padded to 32 bytes so that two
+   nodes share a 64-byte cache line. Bounds are stored as floats, rounded
+   outwards so they never shrink. An interior node's first child follows it
+   directly in the array; "offset" is the index of its second child. A
+   leaf's primitives are primitives[offset, offset + count). */
+typedef struct linear_node_struct {
+
+	float bounds[2][3];				// Min corner, max corner
+	unsigned int offset;			// Second child (interior) or first primitive (leaf)
+	unsigned short count;			// Number of primitives; 0 for interior nodes
+	unsigned char axis;				// Split axis of an interior node
+	unsigned char pad;
+
+} LinearNode;
+
+
+/* A bounding volume hierarchy compiled into one contiguous, depth-first
+   array of nodes. Traversal is iterative with an explicit stack and calls
+   no virtual methods until it reaches a leaf. Coherent rays can also be
+   traced as a packet, sharing one traversal. Build it once the scene is
+   loaded, either from a BoundingBoxTree or straight from the primitives. */
+class LinearBoundingBoxTree : public Primitive {
+
+public:
+
+	/* Constructors */
+	LinearBoundingBoxTree(BoundingBoxTree* tree);
+	LinearBoundingBoxTree(const vector<Primitive*>& objects);
+
+	~LinearBoundingBoxTree();
+
+	/* Instance methods */
+	bool intersect(Ray& ray, IntersectRecord* rec);
+	bool intersectAny(Ray& ray);
+	unsigned int intersectPacket(RayPacket& packet, unsigned int mask);
+	Reflectance getReflectance(const vec3& point);
+	BoundingBox getBoundingBox();
+	void addMemoryUsage(MemoryUsage& usage);
+	Primitive* instance(const mat4& transform, Material* mat);
+	unsigned int getNodeCount();
+
+	/* Static methods */
+	static void setNodeBounds(LinearNode& node, const BoundingBox& bounds);
+	static unsigned int treeDepth(const LinearNode* nodes, unsigned int count);
+
+private:
+
+	/* Instance methods */
+	bool intersectFrom(unsigned int root, Ray& ray, IntersectRecord* rec);
+	unsigned int flatten(BoundingBoxTree* tree);
+	unsigned int flattenLeaf(Primitive* prim);
+	unsigned int build(vector<BuildEntry>& entries, unsigned int begin, unsigned int end);
+	unsigned int allocateNode(const BoundingBox& box);
+	void allocateNodes(unsigned int count);
+
+	/* Instance vars */
+	LinearNode* nodes;				// 32-byte aligned node array
+	unsigned int nodeCount;
+	unsigned int nodeCapacity;
+	vector<Primitive*> primitives;	// Leaf primitives, grouped by leaf
+	BoundingBox box;				// Exact (double) bounds of the whole tree
+	unsigned int depth;				// Most interior nodes above any leaf
+
+};
+
+
+#endif
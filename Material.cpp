@@ -64,6 +64,12 @@ Reflectance Material::getReflectance(const vec3& point, Shape* shape) {
 
 }
 
+Reflectance Material::getReflectance(const vec2&) {
+
+	return myReflectance;
+
+}
+
 
 ////////////////////////////////////////////////
 //			   TEXTUREDMATERIAL				  //
@@ -85,6 +91,12 @@ Reflectance TexturedMaterial::getReflectance(const vec3& point, Shape* shape) {
 
 }
 
+Reflectance TexturedMaterial::getReflectance(const vec2& textureCoordinate) {
+
+	return multiply(myReflectance, texture->getColor(textureCoordinate), rough);
+
+}
+
 Reflectance TexturedMaterial::multiply(const Reflectance& ref, const rgb& color, bool rough) {
 
 	Reflectance toReturn = ref;
@@ -59,6 +59,8 @@ public:
 
 	/* Instance methods */
 	virtual Reflectance getReflectance(const vec3& point, Shape* shape);
+	// For surfaces that work out their own texture coordinate.
+	virtual Reflectance getReflectance(const vec2& textureCoordinate);
 };
 
 
@@ -68,6 +70,7 @@ public:
 	
 	TexturedMaterial(Reflectance reflec, Texture* texMap, bool rough);
 	Reflectance getReflectance(const vec3& point, Shape* shape);
+	Reflectance getReflectance(const vec2& textureCoordinate);
 
 private:
 
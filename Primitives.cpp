@@ -1,6 +1,38 @@
 #include "Primitives.h"
+#include "LinearBoundingBoxTree.h"
+#include "WideBoundingBoxTree.h"
 #include "algebra3.h"
+#include "TileScheduler.h"
 #include <cfloat>
+#include <algorithm>
+#include <pthread.h>
+// Smallest range of entries worth splitting across threads during a build.
+#define PARALLEL_BUILD_MIN 16384
+// Above this many primitives, Morton codes use 21 bits per axis instead of 10.
+#define MORTON_WIDE_MIN (1 << 20)
+// Leading Morton code bits that group primitives into treelets for the
+// SAH top level of mortonSAHSplit.
+#define TREELET_BITS 12
+
+///////////////////////////////////////////////
+//			  Primitive Class                //
+///////////////////////////////////////////////
+
+// One ray at a time.
+unsigned int Primitive::intersectPacket(RayPacket& packet, unsigned int mask) {
+
+	unsigned int hits = 0;
+	for (unsigned int k = 0; k < packet.size; k++)
+		if ((mask & (1u << k)) && intersect(*packet.rays[k], packet.records[k]))
+			hits |= 1u << k;
+	return hits;
+}
+
+Reflectance Primitive::getHitReflectance(const IntersectRecord& rec) {
+
+	return getReflectance(rec.point);
+}
+
 
 ///////////////////////////////////////////////
 //			  GeoPrimitive Class             //
@@ -31,11 +63,21 @@ bool GeoPrimitive::intersect(Ray& ray, IntersectRecord* rec) {
 	bool hit = shape->intersect(ray, rec);
 	if (hit) {
 		rec->primitive = this;
+		rec->leafPrimitive = this;
 		return true;
 	} else return false;
 
 }
 
+bool GeoPrimitive::intersectAny(Ray& ray) {
+
+	// Don't let a refracting object shadow points inside itself.
+	if (this == ray.getLastHitPrim())
+		return false;
+	return shape->intersectAny(ray);
+
+}
+
 Reflectance GeoPrimitive::getReflectance(const vec3& point) {
 
 	return material->getReflectance(point, shape);
@@ -48,21 +90,48 @@ BoundingBox GeoPrimitive::getBoundingBox() {
 
 }
 
+void GeoPrimitive::addMemoryUsage(MemoryUsage& usage) {
+
+	usage.geometry += sizeof(GeoPrimitive);
+	shape->addMemoryUsage(usage);
+}
+
 Primitive* GeoPrimitive::instance(const mat4& transform, Material* mat) {
 
 	return new GeoPrimitive(new TransformedShape(shape, transform), mat);
 }
 
+Shape* GeoPrimitive::getShape() {
+
+	return shape;
+}
+
 
 ///////////////////////////////////////////////
 //			BoundingBoxTree Class            //
 ///////////////////////////////////////////////
 
-BoundingBoxTree::BoundingBoxTree(const vector<Primitive*>& objects, int splitAxis) {
+BoundingBoxTree::BoundingBoxTree(const vector<Primitive*>& objects, int splitAxis, SplitMethod method) {
 
 	this->splitAxis = splitAxis;
 	unsigned int length = objects.size();
 
+	if (method != midpointSplit && length > 2) {
+		double start = TileScheduler::currentTime();
+		// Fetch every bounding box once up front; getBoundingBox() can be
+		// expensive (e.g. for transformed shapes).
+		vector<BuildEntry> entries(length);
+		vector<BuildTask> tasks = splitTasks(entries, 0, length, length < PARALLEL_BUILD_MIN ? 1 : buildThreads);
+		for (unsigned int t = 0; t < tasks.size(); t++)
+			tasks[t].objects = &objects;
+		runTasks(fillEntries, tasks);
+		if (method == sahSplit)
+			buildSAH(entries, 0, length, buildThreads);
+		else buildMorton(entries, method == mortonSAHSplit);
+		buildTime += TileScheduler::currentTime() - start;
+		return;
+	}
+
 	if (length == 1) {
 		low = objects[0];
 		high = NULL;
@@ -75,8 +144,8 @@ BoundingBoxTree::BoundingBoxTree(const vector<Primitive*>& objects, int splitAxi
 		vector<Primitive*> lowVec;
 		vector<Primitive*> highVec;
 		partition(splitAxis, objects, &lowVec, &highVec);
-		low = lowVec.size() > 0 ? new BoundingBoxTree(lowVec, (splitAxis + 1) % 3) : NULL;
-		high = highVec.size() > 0 ? new BoundingBoxTree(highVec, (splitAxis + 1) % 3) : NULL;
+		low = lowVec.size() > 0 ? new BoundingBoxTree(lowVec, (splitAxis + 1) % 3, midpointSplit) : NULL;
+		high = highVec.size() > 0 ? new BoundingBoxTree(highVec, (splitAxis + 1) % 3, midpointSplit) : NULL;
 		if (low == NULL)
 			box = high->getBoundingBox();
 		else if (high == NULL)
@@ -146,6 +215,508 @@ void BoundingBoxTree::partition(int axis, const vector<Primitive*>& all, vector<
 	}
 }
 
+BoundingBoxTree::BoundingBoxTree(vector<BuildEntry>& entries, unsigned int begin, unsigned int end, unsigned int threads) {
+
+	buildSAH(entries, begin, end, threads);
+}
+
+// Builds the subtree over entries[begin, end), reordering that range. With
+// more than one thread, the two halves of a large range are built
+// concurrently, each with its share of the threads.
+void BoundingBoxTree::buildSAH(vector<BuildEntry>& entries, unsigned int begin, unsigned int end, unsigned int threads) {
+
+	splitAxis = VX;
+	unsigned int length = end - begin;
+
+	if (length == 1) {
+		low = entries[begin].primitive;
+		high = NULL;
+		box = entries[begin].box;
+		return;
+	}
+	if (length == 2) {
+		low = entries[begin].primitive;
+		high = entries[begin+1].primitive;
+		box = BoundingBox::combine(entries[begin].box, entries[begin+1].box);
+		return;
+	}
+
+	unsigned int mid = partitionSAH(entries, begin, end, &splitAxis, threads);
+
+	// CASE: Big enough to hand the high half to another thread.
+	if (threads > 1 && length >= PARALLEL_BUILD_MIN && mid - begin > 1 && end - mid > 1) {
+		SubtreeTask task = { &entries, mid, end, threads - threads / 2, NULL };
+		pthread_t thread;
+		bool spawned = pthread_create(&thread, NULL, buildSubtree, &task) == 0;
+		low = new BoundingBoxTree(entries, begin, mid, threads / 2);
+		if (spawned)
+			pthread_join(thread, NULL);
+		else buildSubtree(&task);
+		high = task.tree;
+		box = BoundingBox::combine(low->getBoundingBox(), high->getBoundingBox());
+		return;
+	}
+
+	BoundingBox lowBox, highBox;
+	if (mid - begin == 1) {
+		low = entries[begin].primitive;
+		lowBox = entries[begin].box;
+	} else {
+		low = new BoundingBoxTree(entries, begin, mid, 1);
+		lowBox = low->getBoundingBox();
+	}
+	if (end - mid == 1) {
+		high = entries[mid].primitive;
+		highBox = entries[mid].box;
+	} else {
+		high = new BoundingBoxTree(entries, mid, end, 1);
+		highBox = high->getBoundingBox();
+	}
+	box = BoundingBox::combine(lowBox, highBox);
+}
+
+// An empty node for the Morton builder to fill in.
+BoundingBoxTree::BoundingBoxTree() {
+
+	splitAxis = VX;
+	low = high = NULL;
+}
+
+// Builds a linear BVH (LBVH) over all the entries: primitives are sorted by
+// the Morton code of their centroids, and each node splits its range where
+// the highest differing bit of the codes changes. Near-linear time, at some
+// cost in traversal speed. With "refine", the leading TREELET_BITS bits
+// group the primitives into treelets, each built that way, and the
+// treelets are joined with the SAH builder.
+void BoundingBoxTree::buildMorton(vector<BuildEntry>& entries, bool refine) {
+
+	unsigned int length = entries.size();
+	vector<BuildTask> tasks = splitTasks(entries, 0, length, length < PARALLEL_BUILD_MIN ? 1 : buildThreads);
+	runTasks(findCentroidBounds, tasks);
+	vec3 cMin = tasks[0].cMin;
+	vec3 cMax = tasks[0].cMax;
+	for (unsigned int t = 1; t < tasks.size(); t++)
+		for (int k = 0; k < 3; k++) {
+			cMin[k] = MIN(cMin[k], tasks[t].cMin[k]);
+			cMax[k] = MAX(cMax[k], tasks[t].cMax[k]);
+		}
+
+	// Quantize each centroid to a grid over the centroid bounds and
+	// interleave the coordinates' bits, x highest. With 21 bits per axis
+	// a tree can split on all 63 code bits and go deeper than 64 levels;
+	// the traversals size their stacks from the depth, so that's safe.
+	int axisBits = length > MORTON_WIDE_MIN ? 21 : 10;
+	double cells = (double)((1 << axisBits) - 1);
+	vector<MortonEntry> keys(length);
+	for (unsigned int i = 0; i < length; i++) {
+		keys[i].code = 0;
+		keys[i].index = i;
+		for (int k = 0; k < 3; k++) {
+			double extent = cMax[k] - cMin[k];
+			unsigned long long cell = extent > 0 ? (unsigned long long)((entries[i].centroid[k] - cMin[k]) / extent * cells) : 0;
+			keys[i].code |= spreadBits(cell) << (2 - k);
+		}
+	}
+	radixSort(keys, 3 * axisBits);
+
+	vector<BuildEntry> sorted(length);
+	vector<unsigned long long> codes(length);
+	for (unsigned int i = 0; i < length; i++) {
+		sorted[i] = entries[keys[i].index];
+		codes[i] = keys[i].code;
+	}
+
+	int topBit = 3 * axisBits - 1;
+	if (!refine) {
+		emitMorton(sorted, codes, 0, length, topBit);
+		return;
+	}
+
+	// Build a treelet for each run of codes sharing their leading bits.
+	vector<BuildEntry> treelets;
+	unsigned int shift = 3 * axisBits - TREELET_BITS;
+	for (unsigned int begin = 0; begin < length; ) {
+		unsigned int end = begin + 1;
+		while (end < length && (codes[end] >> shift) == (codes[begin] >> shift))
+			end++;
+		BuildEntry treelet;
+		if (end - begin == 1)
+			treelet = sorted[begin];
+		else {
+			BoundingBoxTree* tree = new BoundingBoxTree();
+			tree->emitMorton(sorted, codes, begin, end, shift - 1);
+			treelet.primitive = tree;
+			treelet.box = tree->box;
+			for (int k = 0; k < 3; k++)
+				treelet.centroid[k] = (treelet.box.minCoordinate(k) + treelet.box.maxCoordinate(k)) / 2;
+		}
+		treelets.push_back(treelet);
+		begin = end;
+	}
+
+	// CASE: Everything landed in one treelet; use it as is.
+	if (treelets.size() == 1) {
+		BoundingBoxTree* tree = (BoundingBoxTree*)treelets[0].primitive;
+		splitAxis = tree->splitAxis;
+		low = tree->low;
+		high = tree->high;
+		box = tree->box;
+		tree->low = tree->high = NULL;
+		delete tree;
+		return;
+	}
+	buildSAH(treelets, 0, treelets.size(), 1);
+}
+
+// Builds the subtree over entries[begin, end), whose codes all agree above
+// "bit", splitting where that bit (or the next one that varies) turns on.
+void BoundingBoxTree::emitMorton(vector<BuildEntry>& entries, const vector<unsigned long long>& codes, unsigned int begin, unsigned int end, int bit) {
+
+	unsigned int length = end - begin;
+	splitAxis = VX;
+
+	if (length == 1) {
+		low = entries[begin].primitive;
+		high = NULL;
+		box = entries[begin].box;
+		return;
+	}
+	if (length == 2) {
+		low = entries[begin].primitive;
+		high = entries[begin+1].primitive;
+		box = BoundingBox::combine(entries[begin].box, entries[begin+1].box);
+		return;
+	}
+
+	while (bit >= 0 && ((codes[begin] ^ codes[end-1]) & (1ULL << bit)) == 0)
+		bit--;
+
+	unsigned int mid;
+	// CASE: Identical codes; split the range in half.
+	if (bit < 0)
+		mid = begin + length / 2;
+	else {
+		// The codes are sorted, so binary search for the first with the bit set.
+		unsigned int lo = begin, hi = end - 1;
+		while (lo + 1 < hi) {
+			unsigned int probe = (lo + hi) / 2;
+			if (codes[probe] & (1ULL << bit))
+				hi = probe;
+			else lo = probe;
+		}
+		mid = hi;
+		splitAxis = 2 - bit % 3;
+	}
+
+	BoundingBox lowBox, highBox;
+	if (mid - begin == 1) {
+		low = entries[begin].primitive;
+		lowBox = entries[begin].box;
+	} else {
+		BoundingBoxTree* tree = new BoundingBoxTree();
+		tree->emitMorton(entries, codes, begin, mid, bit - 1);
+		low = tree;
+		lowBox = tree->box;
+	}
+	if (end - mid == 1) {
+		high = entries[mid].primitive;
+		highBox = entries[mid].box;
+	} else {
+		BoundingBoxTree* tree = new BoundingBoxTree();
+		tree->emitMorton(entries, codes, mid, end, bit - 1);
+		high = tree;
+		highBox = tree->box;
+	}
+	box = BoundingBox::combine(lowBox, highBox);
+}
+
+// Spreads the low 21 bits of x out to every third bit.
+unsigned long long BoundingBoxTree::spreadBits(unsigned long long x) {
+
+	x &= 0x1fffffULL;
+	x = (x | x << 32) & 0x1f00000000ffffULL;
+	x = (x | x << 16) & 0x1f0000ff0000ffULL;
+	x = (x | x << 8) & 0x100f00f00f00f00fULL;
+	x = (x | x << 4) & 0x10c30c30c30c30c3ULL;
+	x = (x | x << 2) & 0x1249249249249249ULL;
+	return x;
+}
+
+// Sorts keys by the low "bits" bits of their codes, eight bits per pass.
+void BoundingBoxTree::radixSort(vector<MortonEntry>& keys, int bits) {
+
+	vector<MortonEntry> buffer(keys.size());
+	vector<MortonEntry>* in = &keys;
+	vector<MortonEntry>* out = &buffer;
+	for (int shift = 0; shift < bits; shift += 8) {
+		unsigned int offsets[256];
+		for (int b = 0; b < 256; b++)
+			offsets[b] = 0;
+		for (unsigned int i = 0; i < in->size(); i++)
+			offsets[((*in)[i].code >> shift) & 0xff]++;
+		unsigned int total = 0;
+		for (int b = 0; b < 256; b++) {
+			unsigned int count = offsets[b];
+			offsets[b] = total;
+			total += count;
+		}
+		for (unsigned int i = 0; i < in->size(); i++)
+			(*out)[offsets[((*in)[i].code >> shift) & 0xff]++] = (*in)[i];
+		vector<MortonEntry>* swap = in;
+		in = out;
+		out = swap;
+	}
+	if (in != &keys)
+		keys = *in;
+}
+
+void* BoundingBoxTree::buildSubtree(void* arg) {
+
+	SubtreeTask* task = (SubtreeTask*)arg;
+	task->tree = new BoundingBoxTree(*task->entries, task->begin, task->end, task->threads);
+	return NULL;
+}
+
+void BoundingBoxTree::setBuildThreads(unsigned int threads) {
+
+	buildThreads = MAX(1, threads);
+}
+
+// Total wall-clock time spent in SAH builds so far, in seconds.
+double BoundingBoxTree::getBuildTime() {
+
+	return buildTime;
+}
+
+// Converts "tree" to the given layout. Unless the layout is pointerLayout,
+// the result takes over the tree's primitives and "tree" is deleted.
+Primitive* BoundingBoxTree::compile(BoundingBoxTree* tree, TreeLayout layout) {
+
+	if (layout == linearLayout)
+		return new LinearBoundingBoxTree(tree);
+	if (layout == wideLayout)
+		return new WideBoundingBoxTree(tree);
+	return tree;
+}
+
+// Detaches the primitives from a tree that has been compiled into another
+// layout, so that deleting it only frees its nodes.
+void BoundingBoxTree::releasePrimitives() {
+
+	Primitive** children[2] = { &low, &high };
+	for (int i = 0; i < 2; i++) {
+		BoundingBoxTree* subtree = dynamic_cast<BoundingBoxTree*>(*children[i]);
+		if (subtree != NULL)
+			subtree->releasePrimitives();
+		else *children[i] = NULL;
+	}
+}
+
+unsigned int BoundingBoxTree::buildThreads = 1;
+double BoundingBoxTree::buildTime = 0;
+
+// Divides entries[begin, end) into "threads" contiguous, nearly equal tasks.
+vector<BuildTask> BoundingBoxTree::splitTasks(vector<BuildEntry>& entries, unsigned int begin, unsigned int end, unsigned int threads) {
+
+	vector<BuildTask> tasks(threads);
+	for (unsigned int t = 0; t < threads; t++) {
+		tasks[t].objects = NULL;
+		tasks[t].entries = &entries;
+		tasks[t].begin = begin + (unsigned int)((unsigned long long)(end - begin) * t / threads);
+		tasks[t].end = begin + (unsigned int)((unsigned long long)(end - begin) * (t + 1) / threads);
+	}
+	return tasks;
+}
+
+// Runs worker on every task, one thread each. The calling thread takes the
+// first task itself, and any thread that can't be started runs inline.
+void BoundingBoxTree::runTasks(void* (*worker)(void*), vector<BuildTask>& tasks) {
+
+	vector<pthread_t> threads(tasks.size());
+	vector<bool> spawned(tasks.size(), false);
+	for (unsigned int t = 1; t < tasks.size(); t++)
+		spawned[t] = pthread_create(&threads[t], NULL, worker, &tasks[t]) == 0;
+	worker(&tasks[0]);
+	for (unsigned int t = 1; t < tasks.size(); t++) {
+		if (spawned[t])
+			pthread_join(threads[t], NULL);
+		else worker(&tasks[t]);
+	}
+}
+
+void* BoundingBoxTree::fillEntries(void* arg) {
+
+	BuildTask* task = (BuildTask*)arg;
+	vector<BuildEntry>& entries = *task->entries;
+	for (unsigned int i = task->begin; i < task->end; i++) {
+		entries[i].primitive = (*task->objects)[i];
+		entries[i].box = entries[i].primitive->getBoundingBox();
+		for (int axis = 0; axis < 3; axis++)
+			entries[i].centroid[axis] = (entries[i].box.minCoordinate(axis) + entries[i].box.maxCoordinate(axis)) / 2;
+	}
+	return NULL;
+}
+
+void* BoundingBoxTree::findCentroidBounds(void* arg) {
+
+	BuildTask* task = (BuildTask*)arg;
+	vector<BuildEntry>& entries = *task->entries;
+	task->cMin = vec3(DBL_MAX, DBL_MAX, DBL_MAX);
+	task->cMax = vec3(-DBL_MAX, -DBL_MAX, -DBL_MAX);
+	for (unsigned int i = task->begin; i < task->end; i++)
+		for (int k = 0; k < 3; k++) {
+			task->cMin[k] = MIN(task->cMin[k], entries[i].centroid[k]);
+			task->cMax[k] = MAX(task->cMax[k], entries[i].centroid[k]);
+		}
+	return NULL;
+}
+
+// Drops each entry into its bin along all three axes at once.
+void* BoundingBoxTree::binCentroids(void* arg) {
+
+	BuildTask* task = (BuildTask*)arg;
+	vector<BuildEntry>& entries = *task->entries;
+	for (int k = 0; k < 3; k++)
+		for (int b = 0; b < SAH_BINS; b++)
+			task->counts[k][b] = 0;
+	for (unsigned int i = task->begin; i < task->end; i++)
+		for (int k = 0; k < 3; k++) {
+			if (task->scale[k] <= 0)
+				continue;
+			int b = MIN((int)((entries[i].centroid[k] - task->cMin[k]) * task->scale[k]), SAH_BINS - 1);
+			task->boxes[k][b] = task->counts[k][b] == 0 ? entries[i].box : BoundingBox::combine(task->boxes[k][b], entries[i].box);
+			task->counts[k][b]++;
+		}
+	return NULL;
+}
+
+/* Orders build entries by their centroid along one axis. */
+class CentroidOrder {
+
+public:
+
+	CentroidOrder(int axis) : axis(axis) {}
+	bool operator () (const BuildEntry& a, const BuildEntry& b) const {
+		return a.centroid[axis] < b.centroid[axis];
+	}
+
+private:
+
+	int axis;
+
+};
+
+/* Tells whether a build entry's centroid falls below a given bin. */
+class BelowBin {
+
+public:
+
+	BelowBin(int axis, double min, double scale, int bin) : axis(axis), min(min), scale(scale), bin(bin) {}
+	bool operator () (const BuildEntry& entry) const {
+		int b = (int)((entry.centroid[axis] - min) * scale);
+		return MIN(b, SAH_BINS - 1) < bin;
+	}
+
+private:
+
+	int axis;
+	double min, scale;
+	int bin;
+
+};
+
+// Splits entries[begin, end) in two with the binned surface area heuristic:
+// centroids are dropped into SAH_BINS bins along each axis, and the bin
+// boundary minimizing (area * count) of the two sides wins. Returns the
+// index of the first entry on the high side, and the axis split along.
+// Large ranges are binned by up to "threads" threads; the result doesn't
+// depend on the thread count.
+unsigned int BoundingBoxTree::partitionSAH(vector<BuildEntry>& entries, unsigned int begin, unsigned int end, int* axis, unsigned int threads) {
+
+	vector<BuildTask> tasks = splitTasks(entries, begin, end, end - begin < PARALLEL_BUILD_MIN ? 1 : MAX(1, threads));
+	runTasks(findCentroidBounds, tasks);
+	vec3 cMin = tasks[0].cMin;
+	vec3 cMax = tasks[0].cMax;
+	for (unsigned int t = 1; t < tasks.size(); t++)
+		for (int k = 0; k < 3; k++) {
+			cMin[k] = MIN(cMin[k], tasks[t].cMin[k]);
+			cMax[k] = MAX(cMax[k], tasks[t].cMax[k]);
+		}
+
+	for (unsigned int t = 0; t < tasks.size(); t++) {
+		tasks[t].cMin = cMin;
+		for (int k = 0; k < 3; k++)
+			tasks[t].scale[k] = cMax[k] - cMin[k] > 0 ? SAH_BINS / (cMax[k] - cMin[k]) : 0;
+	}
+	runTasks(binCentroids, tasks);
+
+	double bestCost = DBL_MAX;
+	int bestAxis = -1;
+	int bestBin = 0;
+
+	for (int k = 0; k < 3; k++) {
+		if (tasks[0].scale[k] <= 0)
+			continue;
+
+		// Merge the tasks' bins.
+		unsigned int counts[SAH_BINS];
+		BoundingBox boxes[SAH_BINS];
+		for (int b = 0; b < SAH_BINS; b++) {
+			counts[b] = 0;
+			for (unsigned int t = 0; t < tasks.size(); t++) {
+				if (tasks[t].counts[k][b] == 0)
+					continue;
+				boxes[b] = counts[b] == 0 ? tasks[t].boxes[k][b] : BoundingBox::combine(boxes[b], tasks[t].boxes[k][b]);
+				counts[b] += tasks[t].counts[k][b];
+			}
+		}
+
+		// Sweep from the right to get the area and count above each boundary,
+		// then from the left to evaluate each candidate split.
+		double rightArea[SAH_BINS];
+		unsigned int rightCount[SAH_BINS];
+		BoundingBox accum;
+		unsigned int count = 0;
+		for (int b = SAH_BINS - 1; b > 0; b--) {
+			if (counts[b] > 0)
+				accum = count == 0 ? boxes[b] : BoundingBox::combine(accum, boxes[b]);
+			count += counts[b];
+			rightArea[b] = count == 0 ? 0 : accum.surfaceArea();
+			rightCount[b] = count;
+		}
+		count = 0;
+		for (int b = 1; b < SAH_BINS; b++) {
+			if (counts[b-1] > 0)
+				accum = count == 0 ? boxes[b-1] : BoundingBox::combine(accum, boxes[b-1]);
+			count += counts[b-1];
+			if (count == 0 || rightCount[b] == 0)
+				continue;
+			double cost = accum.surfaceArea() * count + rightArea[b] * rightCount[b];
+			if (cost < bestCost) {
+				bestCost = cost;
+				bestAxis = k;
+				bestBin = b;
+			}
+		}
+	}
+
+	// CASE: All centroids coincide (or every split is lopsided); fall back
+	// to an even split along the widest axis.
+	if (bestAxis < 0) {
+		vec3 extent = cMax - cMin;
+		*axis = extent[0] >= extent[1] && extent[0] >= extent[2] ? VX : (extent[1] >= extent[2] ? VY : VZ);
+		unsigned int mid = begin + (end - begin) / 2;
+		nth_element(entries.begin() + begin, entries.begin() + mid, entries.begin() + end, CentroidOrder(*axis));
+		return mid;
+	}
+
+	*axis = bestAxis;
+	double scale = SAH_BINS / (cMax[bestAxis] - cMin[bestAxis]);
+	vector<BuildEntry>::iterator split = std::partition(entries.begin() + begin, entries.begin() + end,
+		BelowBin(bestAxis, cMin[bestAxis], scale, bestBin));
+	return split - entries.begin();
+}
+
 BoundingBoxTree::BoundingBoxTree(BoundingBoxTree* otherTree, const mat4& transMat, Material* mat) {
 
 	splitAxis = otherTree->splitAxis;
@@ -178,11 +749,46 @@ BoundingBox BoundingBoxTree::getBoundingBox() {
 
 }
 
+void BoundingBoxTree::addMemoryUsage(MemoryUsage& usage) {
+
+	usage.acceleration += sizeof(BoundingBoxTree);
+	if (low != NULL)
+		low->addMemoryUsage(usage);
+	if (high != NULL)
+		high->addMemoryUsage(usage);
+}
+
 Primitive* BoundingBoxTree::instance(const mat4& transform, Material* mat) {
 
 	return new BoundingBoxTree(this, transform, mat);
 }
 
+// Expected number of box and primitive tests for a ray that hits this
+// tree's box (the SAH cost with unit costs). Lower means faster traversal;
+// useful for comparing split methods without rendering.
+double BoundingBoxTree::traversalCost() {
+
+	return traversalCost(box.surfaceArea());
+}
+
+double BoundingBoxTree::traversalCost(double rootArea) {
+
+	double cost = rootArea > 0 ? box.surfaceArea() / rootArea : 1;
+	Primitive* children[2] = { low, high };
+	for (int i = 0; i < 2; i++) {
+		if (children[i] == NULL)
+			continue;
+		BoundingBoxTree* subtree = dynamic_cast<BoundingBoxTree*>(children[i]);
+		MeshPrimitive* mesh = dynamic_cast<MeshPrimitive*>(children[i]);
+		if (mesh != NULL)
+			subtree = mesh->getTriangleTree();
+		if (subtree != NULL)
+			cost += subtree->traversalCost(rootArea);
+		else cost += rootArea > 0 ? box.surfaceArea() / rootArea : 1;
+	}
+	return cost;
+}
+
 
 bool BoundingBoxTree::intersect(Ray& ray, IntersectRecord* rec) {
 
@@ -212,21 +818,32 @@ bool BoundingBoxTree::intersect(Ray& ray, IntersectRecord* rec) {
 
 }
 
+bool BoundingBoxTree::intersectAny(Ray& ray) {
+
+	if (!box.intersect(ray, NULL))
+		return false;
+
+	// Try the near child first; it's the likelier of the two to block.
+	Primitive* first = ray.getSign(splitAxis) == 0 ? low : high;
+	Primitive* second = ray.getSign(splitAxis) == 0 ? high : low;
+	return (first != NULL && first->intersectAny(ray)) ||
+		(second != NULL && second->intersectAny(ray));
+}
+
 
 ///////////////////////////////////////////////
 //			  MeshPrimitive Class            //
 ///////////////////////////////////////////////
 
-MeshPrimitive::MeshPrimitive(Mesh* mesh, vector<Shape*> triangles, Material* mat) {
+MeshPrimitive::MeshPrimitive(Mesh* mesh, vector<Shape*> triangles, Material* mat, SplitMethod method) {
 
 	this->mesh = mesh;
 	this->mat = mat;
-	lastIntersected = NULL;
 
 	vector<Primitive*> prims;
 	for (unsigned int i = 0; i < triangles.size(); i++)
 		prims.push_back(new GeoPrimitive(triangles[i], mat));
-	this->triangleTree = new BoundingBoxTree(prims, VZ);
+	this->triangleTree = new BoundingBoxTree(prims, VZ, method);
 
 }
 
@@ -234,8 +851,7 @@ MeshPrimitive::MeshPrimitive(MeshPrimitive* otherMesh, const mat4& transMat, Mat
 
 	this->mesh = otherMesh->mesh;
 	this->mat = mat;
-	lastIntersected = NULL;
-	triangleTree = (BoundingBoxTree*)otherMesh->triangleTree->instance(transMat, mat);
+	triangleTree = otherMesh->triangleTree->instance(transMat, mat);
 }
 
 MeshPrimitive::~MeshPrimitive() {
@@ -246,19 +862,42 @@ MeshPrimitive::~MeshPrimitive() {
 
 bool MeshPrimitive::intersect(Ray& ray, IntersectRecord* rec) {
 
+	// rec->leafPrimitive is left pointing at the triangle that was hit,
+	// which is what shading needs for texture lookups.
 	bool hit = triangleTree->intersect(ray, rec);
-	if (hit) {
-		lastIntersected = rec->primitive;
+	if (hit)
 		rec->primitive = this;
-	}
 	return hit;
 }
 
+bool MeshPrimitive::intersectAny(Ray& ray) {
+
+	// The whole mesh is excluded when it's the last hit, matching the
+	// primitive that intersect() reports.
+	if (this == ray.getLastHitPrim())
+		return false;
+	return triangleTree->intersectAny(ray);
+}
+
+// Hands the packet on to the triangle tree, so that it stays a packet
+// inside the mesh too.
+unsigned int MeshPrimitive::intersectPacket(RayPacket& packet, unsigned int mask) {
+
+	unsigned int hits = triangleTree->intersectPacket(packet, mask);
+	for (unsigned int k = 0; k < packet.size; k++)
+		if (hits & (1u << k))
+			packet.records[k]->primitive = this;
+	return hits;
+}
+
 
-// Assumes that we've just intersected at "point."
+// Without a hit record we can't tell which triangle "point" lies on, so
+// this returns the untextured coefficients (e.g. index of refraction),
+// which are the same for every triangle. Shading goes through the
+// leafPrimitive of the IntersectRecord instead.
 Reflectance MeshPrimitive::getReflectance(const vec3& point) {
 
-	return lastIntersected->getReflectance(point);
+	return mat->Material::getReflectance(point, NULL);
 }
 
 
@@ -268,8 +907,31 @@ BoundingBox MeshPrimitive::getBoundingBox() {
 
 }
 
+// Instances share their original's Mesh but count it again.
+void MeshPrimitive::addMemoryUsage(MemoryUsage& usage) {
+
+	usage.geometry += sizeof(MeshPrimitive) + sizeof(Mesh) + mesh->vertices.capacity() * sizeof(vec3) +
+		mesh->normals.capacity() * sizeof(vec3) + mesh->textures.capacity() * sizeof(vec2);
+	triangleTree->addMemoryUsage(usage);
+}
+
 Primitive* MeshPrimitive::instance(const mat4& transform, Material* mat) {
 
 	return new MeshPrimitive(this, transform, mat);
 
+}
+
+// Returns NULL once the mesh has been flattened.
+BoundingBoxTree* MeshPrimitive::getTriangleTree() {
+
+	return dynamic_cast<BoundingBoxTree*>(triangleTree);
+
+}
+
+// Compiles the triangle tree into the given layout.
+void MeshPrimitive::flatten(TreeLayout layout) {
+
+	BoundingBoxTree* tree = getTriangleTree();
+	if (tree != NULL)
+		triangleTree = BoundingBoxTree::compile(tree, layout);
 }
\ No newline at end of file
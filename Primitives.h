@@ -3,6 +3,7 @@
 
 // Forward declarations
 class Shape;
+class BoundingBoxTree;
 typedef struct intersect_record_struct IntersectRecord;
 
 #include "Ray.h"
@@ -14,6 +15,20 @@ typedef struct intersect_record_struct IntersectRecord;
 
 using namespace std;
 
+#define PACKET_SIZE 16				// Most rays in a RayPacket (at most 32)
+
+
+/* A bundle of coherent rays (e.g. the camera rays of a 4x4 block of
+   pixels) traced through the scene together. Ray k's hit goes to
+   records[k]; masks of which rays to trace or which hit use bit k. */
+typedef struct ray_packet_struct {
+
+	Ray* rays[PACKET_SIZE];
+	IntersectRecord* records[PACKET_SIZE];
+	unsigned int size;
+
+} RayPacket;
+
 
 /* Abstract class for all objects in a Scene. */
 class Primitive {
@@ -22,11 +37,22 @@ public:
 
 	/* Default dtor */
 	virtual ~Primitive() {}
-	/* Virtual intersect method */
+	/* Virtual intersect methods */
 	virtual bool intersect(Ray& ray, IntersectRecord* rec) = 0;
+	// True if anything other than the ray's last hit primitive blocks it
+	// within its bounds. Stops at the first such hit and fills in nothing.
+	virtual bool intersectAny(Ray& ray) = 0;
+	// intersect() for each ray of the packet in MASK, returning the mask of
+	// those that hit. Hierarchies override it to traverse the rays together.
+	virtual unsigned int intersectPacket(RayPacket& packet, unsigned int mask);
 	/* Virtual getter methods */
 	virtual Reflectance getReflectance(const vec3& point) = 0;
+	// Reflectance at a hit this primitive reported in REC, which shading
+	// calls on rec.leafPrimitive. By default that of rec.point.
+	virtual Reflectance getHitReflectance(const IntersectRecord& rec);
 	virtual BoundingBox getBoundingBox() = 0;
+	// Adds the bytes this primitive and everything below it take up.
+	virtual void addMemoryUsage(MemoryUsage& usage) = 0;
 	/* Virtual copy method */
 	virtual Primitive* instance(const mat4& transform, Material* mat) = 0;
 
@@ -45,9 +71,12 @@ public:
 
 	/* Instance methods */
 	bool intersect(Ray& ray, IntersectRecord* rec);
+	bool intersectAny(Ray& ray);
 	Reflectance getReflectance(const vec3& point);
 	BoundingBox getBoundingBox();
+	void addMemoryUsage(MemoryUsage& usage);
 	Primitive* instance(const mat4& transform, Material* mat);
+	Shape* getShape();
 
 private:
 
@@ -58,28 +87,125 @@ private:
 };
 
 
+/* How a BoundingBoxTree divides its primitives between its two children. */
+enum SplitMethod {
+	midpointSplit,			// Spatial midpoint, cycling through the axes
+	sahSplit,				// Binned surface area heuristic
+	mortonSplit,			// Morton-code order (LBVH): fastest build
+	mortonSAHSplit			// LBVH treelets joined by an SAH top level
+};
+
+/* Memory layouts a BoundingBoxTree can be compiled into once built. */
+enum TreeLayout {
+	pointerLayout,			// Leave it as a tree of BoundingBoxTree nodes
+	linearLayout,			// LinearBoundingBoxTree
+	wideLayout				// WideBoundingBoxTree (4-wide)
+};
+
+
+/* A primitive's bounds and centroid, cached while building a tree. */
+typedef struct build_entry_struct {
+
+	Primitive* primitive;
+	BoundingBox box;
+	vec3 centroid;
+	unsigned int index;				// For builders whose items aren't Primitives
+
+} BuildEntry;
+
+
+// Number of centroid bins per axis when evaluating SAH splits.
+#define SAH_BINS 16
+
+/* One thread's share of a parallel build step over entries[begin, end). */
+typedef struct build_task_struct {
+
+	const vector<Primitive*>* objects;		// Source primitives, when filling entries
+	vector<BuildEntry>* entries;
+	unsigned int begin;
+	unsigned int end;
+	vec3 cMin;								// Centroid bounds
+	vec3 cMax;
+	double scale[3];						// Bins per unit length along each axis
+	unsigned int counts[3][SAH_BINS];		// Entries per bin along each axis
+	BoundingBox boxes[3][SAH_BINS];			// Bounds of each bin along each axis
+
+} BuildTask;
+
+/* A primitive's Morton code and its index among the build entries. */
+typedef struct morton_entry_struct {
+
+	unsigned long long code;
+	unsigned int index;
+
+} MortonEntry;
+
+/* A subtree to be built on another thread. */
+typedef struct subtree_task_struct {
+
+	vector<BuildEntry>* entries;
+	unsigned int begin;
+	unsigned int end;
+	unsigned int threads;
+	BoundingBoxTree* tree;					// Result
+
+} SubtreeTask;
+
+
 /* Class for bounding volume heirarchies. */
 class BoundingBoxTree : public Primitive {
 
 public:
 
 	/* Constructor */
-	BoundingBoxTree(const vector<Primitive*>& objects, int splitAxis);
+	BoundingBoxTree(const vector<Primitive*>& objects, int splitAxis, SplitMethod method);
 
 	~BoundingBoxTree();
 
 	/* Instance methods */
 	bool intersect(Ray& ray, IntersectRecord* rec);
+	bool intersectAny(Ray& ray);
 	Reflectance getReflectance(const vec3& point);
 	BoundingBox getBoundingBox();
+	void addMemoryUsage(MemoryUsage& usage);
 	Primitive* instance(const mat4& transform, Material* mat);
+	double traversalCost();
 
 	/* Static methods */
 	static void partition(int axis, const vector<Primitive*>& all, vector<Primitive*>* lowVec, vector<Primitive*>* highVec);
+	static unsigned int partitionSAH(vector<BuildEntry>& entries, unsigned int begin, unsigned int end, int* axis, unsigned int threads = 1);
+	static void setBuildThreads(unsigned int threads);
+	static double getBuildTime();
+	static Primitive* compile(BoundingBoxTree* tree, TreeLayout layout);
 
 private:
 
+	friend class LinearBoundingBoxTree;
+	friend class WideBoundingBoxTree;
+	friend class TriangleGroup;
+
 	BoundingBoxTree(BoundingBoxTree* otherTree, const mat4& transMat, Material* mat);
+	BoundingBoxTree();
+	BoundingBoxTree(vector<BuildEntry>& entries, unsigned int begin, unsigned int end, unsigned int threads);
+	void buildSAH(vector<BuildEntry>& entries, unsigned int begin, unsigned int end, unsigned int threads);
+	void buildMorton(vector<BuildEntry>& entries, bool refine);
+	void emitMorton(vector<BuildEntry>& entries, const vector<unsigned long long>& codes, unsigned int begin, unsigned int end, int bit);
+	double traversalCost(double rootArea);
+	void releasePrimitives();
+
+	/* Static methods */
+	static vector<BuildTask> splitTasks(vector<BuildEntry>& entries, unsigned int begin, unsigned int end, unsigned int threads);
+	static void runTasks(void* (*worker)(void*), vector<BuildTask>& tasks);
+	static void* fillEntries(void* arg);
+	static void* findCentroidBounds(void* arg);
+	static void* binCentroids(void* arg);
+	static void* buildSubtree(void* arg);
+	static unsigned long long spreadBits(unsigned long long x);
+	static void radixSort(vector<MortonEntry>& keys, int bits);
+
+	/* Static vars */
+	static unsigned int buildThreads;		// Threads used by SAH builds
+	static double buildTime;				// Seconds spent in SAH and Morton builds
 	/* Instance vars */
 	BoundingBox box;
 	int splitAxis;
@@ -94,20 +220,24 @@ class MeshPrimitive : public Primitive {
 
 public:
 
-	MeshPrimitive(Mesh* mesh, vector<Shape*> triangles, Material* mat);
+	MeshPrimitive(Mesh* mesh, vector<Shape*> triangles, Material* mat, SplitMethod method);
 	~MeshPrimitive();
 	bool intersect(Ray& ray, IntersectRecord* rec);
+	bool intersectAny(Ray& ray);
+	unsigned int intersectPacket(RayPacket& packet, unsigned int mask);
 	Reflectance getReflectance(const vec3& point);
 	BoundingBox getBoundingBox();
+	void addMemoryUsage(MemoryUsage& usage);
 	Primitive* instance(const mat4& transform, Material* mat);
+	BoundingBoxTree* getTriangleTree();
+	void flatten(TreeLayout layout);
 
 private:
 
 	MeshPrimitive(MeshPrimitive* otherMesh, const mat4& transMat, Material* mat);
 	Mesh* mesh;
-	BoundingBoxTree* triangleTree;
+	Primitive* triangleTree;
 	Material* mat;
-	Primitive* lastIntersected;
 };
 
 
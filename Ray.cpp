@@ -2,7 +2,7 @@
 
 
 /* Constructors */
-Ray::Ray(const vec3& start, const vec3& end, double min, double max, const Sample& samp, Primitive* lastHit) {
+Ray::Ray(const vec3& start, const vec3& end, scalar min, scalar max, const Sample& samp, Primitive* lastHit) {
 
 	origin = start;
 	direction = end - start;
@@ -16,7 +16,7 @@ Ray::Ray(const vec3& start, const vec3& end, double min, double max, const Sampl
     this->lastHit = lastHit;
 }
 
-Ray::Ray(const vec3& start, double min, double max, const vec3& direction, const Sample& samp, Primitive* lastHit) {
+Ray::Ray(const vec3& start, scalar min, scalar max, const vec3& direction, const Sample& samp, Primitive* lastHit) {
 
 	origin = start;
 	this->direction = direction;
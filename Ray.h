@@ -18,8 +18,8 @@ private:
 	vec3 origin;					// Point of origin
 	vec3 direction;					// Direction ray points.
     vec3 inverseDirection;          // Direction of the inverse
-	double tMin;					// Minimum intersection bound.
-	double tMax;					// Maximum intersection bound.
+	scalar tMin;					// Minimum intersection bound.
+	scalar tMax;					// Maximum intersection bound.
     int sign[3];                    // holds the sign of all the vectors
 	Sample mySample;				// The sample that generated THIS ray.
     Primitive* lastHit;             // Stores in the last primitive hit.
@@ -27,8 +27,8 @@ private:
 public:
 
 	/* Constructors */
-	Ray(const vec3& start, const vec3& end, double min, double max, const Sample& samp, Primitive* lastHit);
-	Ray(const vec3& start, double min, double max, const vec3& direction, const Sample& samp, Primitive* lastHit);
+	Ray(const vec3& start, const vec3& end, scalar min, scalar max, const Sample& samp, Primitive* lastHit);
+	Ray(const vec3& start, scalar min, scalar max, const vec3& direction, const Sample& samp, Primitive* lastHit);
 
 	/* Instance methods */
 	inline vec3 getOrigin() { return origin; }
@@ -36,15 +36,15 @@ public:
     inline vec3 getInverseDirection() {return inverseDirection; }
     inline int getSign(int axis) { return sign[axis % 3]; }
 	inline Sample getSample() { return mySample; }
-	inline double getLowerBound() { return tMin; }
-	inline double getUpperBound() { return tMax; }
-	inline bool isWithinBounds(double tVal) { return tVal <= tMax && tVal >= tMin; }
-	inline void setBounds(double min, double max) { 
+	inline scalar getLowerBound() { return tMin; }
+	inline scalar getUpperBound() { return tMax; }
+	inline bool isWithinBounds(scalar tVal) { return tVal <= tMax && tVal >= tMin; }
+	inline void setBounds(scalar min, scalar max) { 
 		tMin = min;
 		tMax = max;
 	}
     inline Primitive* getLastHitPrim () { return lastHit; }
-	inline vec3 intersectionPoint(double t) { return origin + t * direction; }
+	inline vec3 intersectionPoint(scalar t) { return origin + t * direction; }
 	inline Ray& operator = (const Ray& ray);
 
 	/* Friends */
@@ -3,6 +3,7 @@
 #include "Lights.h"
 #include <cfloat>
 #include <cmath>
+#include <cstring>
 #include <vector>
 #include <cmath>
 
@@ -11,76 +12,146 @@ using namespace std;
 
 /* Constructors */
 
-RayTracer::RayTracer(Scene* scene, unsigned int depth, double bias) {
+RayTracer::RayTracer(Scene* scene, const RenderSettings& settings) {
 
 	tracingScene = scene;
-	recursionDepth = depth;
-	rayBias = bias;
+	recursionDepth = MIN(settings.recursionDepth, MAX_BOUNCES - 1);
+	rayBias = settings.rayBias;
+	termination = settings.termination;
+	throughputCutoff = settings.throughputCutoff;
+	rng = CounterRNG(settings.seed);
+	rouletteCounter[0] = rouletteCounter[1] = rouletteCounter[2] = 0;
+	rouletteDraws = 0;
+	bounceCount = 0;
+	stats.hitsShaded = 0;
+	stats.materialEvaluations = 0;
+	stats.bouncesTraced = 0;
+	stats.bouncesCut = 0;
+	stats.bouncesBoosted = 0;
 
 }
 
 
 /* Instance methods */
 
-// Publicly accessible
+// Publicly accessible. Rather than recursing, shading a hit queues its
+// reflection and refraction rays, each carrying the product of the kR/kT
+// factors along its path; the queue is drained until the path is done.
 rgb RayTracer::traceViewingRay(Ray& ray) {
 
-	return trace(ray, recursionDepth);
+	IntersectRecord rec;
+	bool hit = tracingScene->getHierarchy()->intersect(ray, &rec);
+	return traceFromHit(ray, hit ? &rec : NULL);
+}
+
+// Traces a packet of viewing rays: their first hits are found together,
+// then each is shaded and its bounces traced on its own.
+void RayTracer::traceViewingPacket(RayPacket& packet, rgb colors[]) {
+
+	IntersectRecord recs[PACKET_SIZE];
+	for (unsigned int k = 0; k < packet.size; k++)
+		packet.records[k] = &recs[k];
+	unsigned int all = packet.size == 32 ? ~0u : (1u << packet.size) - 1;
+	unsigned int hits = tracingScene->getHierarchy()->intersectPacket(packet, all);
+
+	for (unsigned int k = 0; k < packet.size; k++)
+		colors[k] = traceFromHit(*packet.rays[k], (hits & (1u << k)) ? &recs[k] : NULL);
 }
 
-// Recursive helper for the above method.
-rgb RayTracer::trace(Ray& ray, unsigned int depth) {
+// The rest of traceViewingRay(), once the ray's first hit (or NULL for
+// none) is known.
+rgb RayTracer::traceFromHit(Ray& ray, const IntersectRecord* hit) {
 
-	// Recursive base case
-	if (depth < 0)
-		return rgb::black;
+	bounceCount = 0;
+	if (termination == rouletteTermination)
+		seedRoulette(ray.getSample());
+	rgb color = hit != NULL ? shadeIntersection(*hit, ray, rgb(1,1,1), recursionDepth) : rgb::black;
+
+	while (bounceCount > 0) {
+		Bounce bounce = bounces[--bounceCount];
+		Ray bounceRay(bounce.origin, rayBias, DBL_MAX, bounce.direction, ray.getSample(), bounce.lastHit);
+		stats.bouncesTraced++;
+		color += trace(bounceRay, bounce.throughput, bounce.depth);
+	}
+	return color;
+}
+
+// Returns the light ray brings back from its first hit, weighted by
+// throughput, and queues any bounces from there.
+rgb RayTracer::trace(Ray& ray, const rgb& throughput, unsigned int depth) {
 
 	IntersectRecord rec;
 	if (tracingScene->getHierarchy()->intersect(ray, &rec))
-		return shadeIntersection(rec, ray, depth);
+		return throughput * shadeIntersection(rec, ray, throughput, depth);
 	else return rgb::black;
 
 }
 
-rgb RayTracer::shadeIntersection(const IntersectRecord& intersection, Ray& ray, unsigned int depth) {
+TraceStats RayTracer::getStats() {
+
+	return stats;
+}
+
+// Returns the ambient and direct light at a hit and queues its bounces.
+// The material (possibly a texture lookup) is evaluated once per hit, and
+// the result is shared by every lighting term below.
+rgb RayTracer::shadeIntersection(const IntersectRecord& intersection, Ray& ray, const rgb& throughput, unsigned int depth) {
 	
-	Reflectance refl = intersection.primitive->getReflectance(intersection.point);
+	stats.hitsShaded++;
+	Reflectance refl = evaluateMaterial(intersection);
 	rgb pointColor = refl.kA;
 	vector<Light*> lights = tracingScene->getLights();
 
 	for (unsigned int i = 0; i < lights.size(); i++) {
 		Ray shadowRay = lights[i]->getShadowRay(intersection.point, rayBias, ray);
-        rgb kT = intersection.primitive->getReflectance(intersection.point).kT;
 		if (!traceShadowRay(shadowRay)) {
 			vec3 lightIncidence = shadowRay.getDirection();
 			lightIncidence.normalize();
 			if (refl.kD != rgb::black)
-				pointColor += diffComp(intersection, lightIncidence, lights[i]->getColor());
+				pointColor += diffComp(intersection, refl, lightIncidence, lights[i]->getColor());
 			if (refl.kS != rgb::black)
-				pointColor += specComp(intersection, lightIncidence, lights[i]->getColor(), ray);
+				pointColor += specComp(intersection, refl, lightIncidence, lights[i]->getColor(), ray);
 		}
 	}
     
+	Bounce found[2];
+	unsigned int count = findBounces(intersection, refl, ray, throughput, depth, found);
+	for (unsigned int i = 0; i < count; i++)
+		queueBounce(found[i]);
+	return pointColor;
+}
+
+// Fills in the reflection and refraction rays leaving a hit, if any, and
+// returns how many there are. They still have to pass keepBounce().
+unsigned int RayTracer::findBounces(const IntersectRecord& intersection, const Reflectance& refl, Ray& ray,
+									const rgb& throughput, unsigned int depth, Bounce found[2]) {
+
+	unsigned int count = 0;
+
 	// Bounce rays
     
 	if (refl.kR != rgb::black && depth > 0) {
         vec3 rayDirection = ray.getDirection();
         vec3 reflectDirection = rayDirection -
         2*(rayDirection * intersection.surfaceNormal) * intersection.surfaceNormal;
-		Ray bounceRay(intersection.point, rayBias, DBL_MAX, reflectDirection, ray.getSample(), ray.getLastHitPrim());
-		pointColor += refl.kR * trace(bounceRay, depth - 1);
+		Bounce& bounce = found[count++];
+		bounce.origin = intersection.point;
+		bounce.direction = reflectDirection;
+		bounce.lastHit = ray.getLastHitPrim();
+		bounce.throughput = throughput * refl.kR;
+		bounce.depth = depth - 1;
 	}
     
     // Refraction Rays
     if (refl.kT != rgb(0,0,0) && depth > 0) {
-		double index = intersection.primitive->getReflectance(intersection.point).indexOfRefraction;
+		double index = refl.indexOfRefraction;
 		bool refracted = false;
         vec3 refractDirection (0,0,0);
         if (ray.getLastHitPrim() != NULL) {          
             if (ray.getLastHitPrim() == intersection.primitive) {
                     refracted = refract(ray, intersection, index, 1.0, refractDirection);
             } else {
-                double oldIndex = ray.getLastHitPrim()->getReflectance(intersection.point).indexOfRefraction;
+                double oldIndex = evaluateMaterial(ray.getLastHitPrim(), intersection.point).indexOfRefraction;
                 refracted = refract(ray, intersection, oldIndex, index, refractDirection);
             }
         } else {
@@ -88,37 +159,103 @@ rgb RayTracer::shadeIntersection(const IntersectRecord& intersection, Ray& ray,
         }
         
         if (refracted) {
-            Ray refractRay(intersection.point, rayBias, DBL_MAX, refractDirection, ray.getSample(), intersection.primitive);
-            pointColor += refl.kT * trace(refractRay, depth - 1);
-        }
+			Bounce& bounce = found[count++];
+			bounce.origin = intersection.point;
+			bounce.direction = refractDirection;
+			bounce.lastHit = intersection.primitive;
+			bounce.throughput = throughput * refl.kT;
+			bounce.depth = depth - 1;
+		}
     }
-	return pointColor;
+	return count;
+}
+
+void RayTracer::queueBounce(const Bounce& bounce) {
+
+	rgb throughput = bounce.throughput;
+	if (keepBounce(throughput)) {
+		bounces[bounceCount] = bounce;
+		bounces[bounceCount++].throughput = throughput;
+	}
+}
+
+// Bounces whose throughput is at most throughputCutoff in every channel
+// can't change the sample noticeably. In threshold mode they are dropped.
+// In roulette mode a bounce below the cutoff survives with probability
+// (throughput / cutoff) and is reweighted by its inverse, which keeps the
+// expected color unchanged. Roulette draws come from the current sample.
+bool RayTracer::keepBounce(rgb& throughput) {
+
+	double weight = MAX(throughput[0], MAX(throughput[1], throughput[2]));
+	if (termination == thresholdTermination && weight <= throughputCutoff) {
+		stats.bouncesCut++;
+		return false;
+	}
+	if (termination == rouletteTermination && weight < throughputCutoff) {
+		double survival = weight / throughputCutoff;
+		if (weight <= 0 || nextRoulette() >= survival) {
+			stats.bouncesCut++;
+			return false;
+		}
+		throughput = throughput / survival;
+		stats.bouncesBoosted++;
+	}
+	return true;
+}
+
+// Keys roulette to the sample itself, so a sample's paths end the same
+// way whichever thread traces it and in whatever order.
+void RayTracer::seedRoulette(const Sample& samp) {
+
+	unsigned long long bits[2];
+	memcpy(&bits[0], &samp.horiz, sizeof(double));
+	memcpy(&bits[1], &samp.vert, sizeof(double));
+	rouletteCounter[0] = (uint32)(bits[0] ^ (bits[0] >> 32));
+	rouletteCounter[1] = (uint32)(bits[1] ^ (bits[1] >> 32));
+	rouletteCounter[2] = (samp.p << 16) ^ samp.q;
+	rouletteDraws = 0;
+}
+
+// The sample's next roulette number, a uniform number in [0, 1).
+double RayTracer::nextRoulette() {
+
+	return rng.uniform(rouletteCounter[0], rouletteCounter[1], rouletteCounter[2], rouletteDraws++);
 }
 
 bool RayTracer::traceShadowRay(Ray& ray) {
 
-	IntersectRecord rec;
-	// If we hit the last primitive through which the ray was transmitted via
-	// refraction, don't register that as an occluder.
-	return (tracingScene->getHierarchy()->intersect(ray, &rec) &&
-		rec.primitive != ray.getLastHitPrim());
+	// Any occluder will do, so there's no need to find the closest one.
+	// The last primitive through which the ray was transmitted via
+	// refraction is skipped and doesn't register as an occluder.
+	return tracingScene->getHierarchy()->intersectAny(ray);
+}
+
+Reflectance RayTracer::evaluateMaterial(Primitive* primitive, const vec3& point) {
+
+	stats.materialEvaluations++;
+	return primitive->getReflectance(point);
+}
+
+// The material at a hit, as its innermost primitive reports it.
+Reflectance RayTracer::evaluateMaterial(const IntersectRecord& intersection) {
+
+	stats.materialEvaluations++;
+	return intersection.leafPrimitive->getHitReflectance(intersection);
 }
 
-rgb RayTracer::diffComp(const IntersectRecord& intersection, const vec3& incidence, const rgb& color) {
+rgb RayTracer::diffComp(const IntersectRecord& intersection, const Reflectance& refl, const vec3& incidence, const rgb& color) {
 
-	return intersection.primitive->getReflectance(intersection.point).kD * color
-		* MAX(intersection.surfaceNormal * incidence, 0);
+	return refl.kD * color * MAX(intersection.surfaceNormal * incidence, 0);
 
 }
 
-rgb RayTracer::specComp(const IntersectRecord& intersection, const vec3& incidence, const rgb& color, Ray& viewRay) {
+rgb RayTracer::specComp(const IntersectRecord& intersection, const Reflectance& refl, const vec3& incidence, const rgb& color, Ray& viewRay) {
 
 	vec3 reflectVec = -incidence + (2 * (incidence * intersection.surfaceNormal) * intersection.surfaceNormal);
 	vec3 viewerVec = -viewRay.getDirection();
 	viewerVec.normalize();
 	double scalarTerm = MAX(reflectVec * viewerVec, 0);
-	Reflectance reflec = intersection.primitive->getReflectance(intersection.point);
-	return reflec.kS * color * pow(scalarTerm, reflec.pExp);
+	return refl.kS * color * pow(scalarTerm, refl.pExp);
 }
 
 bool RayTracer::refract(Ray& ray, const IntersectRecord& intersect, double oldIndex, double newIndex, vec3& refractDirection) {
@@ -6,6 +6,37 @@
 #include "Ray.h"
 #include "Primitives.h"
 #include "IntersectRecord.h"
+#include "RenderSettings.h"
+#include "CounterRNG.h"
+
+/* Counts kept by a RayTracer while it traces. */
+typedef struct trace_stats_struct {
+
+	unsigned long long hitsShaded;				// Intersections shaded
+	unsigned long long materialEvaluations;		// Calls to getReflectance()
+	unsigned long long bouncesTraced;			// Reflection and refraction rays traced
+	unsigned long long bouncesCut;				// ...and skipped for low throughput
+	unsigned long long bouncesBoosted;			// Roulette survivors, reweighted
+
+} TraceStats;
+
+
+// Most reflection/refraction rays waiting to be traced at once. A path
+// has at most (recursion depth + 1) of them pending.
+#define MAX_BOUNCES 64
+
+/* A reflection or refraction ray waiting to be traced, with the weight of
+   its color in the final sample and the number of bounces it has left. */
+typedef struct bounce_struct {
+
+	vec3 origin;
+	vec3 direction;
+	Primitive* lastHit;
+	rgb throughput;
+	unsigned int depth;
+
+} Bounce;
+
 
 /* Raytracer objects trace viewing rays into the
    scene in order to determine sample color. */
@@ -18,22 +49,44 @@ private:
 	unsigned int recursionDepth;				// Maximum # of ray bounces
 	double rayBias;							// tMin for shadow/bounce rays
     double shadowBias;
+	TerminationMode termination;
+	double throughputCutoff;				// Bounces weighing less than this may be ended
+	CounterRNG rng;							// Random numbers for Russian roulette
+	uint32 rouletteCounter[3];				// Identifies the current sample to rng
+	uint32 rouletteDraws;					// Roulette numbers drawn for it so far
+	TraceStats stats;
+	Bounce bounces[MAX_BOUNCES];			// Pending bounces of the current sample
+	unsigned int bounceCount;
 
 	/* Instance methods */
-	rgb trace(Ray& ray, unsigned int depth);
+	rgb trace(Ray& ray, const rgb& throughput, unsigned int depth);
+	rgb traceFromHit(Ray& ray, const IntersectRecord* hit);
 	bool traceShadowRay(Ray& ray);
-	rgb shadeIntersection(const IntersectRecord& intersection, Ray& ray, unsigned int depth);
-	rgb diffComp(const IntersectRecord& intersection, const vec3& incidence, const rgb& color);
-	rgb specComp(const IntersectRecord& intersection, const vec3& incidence, const rgb& color, Ray& viewRay);
+	rgb shadeIntersection(const IntersectRecord& intersection, Ray& ray, const rgb& throughput, unsigned int depth);
+	unsigned int findBounces(const IntersectRecord& intersection, const Reflectance& refl, Ray& ray,
+		const rgb& throughput, unsigned int depth, Bounce found[2]);
+	void queueBounce(const Bounce& bounce);
+	bool keepBounce(rgb& throughput);
+	void seedRoulette(const Sample& samp);
+	double nextRoulette();
+	Reflectance evaluateMaterial(Primitive* primitive, const vec3& point);
+	Reflectance evaluateMaterial(const IntersectRecord& intersection);
+	rgb diffComp(const IntersectRecord& intersection, const Reflectance& refl, const vec3& incidence, const rgb& color);
+	rgb specComp(const IntersectRecord& intersection, const Reflectance& refl, const vec3& incidence, const rgb& color, Ray& viewRay);
     bool refract(Ray& ray, const IntersectRecord& intersect, double oldIndex, double newIndex, vec3& refractDirection);
 
 public:
 
 	/* Constructors */
-	RayTracer(Scene* scene, unsigned int depth, double bias);
+	RayTracer(Scene* scene, const RenderSettings& settings);
 
 	/* Instance methods */
 	rgb traceViewingRay(Ray& ray);
+	void traceViewingPacket(RayPacket& packet, rgb colors[]);
+	TraceStats getStats();
+
+	/* Friends */
+	friend class WavefrontTracer;
 
 };
 
@@ -2,9 +2,22 @@
 #define RENDERSETTINGSH
 
 #include <string>
+#include "SampleGenerator.h"
 
 using namespace std;
 
+/* How RayTracer ends paths whose throughput has become negligible. */
+enum TerminationMode {
+	thresholdTermination,				// Drop bounces at or below the threshold
+	rouletteTermination					// Russian roulette below the threshold (unbiased)
+};
+
+/* How Scene traces each batch of viewing rays. */
+enum IntegratorMode {
+	pathIntegrator,						// One whole path at a time (RayTracer)
+	wavefrontIntegrator					// One stage of every path at a time (WavefrontTracer)
+};
+
 /* RenderSettings structs hold all the information necessary
    to render a Scene. */
 typedef struct render_settings_struct {
@@ -13,9 +26,21 @@ typedef struct render_settings_struct {
 	unsigned int pixelWidth;
 	unsigned int pixelHeight;
 	unsigned int sqrtSamplesPerPixel;
+	SamplePattern samplePattern;		// Point set the samples are drawn from
 	unsigned int recursionDepth;
 	double rayBias;
     unsigned int refractionDepth;
+	unsigned int numThreads;			// Worker threads for rendering (1 = serial)
+	unsigned int tileSize;				// Width/height of a render tile in pixels
+	unsigned int seed;					// Seed for sample jitter
+	TerminationMode termination;
+	double throughputCutoff;			// Threshold for termination (0 = trace every bounce)
+	bool packetRays;					// Trace camera rays in packets
+	IntegratorMode integrator;			// Path-at-a-time or wavefront tracing
+	double adaptiveThreshold;			// Pixel error that adaptive sampling aims for (0 = off)
+	unsigned int sampleBudget;			// Cap on average samples per pixel (0 = none)
+	double timeBudget;					// Seconds a progressive render may take (0 = no limit)
+	double noiseTarget;					// Pixel error that ends a progressive render (0 = none)
 
 } RenderSettings;
 
@@ -0,0 +1,242 @@
+#include "SampleGenerator.h"
+#include <cmath>
+#include <cfloat>
+
+
+//////////////////////////
+// Sample Generator     //
+//////////////////////////
+
+/* Constructors */
+
+SampleGenerator::SampleGenerator(unsigned int count, uint32 seed) : rng(seed) {
+
+	this->count = MAX(count, 1);
+	this->seed = seed;
+
+}
+
+
+/* Static methods */
+
+SampleGenerator* SampleGenerator::create(SamplePattern pattern, unsigned int count, uint32 seed) {
+
+	switch (pattern) {
+		case sobolPattern:
+			return new SobolGenerator(count, seed);
+		case haltonPattern:
+			return new HaltonGenerator(count, seed);
+		case multiJitterPattern:
+			return new MultiJitterGenerator(count, seed);
+		default:
+			return new JitteredGenerator(count, seed);
+	}
+}
+
+// MurmurHash3's mixing steps over the seed and four inputs.
+uint32 SampleGenerator::hash(uint32 seed, uint32 a, uint32 b, uint32 c, uint32 d) {
+
+	uint32 inputs[4] = { a, b, c, d };
+	uint32 h = seed;
+	for (int k = 0; k < 4; k++) {
+		uint32 m = inputs[k] * 0xcc9e2d51u;
+		m = (m << 15) | (m >> 17);
+		h ^= m * 0x1b873593u;
+		h = ((h << 13) | (h >> 19)) * 5 + 0xe6546b64u;
+	}
+	h ^= h >> 16;
+	h *= 0x85ebca6bu;
+	h ^= h >> 13;
+	h *= 0xc2b2ae35u;
+	h ^= h >> 16;
+	return h;
+}
+
+// Kensler's hashed permutation: maps i in [0, length) to a distinct value
+// in [0, length), a different permutation for every key.
+uint32 SampleGenerator::permute(uint32 i, uint32 length, uint32 key) {
+
+	uint32 w = length - 1;
+	w |= w >> 1;
+	w |= w >> 2;
+	w |= w >> 4;
+	w |= w >> 8;
+	w |= w >> 16;
+	do {
+		i ^= key; i *= 0xe170893du;
+		i ^= key >> 16;
+		i ^= (i & w) >> 4;
+		i ^= key >> 8; i *= 0x0929eb3fu;
+		i ^= key >> 23;
+		i ^= (i & w) >> 1; i *= 1 | key >> 27;
+		i *= 0x6935fa69u;
+		i ^= (i & w) >> 11; i *= 0x74dcb303u;
+		i ^= (i & w) >> 2; i *= 0x9e501cc3u;
+		i ^= (i & w) >> 2; i *= 0xc860a3dfu;
+		i &= w;
+		i ^= i >> 5;
+	} while (i >= length);
+	return (i + key) % length;
+}
+
+
+//////////////////////////
+// Jittered Generator   //
+//////////////////////////
+
+JitteredGenerator::JitteredGenerator(unsigned int count, uint32 seed) : SampleGenerator(count, seed) {
+
+	n = (unsigned int)(sqrt((double)count) + 0.5);
+	if (n == 0)
+		n = 1;
+
+}
+
+// The pixel dimensions visit stratum (index / n, index % n) and, with a
+// single sample, take the pixel's centre. The other pairs jitter a stratum
+// picked by a per-pixel permutation of the index.
+vec2 JitteredGenerator::get2D(unsigned int x, unsigned int y, unsigned int index, unsigned int dimension) const {
+
+	if (dimension == pixelDimension && n == 1 && index == 0)
+		return vec2(0.5, 0.5);
+
+	unsigned int strata = n * n;
+	uint32 stratum = index % strata;
+	if (dimension != pixelDimension) {
+		uint32 keys[4];
+		patternKeys(x, y, dimension, keys);
+		stratum = permute(stratum, strata, roundKey(keys[0], index / strata));
+	}
+
+	uint32 jitter[4];
+	rng.generate(x, y, index, dimension, jitter);
+	double eps1 = jitter[0] / 4294967296.0;
+	double eps2 = jitter[1] / 4294967296.0;
+	return vec2((stratum / n + eps1) / n, (stratum % n + eps2) / n);
+}
+
+
+//////////////////////////
+// Sobol Generator      //
+//////////////////////////
+
+SobolGenerator::SobolGenerator(unsigned int count, uint32 seed) : SampleGenerator(count, seed) {
+}
+
+vec2 SobolGenerator::get2D(unsigned int x, unsigned int y, unsigned int index, unsigned int dimension) const {
+
+	uint32 keys[4];
+	patternKeys(x, y, dimension, keys);
+	uint32 i = scramble(index, keys[0]);
+
+	// First dimension: van der Corput in base 2
+	uint32 u = reverseBits(i);
+
+	// Second dimension: direction numbers v_k = v_{k-1} ^ (v_{k-1} >> 1)
+	uint32 v = 0;
+	for (uint32 d = 1u << 31; i != 0; i >>= 1, d ^= d >> 1)
+		if (i & 1)
+			v ^= d;
+
+	u = scramble(u, keys[1]);
+	v = scramble(v, keys[2]);
+	return vec2(u / 4294967296.0, v / 4294967296.0);
+}
+
+uint32 SobolGenerator::reverseBits(uint32 v) {
+
+	v = ((v >> 1) & 0x55555555u) | ((v & 0x55555555u) << 1);
+	v = ((v >> 2) & 0x33333333u) | ((v & 0x33333333u) << 2);
+	v = ((v >> 4) & 0x0f0f0f0fu) | ((v & 0x0f0f0f0fu) << 4);
+	v = ((v >> 8) & 0x00ff00ffu) | ((v & 0x00ff00ffu) << 8);
+	return (v >> 16) | (v << 16);
+}
+
+// Nested uniform (Owen) scrambling: every bit is flipped depending on the
+// bits above it, via Laine and Karras' hash of the bit-reversed value.
+uint32 SobolGenerator::scramble(uint32 v, uint32 key) {
+
+	v = reverseBits(v);
+	v += key;
+	v ^= v * 0x6c50b47cu;
+	v ^= v * 0xb82f1e52u;
+	v ^= v * 0xc7afe638u;
+	v ^= v * 0x8d22f6e6u;
+	return reverseBits(v);
+}
+
+
+//////////////////////////
+// Halton Generator     //
+//////////////////////////
+
+HaltonGenerator::HaltonGenerator(unsigned int count, uint32 seed) : SampleGenerator(count, seed) {
+}
+
+vec2 HaltonGenerator::get2D(unsigned int x, unsigned int y, unsigned int index, unsigned int dimension) const {
+
+	uint32 keys[4];
+	patternKeys(x, y, dimension, keys);
+	uint32 i = index;
+	if (dimension != pixelDimension)
+		i = index - index % count + permute(index % count, count, roundKey(keys[0], index / count));
+	return vec2(radicalInverse(2, i, keys[1]), radicalInverse(3, i, keys[2]));
+}
+
+// The index's digits in "base", mirrored about the radix point, each one
+// shifted (mod base) by an amount hashed from the key and its position.
+// Trailing zero digits are shifted too, down to double precision.
+double HaltonGenerator::radicalInverse(uint32 base, uint32 index, uint32 key) const {
+
+	double invBase = 1.0 / base;
+	double factor = invBase;
+	double result = 0;
+	for (uint32 position = 0; factor > DBL_EPSILON; position++) {
+		uint32 digit = index % base;
+		index /= base;
+		uint32 shift = hash(key, position, 0, 0, 0) % base;
+		result += ((digit + shift) % base) * factor;
+		factor *= invBase;
+	}
+	return MIN(result, 1.0 - DBL_EPSILON);
+}
+
+
+//////////////////////////
+// Multi-Jitter Gen.    //
+//////////////////////////
+
+MultiJitterGenerator::MultiJitterGenerator(unsigned int count, uint32 seed) : SampleGenerator(count, seed) {
+
+	m = (unsigned int)sqrt((double)count);
+	if (m == 0)
+		m = 1;
+	n = (count + m - 1) / m;
+
+}
+
+vec2 MultiJitterGenerator::get2D(unsigned int x, unsigned int y, unsigned int index, unsigned int dimension) const {
+
+	uint32 keys[4];
+	patternKeys(x, y, dimension, keys);
+	uint32 key = roundKey(keys[0], index / (m * n));
+	uint32 s = permute(index % (m * n), m * n, key * 0x51633e2du);
+	uint32 sx = permute(s % m, m, key * 0xa511e9b3u);
+	uint32 sy = permute(s / m, n, key * 0x63d83595u);
+	double jx = randomFloat(s, key * 0xa399d265u);
+	double jy = randomFloat(s, key * 0x711ad6a5u);
+	return vec2((s % m + (sy + jx) / n) / m, (s / m + (sx + jy) / m) / n);
+}
+
+// Kensler's hashed uniform number in [0, 1).
+double MultiJitterGenerator::randomFloat(uint32 i, uint32 key) {
+
+	i ^= key;
+	i ^= i >> 17;
+	i ^= i >> 10; i *= 0xb36534e5u;
+	i ^= i >> 12;
+	i ^= i >> 21; i *= 0x93fc4795u;
+	i ^= 0xdf6e307fu;
+	i ^= i >> 17; i *= 1 | key >> 18;
+	return i / 4294967296.0;
+}
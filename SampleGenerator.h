@@ -0,0 +1,125 @@
+#ifndef SAMPLEGENERATORH
+#define SAMPLEGENERATORH
+
+#include "algebra3.h"
+#include "randomc.h"
+#include "CounterRNG.h"
+
+#define PATTERN_KEY 0xffffffffu		// Sample index under which a pixel's pattern keys are drawn
+
+
+/* Point sets a Sampler can draw its samples from. */
+enum SamplePattern {
+	jitteredPattern,				// n-by-n stratified jitter
+	sobolPattern,					// Owen-scrambled Sobol (0,2)-sequence
+	haltonPattern,					// Digit-scrambled Halton
+	multiJitterPattern				// Correlated multi-jitter (Kensler 2013)
+};
+
+/* The 2D dimension pairs of a sample. Each pair gets its own, decorrelated
+   pattern, so e.g. the lens position doesn't follow the pixel position. */
+enum SampleDimension {
+	pixelDimension = 0,				// Position within the pixel
+	lensDimension = 1,				// Position on the lens of a LensCamera
+	lightDimension = 2				// Position on an AreaLight
+};
+
+
+/* Abstract source of 2D sample points. A pixel's "count" samples are one
+   well-distributed point set per dimension pair; point "index" of it is
+   computed directly from the seed, the pixel and the index, with no state
+   carried between calls. Indices past "count" keep going, for adaptive
+   sampling: the sequences simply continue, while the patterns that only
+   come in sets of "count" start a fresh, independently shuffled set. */
+class SampleGenerator {
+
+public:
+
+	SampleGenerator(unsigned int count, uint32 seed);
+	virtual ~SampleGenerator() {}
+
+	// Point "index" (0 <= index < count) of pixel (x, y)'s pattern for the
+	// given dimension pair, in [0, 1)^2.
+	virtual vec2 get2D(unsigned int x, unsigned int y, unsigned int index, unsigned int dimension) const = 0;
+
+	static SampleGenerator* create(SamplePattern pattern, unsigned int count, uint32 seed);
+	static uint32 hash(uint32 seed, uint32 a, uint32 b, uint32 c, uint32 d);
+	static uint32 permute(uint32 i, uint32 length, uint32 key);
+
+protected:
+
+	unsigned int count;				// Samples per pixel
+	uint32 seed;
+	CounterRNG rng;
+
+	// Four random keys for pixel (x, y)'s pattern in the given dimension pair
+	inline void patternKeys(unsigned int x, unsigned int y, unsigned int dimension, uint32 keys[4]) const {
+		rng.generate(x, y, PATTERN_KEY, dimension, keys);
+	}
+
+	// The key for the given set of "count" samples; set 0 uses the key as is
+	static inline uint32 roundKey(uint32 key, unsigned int round) {
+		return round == 0 ? key : hash(key, round, 0, 0, 0);
+	}
+
+};
+
+
+/* Stratified jitter on a sqrt(count)-by-sqrt(count) grid. Outside the pixel
+   dimensions, each pixel visits the strata in its own shuffled order. */
+class JitteredGenerator : public SampleGenerator {
+
+public:
+	JitteredGenerator(unsigned int count, uint32 seed);
+	vec2 get2D(unsigned int x, unsigned int y, unsigned int index, unsigned int dimension) const;
+
+private:
+	unsigned int n;					// Strata per axis
+};
+
+
+/* The first two Sobol dimensions with hash-based Owen scrambling (Burley
+   2020). The index is shuffled per pixel and dimension pair too, which
+   decorrelates the pairs from one another. */
+class SobolGenerator : public SampleGenerator {
+
+public:
+	SobolGenerator(unsigned int count, uint32 seed);
+	vec2 get2D(unsigned int x, unsigned int y, unsigned int index, unsigned int dimension) const;
+
+private:
+	static uint32 reverseBits(uint32 v);
+	static uint32 scramble(uint32 v, uint32 key);
+};
+
+
+/* Halton points in bases 2 and 3, with every digit shifted by a per-pixel
+   random amount. The higher prime bases stratify too poorly at a few dozen
+   samples per pixel, so each dimension pair instead reuses bases 2 and 3
+   with its own scrambling and its own shuffled order of the pixel's points. */
+class HaltonGenerator : public SampleGenerator {
+
+public:
+	HaltonGenerator(unsigned int count, uint32 seed);
+	vec2 get2D(unsigned int x, unsigned int y, unsigned int index, unsigned int dimension) const;
+
+private:
+	double radicalInverse(uint32 base, uint32 index, uint32 key) const;
+};
+
+
+/* Correlated multi-jittered points (Kensler 2013): stratified in 2D and in
+   each 1D projection, on as square a grid as "count" allows. */
+class MultiJitterGenerator : public SampleGenerator {
+
+public:
+	MultiJitterGenerator(unsigned int count, uint32 seed);
+	vec2 get2D(unsigned int x, unsigned int y, unsigned int index, unsigned int dimension) const;
+
+private:
+	static double randomFloat(uint32 i, uint32 key);
+	unsigned int m, n;				// Grid is m columns by n rows
+};
+
+
+#endif
@@ -1,74 +1,46 @@
 #include "Sampler.h"
-#include <time.h>
 #include <cstdlib>
 
 
 /* Constructors */
 
-Sampler::Sampler(unsigned int width, unsigned int height, unsigned int perPixel) {
+Sampler::Sampler(unsigned int width, unsigned int height, unsigned int perPixel,
+				 uint32 seed, SamplePattern pattern) {
 
 	pixelWidth = width;
 	pixelHeight = height;
 	n = perPixel;
-	i = j = 0;
-	p = q = 0;
-
-	randGen = new CRandomMersenne((uint32)time(NULL));
+	generator = SampleGenerator::create(pattern, n * n, seed);
 
 }
 
-
-/* Destructor */
-
 Sampler::~Sampler() {
 
-	delete randGen;
+	delete generator;
+
 }
 
 
 /* Instance methods */
 
-Sample Sampler::nextSample() {
-
-	if (!hasMoreSamples())
-		throw "Sampler has no more samples.";
+// Sample number "index" (0 <= index < n*n) of pixel (x, y), with its
+// position in the pixel, on the lens and on area lights all drawn from
+// the generator's (decorrelated) dimension pairs.
+Sample Sampler::getSample(unsigned int x, unsigned int y, unsigned int index) const {
 
 	Sample toReturn;
-	toReturn.p = p;
-	toReturn.q = q;
-	// Stratified (jittered) sampling (But only if n > 1).
-	double eps1 = n == 1 ? 0.5 : randGen->Random();		//((double)rand()) / RAND_MAX;
-	double eps2 = n == 1 ? 0.5 : randGen->Random();		//((double)rand()) / RAND_MAX;
-	toReturn.horiz = i + (p + eps1) / n;
-	toReturn.vert = j + (q + eps2) / n;
-
-	// CASE: This is the last sample for the overall last pixel
-	if (i == pixelWidth - 1 && j == pixelHeight - 1 && p == n -1 && q == n - 1) {
-		i++;
-		j++;
-		p = q = 0;
-	}
-	// CASE: This is the last sample for the last pixel in one row
-	else if (i == pixelWidth - 1 && p == n - 1 && q == n - 1) {
-		i = 0;
-		j++;
-		p = q = 0;
-	}
-	// CASE: This is the last sample for a pixel in the middle of a row
-	else if (p == n - 1 && q == n - 1) {
-		i++;
-		p = q = 0;
-	}
-	// CASE: This is the last sample in one row of a single pixel
-	else if (q == n - 1) {
-		q = 0;
-		p++;
-	}
-	// CASE: This is a sample in the middle of a row of a single pixel
-	else q++;
-
+	toReturn.p = index / n;
+	toReturn.q = index % n;
+	vec2 pixel = generator->get2D(x, y, index, pixelDimension);
+	vec2 lens = generator->get2D(x, y, index, lensDimension);
+	vec2 light = generator->get2D(x, y, index, lightDimension);
+	toReturn.horiz = x + pixel[VX];
+	toReturn.vert = y + pixel[VY];
+	toReturn.lensU = lens[VX];
+	toReturn.lensV = lens[VY];
+	toReturn.lightU = light[VX];
+	toReturn.lightV = light[VY];
 	return toReturn;
-	
 }
 
 Sample Sampler::normalizeSample(const Sample& samp) {
@@ -78,6 +50,10 @@ Sample Sampler::normalizeSample(const Sample& samp) {
 	toReturn.vert = samp.vert / pixelHeight;
 	toReturn.p = samp.p;
 	toReturn.q = samp.q;
+	toReturn.lensU = samp.lensU;
+	toReturn.lensV = samp.lensV;
+	toReturn.lightU = samp.lightU;
+	toReturn.lightV = samp.lightV;
 
 	return toReturn;
 }
\ No newline at end of file
@@ -2,6 +2,7 @@
 #define SAMPLERH
 
 #include "randomc.h"
+#include "SampleGenerator.h"
 
 /* A simple way to describe a pixel sample in
    terms of the screen coordinates. */
@@ -10,12 +11,25 @@ typedef struct sample_struct {
 	double vert;
 	unsigned int p;			// Which sample on the given pixel produced this?
 	unsigned int q;
+	double lensU, lensV;	// Position on the lens, in [0, 1)^2
+	double lightU, lightV;	// Position on an area light, in [0, 1)^2
 } Sample;
 
 
-/* Sampler objects enumerate through all the samples necessary to draw
-   every pixel on the screen. Currently, the Sampler class only does one
-   sample per pixel. This is not difficult to change. */
+/* A rectangular block of pixels, [x0, x1) by [y0, y1), that is
+   rendered as one unit of work. */
+typedef struct render_tile_struct {
+	unsigned int x0, y0;
+	unsigned int x1, y1;
+} RenderTile;
+
+
+/* Sampler objects give the samples needed to draw the pixels of the
+   screen. Sampling is stateless: getSample() computes any sample of any
+   pixel directly from the seed, the pixel's coordinates and the sample's
+   index, so tiles may be sampled in any order, on any thread, and still
+   give identical images. The points themselves come from a
+   SampleGenerator, which supplies the pixel, lens and light positions. */
 class Sampler {
 
 private:
@@ -23,26 +37,19 @@ private:
 	/* Instance vars */
 	unsigned int pixelWidth;				// Width of the screen
 	unsigned int pixelHeight;				// Height of the screen
-	unsigned int i, j;						// The next pixel to sample
-	unsigned int p, q;						// The next part of the pixel to sample
 	unsigned int n;							// n = sqrt(# of samples per pixel)
-	CRandomMersenne* randGen;				// Random number generator
+	SampleGenerator* generator;				// Source of the sample points
 
 public:
 
 	/* Constructors */
-	Sampler(unsigned int width, unsigned int height, unsigned int perPixel);
-
-	/* Destructor */
+	Sampler(unsigned int width, unsigned int height, unsigned int perPixel,
+		uint32 seed, SamplePattern pattern = jitteredPattern);
 	~Sampler();
 
 	/* Instance methods */
-	inline bool hasMoreSamples() {
-		return i < pixelWidth &&
-			j < pixelHeight;
-	}
-
-	Sample nextSample();
+	Sample getSample(unsigned int x, unsigned int y, unsigned int index) const;
+	inline unsigned int getSamplesPerPixel() const { return n * n; }
 
 	Sample normalizeSample(const Sample& samp);
 
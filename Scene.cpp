@@ -2,23 +2,68 @@
 #include "Sampler.h"
 #include "Film.h"
 #include "RayTracer.h"
+#include "WavefrontTracer.h"
+#include "TileScheduler.h"
 #include "rgb.h"
 #include <iostream>
+#include <cstdlib>
+#include <pthread.h>
+#include <algorithm>
+#include <climits>
+#include <cfloat>
+
+// Most samples adaptive sampling may give a pixel, as a multiple of the
+// scene's base n-by-n count.
+#define ADAPTIVE_MAX_FACTOR 16
+
+// A progressive render with a noise target stops once this fraction of
+// the pixels has an error at or below the target.
+#define NOISE_PERCENTILE 0.95
+
+// Side of the square pixel blocks whose camera rays are traced as one
+// packet; PACKET_BLOCK squared must not exceed PACKET_SIZE.
+#define PACKET_BLOCK 4
+
+// Most viewing rays a wavefront render traces as one batch.
+#define WAVEFRONT_BATCH 16384
 
 using namespace std;
 
 
+/* Work handed to one render thread. */
+typedef struct render_job_struct {
+
+	Scene* scene;
+	const RenderSettings* settings;
+	TileScheduler* scheduler;
+	Film* output;
+	const vector<unsigned int>* targets;	// Samples each pixel should have after the pass
+	unsigned int thread;			// Which of the scheduler's queues is ours
+	TraceStats stats;				// Filled in when the thread finishes
+
+} RenderJob;
+
+
+// Orders adaptive sampling candidates by decreasing error.
+static bool worseError(const pair<double, unsigned int>& a, const pair<double, unsigned int>& b) {
+
+	return a.first > b.first;
+}
+
+
 /* Constructors */
 
 Scene::Scene(Camera* cam) {
 
 	sceneCam = cam;
+	scheduler = NULL;
 
 }
 
 Scene::~Scene() {
 
 	delete sceneCam;
+	delete scheduler;
 
 }
 
@@ -30,30 +75,345 @@ void Scene::render(const RenderSettings& settings) {
 	// [START] RENDER
 	cout << "Rendering...";
 
-	Sampler samples(settings.pixelWidth, settings.pixelHeight, settings.sqrtSamplesPerPixel);
 	Film output(settings.pixelWidth, settings.pixelHeight);
-	RayTracer tracer(this, settings.recursionDepth, settings.rayBias);
 
-	while (samples.hasMoreSamples()) {
-		Sample s = samples.nextSample();
-		Ray viewRay = sceneCam->createViewingRay(samples.normalizeSample(s));
-		rgb pixelColor = tracer.traceViewingRay(viewRay);
-		output.commit(s, pixelColor);
+	// Keep the scheduler between renders so that tile timings from one frame
+	// shape the tiling of the next.
+	if (scheduler != NULL && !scheduler->covers(settings)) {
+		delete scheduler;
+		scheduler = NULL;
+	}
+	if (scheduler == NULL)
+		scheduler = new TileScheduler(settings);
+
+	// A progressive render writes the image after every pass, so a usable
+	// picture exists from the first pass on, and stops at a deadline or
+	// once the image is clean enough
+	bool progressive = settings.timeBudget > 0 || settings.noiseTarget > 0;
+	if (progressive)
+		cout << endl;
+	double start = TileScheduler::currentTime();
+
+	// Base pass: the scene's n-by-n samples in every pixel
+	unsigned int pixels = settings.pixelWidth * settings.pixelHeight;
+	unsigned int perPixel = MAX(1U, settings.sqrtSamplesPerPixel * settings.sqrtSamplesPerPixel);
+	vector<unsigned int> targets(pixels, perPixel);
+	TraceStats total;
+	total.hitsShaded = total.materialEvaluations = 0;
+	total.bouncesTraced = total.bouncesCut = total.bouncesBoosted = 0;
+	renderPass(settings, output, targets, &total);
+
+	unsigned long long samples = (unsigned long long)pixels * perPixel;
+	unsigned int passes = 1;
+	double secondsPerSample = (TileScheduler::currentTime() - start) / samples;
+	if (progressive)
+		writePass(settings, output, passes, samples, start);
+
+	// Further passes: adaptive ones add samples wherever the error is still
+	// too high, progressive ones double every pixel's samples. The passes
+	// are sized to fit what is left of the sample budget and, going by the
+	// cost of the pass before, of the time budget.
+	unsigned long long budget = settings.sampleBudget > 0 ?
+		(unsigned long long)pixels * settings.sampleBudget : ULLONG_MAX;
+	while ((settings.adaptiveThreshold > 0 || progressive) && samples < budget) {
+		if (settings.noiseTarget > 0 && output.errorPercentile(NOISE_PERCENTILE) <= settings.noiseTarget)
+			break;
+
+		unsigned long long affordable = budget - samples;
+		if (settings.timeBudget > 0) {
+			double inTime = (settings.timeBudget - (TileScheduler::currentTime() - start)) / secondsPerSample;
+			if (inTime < affordable)
+				affordable = (unsigned long long)MAX(0.0, inTime);
+		}
+
+		unsigned long long added;
+		if (settings.adaptiveThreshold > 0)
+			added = refineTargets(settings, output, targets, affordable);
+		else {
+			unsigned int extra = (unsigned int)MIN((unsigned long long)targets[0], affordable / pixels);
+			for (unsigned int i = 0; i < pixels; i++)
+				targets[i] += extra;
+			added = (unsigned long long)extra * pixels;
+		}
+		if (added == 0)
+			break;
+
+		double passStart = TileScheduler::currentTime();
+		renderPass(settings, output, targets, &total);
+		secondsPerSample = (TileScheduler::currentTime() - passStart) / added;
+		samples += added;
+		passes++;
+		if (progressive)
+			writePass(settings, output, passes, samples, start);
 	}
 
 	// [END] RENDER
 	cout << "DONE" << endl;
 
+	cout << "Shaded " << total.hitsShaded << " hits with " << total.materialEvaluations
+		<< " material evaluations" << endl;
+	cout << "Traced " << total.bouncesTraced << " bounces; " << total.bouncesCut << " of "
+		<< total.bouncesTraced + total.bouncesCut << " ("
+		<< 100.0 * total.bouncesCut / MAX(1ULL, total.bouncesTraced + total.bouncesCut) << "%) saved by "
+		<< (settings.termination == rouletteTermination ? "roulette" : "threshold")
+		<< " below throughput " << settings.throughputCutoff;
+	if (settings.termination == rouletteTermination)
+		cout << ", " << total.bouncesBoosted << " survivors reweighted";
+	cout << endl;
+	if (settings.adaptiveThreshold > 0)
+		cout << "Adaptive sampling: " << samples << " samples (" << (double)samples / pixels
+			<< " per pixel) in " << passes - 1 << " extra passes to error " << settings.adaptiveThreshold << endl;
+
+	if (!progressive)
+		output.writeImage(settings.filename);
+}
+
+// Reports a finished progressive pass and writes the image so far.
+void Scene::writePass(const RenderSettings& settings, Film& output, unsigned int pass,
+					  unsigned long long samples, double start) {
+
+	unsigned int pixels = settings.pixelWidth * settings.pixelHeight;
+	double error = output.errorPercentile(NOISE_PERCENTILE);
+	cout << "Pass " << pass << ": " << (double)samples / pixels << " samples per pixel, error ";
+	if (error == DBL_MAX)
+		cout << "unknown";
+	else
+		cout << error << " at " << 100 * NOISE_PERCENTILE << "% of pixels";
+	cout << ", " << TileScheduler::currentTime() - start << "s; ";
 	output.writeImage(settings.filename);
 }
 
+// Renders every pixel of the image up to its target sample count, across
+// the render threads, and adds the threads' trace counts to TOTAL.
+void Scene::renderPass(const RenderSettings& settings, Film& output, const vector<unsigned int>& targets, TraceStats* total) {
+
+	unsigned int numThreads = MAX(1, settings.numThreads);
+	scheduler->beginPass(numThreads);
+
+	vector<RenderJob> jobs(numThreads);
+	for (unsigned int i = 0; i < numThreads; i++) {
+		jobs[i].scene = this;
+		jobs[i].settings = &settings;
+		jobs[i].scheduler = scheduler;
+		jobs[i].output = &output;
+		jobs[i].targets = &targets;
+		jobs[i].thread = i;
+	}
+
+	if (numThreads == 1)
+		renderWorker(&jobs[0]);
+	else {
+		vector<pthread_t> threads(numThreads);
+		for (unsigned int i = 0; i < numThreads; i++) {
+			if (pthread_create(&threads[i], NULL, renderWorker, &jobs[i]) != 0) {
+				cout << endl;
+				cerr << "Error: Could not start render thread" << endl;
+				exit(1);
+			}
+		}
+		for (unsigned int i = 0; i < numThreads; i++)
+			pthread_join(threads[i], NULL);
+	}
+
+	for (unsigned int i = 0; i < numThreads; i++) {
+		total->hitsShaded += jobs[i].stats.hitsShaded;
+		total->materialEvaluations += jobs[i].stats.materialEvaluations;
+		total->bouncesTraced += jobs[i].stats.bouncesTraced;
+		total->bouncesCut += jobs[i].stats.bouncesCut;
+		total->bouncesBoosted += jobs[i].stats.bouncesBoosted;
+	}
+}
+
+// Takes each pixel of the tile from the samples it already has up to its
+// target.
+void Scene::renderTile(const RenderTile& tile, const RenderSettings& settings, RayTracer& tracer,
+					   WavefrontTracer& wavefront, Film& output, const vector<unsigned int>& targets) {
+
+	Sampler samples(settings.pixelWidth, settings.pixelHeight, settings.sqrtSamplesPerPixel,
+		settings.seed, settings.samplePattern);
+
+	if (settings.integrator == wavefrontIntegrator) {
+		renderWavefront(tile, settings, samples, wavefront, output, targets);
+		return;
+	}
+
+	if (settings.packetRays) {
+		for (unsigned int y = tile.y0; y < tile.y1; y += PACKET_BLOCK)
+			for (unsigned int x = tile.x0; x < tile.x1; x += PACKET_BLOCK)
+				renderBlock(x, y, tile, settings, samples, tracer, output, targets);
+		return;
+	}
+
+	for (unsigned int y = tile.y0; y < tile.y1; y++)
+		for (unsigned int x = tile.x0; x < tile.x1; x++) {
+			unsigned int target = targets[y * settings.pixelWidth + x];
+			for (unsigned int index = output.getSampleCount(x, y); index < target; index++) {
+				Sample s = samples.getSample(x, y, index);
+				Ray viewRay = sceneCam->createViewingRay(samples.normalizeSample(s));
+				rgb pixelColor = tracer.traceViewingRay(viewRay);
+				output.commit(s, pixelColor);
+			}
+		}
+}
+
+// Renders the PACKET_BLOCK-square block of the tile at (x0, y0) with ray
+// packets: the block's samples with the same index go out together.
+void Scene::renderBlock(unsigned int x0, unsigned int y0, const RenderTile& tile, const RenderSettings& settings,
+						Sampler& samples, RayTracer& tracer, Film& output, const vector<unsigned int>& targets) {
+
+	unsigned int x1 = MIN(x0 + PACKET_BLOCK, tile.x1);
+	unsigned int y1 = MIN(y0 + PACKET_BLOCK, tile.y1);
+	unsigned int first = UINT_MAX, last = 0;
+	for (unsigned int y = y0; y < y1; y++)
+		for (unsigned int x = x0; x < x1; x++) {
+			first = MIN(first, output.getSampleCount(x, y));
+			last = MAX(last, targets[y * settings.pixelWidth + x]);
+		}
+
+	vector<Ray> rays;
+	vector<Sample> packetSamples;
+	rays.reserve(PACKET_SIZE);
+	packetSamples.reserve(PACKET_SIZE);
+	RayPacket packet;
+	rgb colors[PACKET_SIZE];
+
+	for (unsigned int index = first; index < last; index++) {
+		rays.clear();
+		packetSamples.clear();
+		for (unsigned int y = y0; y < y1; y++)
+			for (unsigned int x = x0; x < x1; x++)
+				if (index >= output.getSampleCount(x, y) && index < targets[y * settings.pixelWidth + x]) {
+					Sample s = samples.getSample(x, y, index);
+					packetSamples.push_back(s);
+					rays.push_back(sceneCam->createViewingRay(samples.normalizeSample(s)));
+				}
+
+		packet.size = rays.size();
+		for (unsigned int k = 0; k < packet.size; k++)
+			packet.rays[k] = &rays[k];
+		tracer.traceViewingPacket(packet, colors);
+		for (unsigned int k = 0; k < packet.size; k++)
+			output.commit(packetSamples[k], colors[k]);
+	}
+}
+
+// Traces the tile's samples with the wavefront tracer, WAVEFRONT_BATCH at
+// a time. Camera rays are queued in the same block order renderBlock()
+// uses, so the tracer's packets of camera rays stay coherent.
+void Scene::renderWavefront(const RenderTile& tile, const RenderSettings& settings, Sampler& samples,
+							WavefrontTracer& wavefront, Film& output, const vector<unsigned int>& targets) {
+
+	vector<Sample> batch;
+	vector<rgb> colors;
+
+	for (unsigned int y0 = tile.y0; y0 < tile.y1; y0 += PACKET_BLOCK)
+		for (unsigned int x0 = tile.x0; x0 < tile.x1; x0 += PACKET_BLOCK) {
+			unsigned int x1 = MIN(x0 + PACKET_BLOCK, tile.x1);
+			unsigned int y1 = MIN(y0 + PACKET_BLOCK, tile.y1);
+			unsigned int first = UINT_MAX, last = 0;
+			for (unsigned int y = y0; y < y1; y++)
+				for (unsigned int x = x0; x < x1; x++) {
+					first = MIN(first, output.getSampleCount(x, y));
+					last = MAX(last, targets[y * settings.pixelWidth + x]);
+				}
+
+			for (unsigned int index = first; index < last; index++)
+				for (unsigned int y = y0; y < y1; y++)
+					for (unsigned int x = x0; x < x1; x++)
+						if (index >= output.getSampleCount(x, y) && index < targets[y * settings.pixelWidth + x]) {
+							Sample s = samples.getSample(x, y, index);
+							Ray viewRay = sceneCam->createViewingRay(samples.normalizeSample(s));
+							wavefront.addViewingRay(viewRay);
+							batch.push_back(s);
+						}
+
+			// Only between blocks: the block's pixels must keep their
+			// sample counts until its rays are all queued.
+			if (batch.size() >= WAVEFRONT_BATCH || (y0 + PACKET_BLOCK >= tile.y1 && x0 + PACKET_BLOCK >= tile.x1)) {
+				wavefront.traceBatch(colors);
+				for (unsigned int k = 0; k < batch.size(); k++)
+					output.commit(batch[k], colors[k]);
+				batch.clear();
+			}
+		}
+}
+
+// Picks the pixels for the next adaptive pass and raises their targets:
+// every pixel whose error, or any neighbour's, is above the threshold
+// gets its sample count doubled, up to ADAPTIVE_MAX_FACTOR times the base
+// count. The neighbours count because a pixel whose few samples happen
+// to agree (e.g. on a thin edge) reports no error at all. If the budget
+// can't cover them all, the worst pixels go first. Returns the number of
+// samples added.
+unsigned long long Scene::refineTargets(const RenderSettings& settings, const Film& output,
+										vector<unsigned int>& targets, unsigned long long budget) {
+
+	unsigned int width = settings.pixelWidth;
+	unsigned int height = settings.pixelHeight;
+	unsigned int perPixel = MAX(1U, settings.sqrtSamplesPerPixel * settings.sqrtSamplesPerPixel);
+	unsigned int maxPerPixel = perPixel * ADAPTIVE_MAX_FACTOR;
+
+	vector<double> errors(width * height);
+	for (unsigned int j = 0; j < height; j++)
+		for (unsigned int i = 0; i < width; i++)
+			errors[j * width + i] = output.estimateError(i, j);
+
+	vector< pair<double, unsigned int> > candidates;
+	for (unsigned int j = 0; j < height; j++)
+		for (unsigned int i = 0; i < width; i++) {
+			unsigned int index = j * width + i;
+			if (targets[index] >= maxPerPixel)
+				continue;
+			double error = 0;
+			for (unsigned int y = (j > 0 ? j - 1 : 0); y <= MIN(j + 1, height - 1); y++)
+				for (unsigned int x = (i > 0 ? i - 1 : 0); x <= MIN(i + 1, width - 1); x++)
+					error = MAX(error, errors[y * width + x]);
+			if (error > settings.adaptiveThreshold)
+				candidates.push_back(pair<double, unsigned int>(error, index));
+		}
+
+	// Worst first; ties (pixels without an estimate yet) in scanline order
+	stable_sort(candidates.begin(), candidates.end(), worseError);
+
+	unsigned long long added = 0;
+	for (unsigned int k = 0; k < candidates.size(); k++) {
+		unsigned int index = candidates[k].second;
+		unsigned int extra = MIN(targets[index], maxPerPixel - targets[index]);
+		if (added + extra > budget)
+			break;
+		targets[index] += extra;
+		added += extra;
+	}
+	return added;
+}
+
+// Entry point for render threads. Each thread traces with its own RayTracer;
+// tiles never overlap, so threads commit to disjoint pixels of the Film.
+void* Scene::renderWorker(void* arg) {
+
+	RenderJob* job = (RenderJob*)arg;
+	const RenderSettings& settings = *job->settings;
+	RayTracer tracer(job->scene, settings);
+	WavefrontTracer wavefront(job->scene, &tracer, settings);
+
+	unsigned int index;
+	while (job->scheduler->nextTile(job->thread, &index)) {
+		double start = TileScheduler::currentTime();
+		job->scene->renderTile(job->scheduler->getTile(index), settings, tracer, wavefront, *job->output, *job->targets);
+		job->scheduler->recordCost(index, TileScheduler::currentTime() - start);
+	}
+	job->stats = tracer.getStats();
+
+	return NULL;
+}
+
 void Scene::addLight(Light* light) {
 
 	sceneLights.push_back(light);
 
 }
 
-void Scene::setHierarchy(BoundingBoxTree* tree) {
+void Scene::setHierarchy(Primitive* tree) {
 
 	hierarchy = tree;
 }
@@ -64,7 +424,7 @@ vector<Light*> Scene::getLights() {
 
 }
 
-BoundingBoxTree* Scene::getHierarchy() {
+Primitive* Scene::getHierarchy() {
 
 	return hierarchy;
 
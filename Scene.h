@@ -1,10 +1,18 @@
 #ifndef SCENEH
 #define SCENEH
 
+// Forward declarations
+class RayTracer;
+class Film;
+class TileScheduler;
+class WavefrontTracer;
+struct trace_stats_struct;
+
 #include "Camera.h"
 #include "Lights.h"
 #include "RenderSettings.h"
 #include "Primitives.h"
+#include "Sampler.h"
 #include <string>
 #include <vector>
 
@@ -18,7 +26,24 @@ private:
 	/* Instance vars */
 	Camera* sceneCam;					// Camera for this scene.
 	vector<Light*> sceneLights;			// Lights for this scene.
-	BoundingBoxTree* hierarchy;			// Object hierarchy for this scene.
+	Primitive* hierarchy;			// Object hierarchy for this scene.
+	TileScheduler* scheduler;			// Tiling and tile timings kept between renders.
+
+	/* Instance methods */
+	void renderPass(const RenderSettings& settings, Film& output, const vector<unsigned int>& targets, trace_stats_struct* total);
+	void renderTile(const RenderTile& tile, const RenderSettings& settings, RayTracer& tracer,
+		WavefrontTracer& wavefront, Film& output, const vector<unsigned int>& targets);
+	void renderWavefront(const RenderTile& tile, const RenderSettings& settings, Sampler& samples,
+		WavefrontTracer& wavefront, Film& output, const vector<unsigned int>& targets);
+	void renderBlock(unsigned int x0, unsigned int y0, const RenderTile& tile, const RenderSettings& settings,
+		Sampler& samples, RayTracer& tracer, Film& output, const vector<unsigned int>& targets);
+
+	/* Static methods */
+	static void* renderWorker(void* arg);
+	static void writePass(const RenderSettings& settings, Film& output, unsigned int pass,
+		unsigned long long samples, double start);
+	static unsigned long long refineTargets(const RenderSettings& settings, const Film& output,
+		vector<unsigned int>& targets, unsigned long long budget);
 
 public:
 
@@ -28,9 +53,9 @@ public:
 	/* Instance methods */
 	void render(const RenderSettings& settings);
 	void addLight(Light* light);
-	void setHierarchy(BoundingBoxTree* tree);
+	void setHierarchy(Primitive* tree);
 	vector<Light*> getLights();
-	BoundingBoxTree* getHierarchy();
+	Primitive* getHierarchy();
 
 };
 
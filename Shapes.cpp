@@ -11,13 +11,18 @@
 #include <cfloat>
 #include <cmath>
 
-#define WIREFRAME_THRESHOLD 0.01
-
 
 Shape::Shape() {}
 
 Shape::~Shape() {}
 
+// Shapes without a faster test fall back on the full intersection.
+bool Shape::intersectAny(Ray& ray) {
+
+	IntersectRecord rec;
+	return intersect(ray, &rec);
+}
+
 /****************************/
 /*      BoundingBox         */
 /****************************/
@@ -37,7 +42,7 @@ BoundingBox::BoundingBox(const vec3 &min, const vec3 &max) {
 }
 
 bool BoundingBox::intersect(Ray& ray, IntersectRecord* rec) {
-    double tmin, tmax, tymin, tymax, tzmin, tzmax;
+    scalar tmin, tmax, tymin, tymax, tzmin, tzmax;
     vec3 direction = ray.getDirection();
     vec3 origin = ray.getOrigin();
     vec3 inverse = ray.getInverseDirection();
@@ -105,18 +110,30 @@ vec2 BoundingBox::getTextureCoordinate(const vec3& point) {
 	throw "BoundingBox does not implement this method.";
 }
 
-double BoundingBox::minCoordinate(int axis) {
+void BoundingBox::addMemoryUsage(MemoryUsage& usage) {
+
+	usage.geometry += sizeof(BoundingBox);
+}
+
+scalar BoundingBox::minCoordinate(int axis) {
 
 	return bounds[0][axis];
 
 }
 
-double BoundingBox::maxCoordinate(int axis) {
+scalar BoundingBox::maxCoordinate(int axis) {
 
 	return bounds[1][axis];
 
 }
 
+scalar BoundingBox::surfaceArea() {
+
+	vec3 extent = bounds[1] - bounds[0];
+	return 2 * (extent[0]*extent[1] + extent[1]*extent[2] + extent[2]*extent[0]);
+
+}
+
 BoundingBox BoundingBox::combine(const BoundingBox& box1, const BoundingBox& box2) {
 
 	BoundingBox comboBox;
@@ -136,7 +153,7 @@ BoundingBox BoundingBox::combine(const BoundingBox& box1, const BoundingBox& box
 /****************************/
 /*         Sphere           */
 /****************************/
-Sphere::Sphere(double radius, const vec3& center) {
+Sphere::Sphere(scalar radius, const vec3& center) {
 
 	this->radius = radius;
 	this->center = center;
@@ -149,16 +166,16 @@ bool Sphere::intersect(Ray& ray, IntersectRecord* rec) {
     
     // If discriminant is less than zero, then the ray didn't
     // hit anything.
-	double discriminant = getDiscriminant(origin, direction);
+	scalar discriminant = getDiscriminant(origin, direction);
     if (discriminant < 0) 
         return false;
     
 	// Quadratic formula!
-	double leftTerm = -direction * (origin - center);
-	double rightTerm = sqrt(discriminant);
-	double denominator = direction * direction;
-	double tNeg = (leftTerm - rightTerm) / denominator;
-	double tPos = (leftTerm + rightTerm) / denominator;
+	scalar leftTerm = -direction * (origin - center);
+	scalar rightTerm = sqrt(discriminant);
+	scalar denominator = direction * direction;
+	scalar tNeg = (leftTerm - rightTerm) / denominator;
+	scalar tPos = (leftTerm + rightTerm) / denominator;
 
 	// If either of the roots is within the ray's intersection
 	// bounds, use smaller one. Otherwise, the ray didn't hit.
@@ -174,6 +191,21 @@ bool Sphere::intersect(Ray& ray, IntersectRecord* rec) {
 	return true;
 }
 
+bool Sphere::intersectAny(Ray& ray) {
+
+	vec3 origin = ray.getOrigin();
+	vec3 direction = ray.getDirection();
+	scalar discriminant = getDiscriminant(origin, direction);
+	if (discriminant < 0)
+		return false;
+
+	scalar leftTerm = -direction * (origin - center);
+	scalar rightTerm = sqrt(discriminant);
+	scalar denominator = direction * direction;
+	return ray.isWithinBounds((leftTerm - rightTerm) / denominator) ||
+		ray.isWithinBounds((leftTerm + rightTerm) / denominator);
+}
+
 BoundingBox Sphere::getBoundingBox() {
 
 	vec3 radiusVec(radius,radius,radius);
@@ -182,15 +214,20 @@ BoundingBox Sphere::getBoundingBox() {
 
 vec2 Sphere::getTextureCoordinate(const vec3& point) {
 
-	double theta = acos((point[VY] - center[VY]) / radius);
-	double phi = atan2(point[VZ] - center[VY], point[VX] - center[VX]);
+	scalar theta = acos((point[VY] - center[VY]) / radius);
+	scalar phi = atan2(point[VZ] - center[VY], point[VX] - center[VX]);
 	phi = (phi < 0 ? phi + 2*M_PI : phi);
-	double u = 1 - (phi / (2 * M_PI));
-	double v = (M_PI - theta) / M_PI;
+	scalar u = 1 - (phi / (2 * M_PI));
+	scalar v = (M_PI - theta) / M_PI;
 	return vec2(u,v);
 
 }
 
+void Sphere::addMemoryUsage(MemoryUsage& usage) {
+
+	usage.geometry += sizeof(Sphere);
+}
+
 void Sphere::getNormal(Ray& ray, IntersectRecord *rec) {
     // Find Normal
     vec3 surfaceNormal = rec->point - center;
@@ -208,9 +245,9 @@ void Sphere::getNormal(Ray& ray, IntersectRecord *rec) {
 }
 
 // Gets the discriminat givin the origin and direction of the ray
-double Sphere::getDiscriminant(const vec3& origin, const vec3& direction) {
-    double scalarA = (direction * (origin - center)) * (direction * (origin - center));
-    double scalarB = (origin - center) * (origin - center) - radius * radius;
+scalar Sphere::getDiscriminant(const vec3& origin, const vec3& direction) {
+    scalar scalarA = (direction * (origin - center)) * (direction * (origin - center));
+    scalar scalarB = (origin - center) * (origin - center) - radius * radius;
     return scalarA - (direction * direction) * scalarB;
 }
 
@@ -238,6 +275,12 @@ bool TransformedShape::intersect(Ray& ray, IntersectRecord* rec) {
 	return result;
 }
 
+bool TransformedShape::intersectAny(Ray& ray) {
+
+	Ray temp = inverseTransform * ray;
+	return shape->intersectAny(temp);
+}
+
 BoundingBox TransformedShape::getBoundingBox() {
 
 	BoundingBox bbox = shape->getBoundingBox();
@@ -252,6 +295,14 @@ vec2 TransformedShape::getTextureCoordinate(const vec3& point) {
 	return shape->getTextureCoordinate(transPoint);
 }
 
+// Ellipsoids all share the unit sphere, which isn't counted against them.
+void TransformedShape::addMemoryUsage(MemoryUsage& usage) {
+
+	usage.geometry += sizeof(TransformedShape);
+	if (shape != &Sphere::unitSphere)
+		shape->addMemoryUsage(usage);
+}
+
 vec3 TransformedShape::transformNormal(const vec3& normal) {
 
 	vec3 transNorm = vec3(inverseTransform.transpose() * vec4(normal, 0.0), VW);
@@ -269,45 +320,148 @@ Ellipsoid::Ellipsoid(const mat4& transform)
 : TransformedShape(&Sphere::unitSphere, transform) {}
 
 
+/****************************/
+/*      TriangleKernel      */
+/****************************/
+
+TriangleKernel::TriangleKernel() {
+
+	watertight = false;
+}
+
+TriangleKernel::TriangleKernel(const vec3& a, const vec3& b, const vec3& c, bool watertight) {
+
+	this->a = a;
+	u = watertight ? b : b - a;
+	v = watertight ? c : c - a;
+	this->watertight = watertight;
+}
+
+bool TriangleKernel::intersect(Ray& ray, scalar* t, scalar* beta, scalar* gamma) {
+
+	if (watertight)
+		return intersectWatertight(ray, a, u, v, t, beta, gamma);
+	return intersectFast(ray, a, u, v, t, beta, gamma);
+}
+
+bool TriangleKernel::intersect(Ray& ray, const vec3& a, const vec3& b, const vec3& c, bool watertight,
+							   scalar* t, scalar* beta, scalar* gamma) {
+
+	if (watertight)
+		return intersectWatertight(ray, a, b, c, t, beta, gamma);
+	return intersectFast(ray, a, b - a, c - a, t, beta, gamma);
+}
+
+// Moller-Trumbore. Solves a + beta*edge1 + gamma*edge2 = origin + t*direction
+// by Cramer's rule, rejecting as early as possible.
+bool TriangleKernel::intersectFast(Ray& ray, const vec3& a, const vec3& edge1, const vec3& edge2,
+								   scalar* t, scalar* beta, scalar* gamma) {
+
+	vec3 direction = ray.getDirection();
+	vec3 pvec = direction ^ edge2;
+	scalar det = edge1 * pvec;
+
+	// Ray is parallel to the triangle's plane.
+	if (fabs(det) < 0.000001)
+		return false;
+	scalar invDet = 1 / det;
+
+	vec3 tvec = ray.getOrigin() - a;
+	scalar u = (tvec * pvec) * invDet;
+	if (u < 0 || u > 1)
+		return false;
+
+	vec3 qvec = tvec ^ edge1;
+	scalar v = (direction * qvec) * invDet;
+	if (v < 0 || u + v > 1)
+		return false;
+
+	scalar tHit = (edge2 * qvec) * invDet;
+	if (!ray.isWithinBounds(tHit))
+		return false;
+
+	*t = tHit;
+	*beta = u;
+	*gamma = v;
+	return true;
+}
+
+// Watertight test. The ray is sheared so it points down the z-axis, which
+// reduces the edge tests to 2D edge functions of the vertices. Those come
+// out exactly the same for an edge shared by two triangles, so a ray can't
+// miss both of them.
+bool TriangleKernel::intersectWatertight(Ray& ray, const vec3& a, const vec3& b, const vec3& c,
+										 scalar* t, scalar* beta, scalar* gamma) {
+
+	vec3 direction = ray.getDirection();
+	vec3 origin = ray.getOrigin();
+
+	// Largest component of the direction becomes z; keep the winding.
+	int kz = fabs(direction[0]) > fabs(direction[1]) ?
+		(fabs(direction[0]) > fabs(direction[2]) ? 0 : 2) :
+		(fabs(direction[1]) > fabs(direction[2]) ? 1 : 2);
+	int kx = (kz + 1) % 3;
+	int ky = (kx + 1) % 3;
+	if (direction[kz] < 0) {
+		int temp = kx;
+		kx = ky;
+		ky = temp;
+	}
+	scalar sz = 1 / direction[kz];
+	scalar sx = direction[kx] * sz;
+	scalar sy = direction[ky] * sz;
+
+	vec3 A = a - origin;
+	vec3 B = b - origin;
+	vec3 C = c - origin;
+	scalar ax = A[kx] - sx * A[kz];
+	scalar ay = A[ky] - sy * A[kz];
+	scalar bx = B[kx] - sx * B[kz];
+	scalar by = B[ky] - sy * B[kz];
+	scalar cx = C[kx] - sx * C[kz];
+	scalar cy = C[ky] - sy * C[kz];
+
+	// Edge functions; all the same sign means the ray passes inside.
+	scalar U = cx * by - cy * bx;
+	scalar V = ax * cy - ay * cx;
+	scalar W = bx * ay - by * ax;
+	if ((U < 0 || V < 0 || W < 0) && (U > 0 || V > 0 || W > 0))
+		return false;
+
+	scalar det = U + V + W;
+	if (det == 0)
+		return false;
+
+	scalar T = U * sz * A[kz] + V * sz * B[kz] + W * sz * C[kz];
+	scalar tHit = T / det;
+	if (!ray.isWithinBounds(tHit))
+		return false;
+
+	*t = tHit;
+	*beta = V / det;
+	*gamma = W / det;
+	return true;
+}
+
+
 /****************************/
 /*         Triangle         */
 /****************************/
-Triangle::Triangle (const vec3& a, const vec3& b, const vec3& c) {
+Triangle::Triangle (const vec3& a, const vec3& b, const vec3& c, bool watertight) {
     this->a = a;
     this->b = b;
     this->c = c;
 
 	barycentricFinder = mat3(a, b, c);
 	barycentricFinder = barycentricFinder.transpose().inverse();
+	this->watertight = watertight;
 }
 
 bool Triangle::intersect(Ray& ray, IntersectRecord* rec) {
 
-    vec3 origin = ray.getOrigin();
-    vec3 direction = ray.getDirection();
-
-    vec3 row1 = vec3(a[0] - b[0], a[0] - c[0], direction[0]);
-    vec3 row2 = vec3(a[1] - b[1], a[1] - c[1], direction[1]);
-    vec3 row3 = vec3(a[2] - b[2], a[2] - c[2], direction[2]);
-    mat3 linearEq = mat3(row1, row2, row3);
-
-    if (fabs(linearEq.determinant()) < 0.000001) 
-        return false;
-    
-    mat3 inverse = linearEq.inverse();
-    mat3 idenity = inverse * linearEq;
-    
-    vec3 answer = a - origin;
-    vec3 solution = inverse * answer;
-    double t = solution[2];
-    double gamma = solution[1];
-    double beta = solution[0];
-    
-    if (!ray.isWithinBounds(t))
-        return false;
-    
-    if (gamma < 0 || beta < 0 || gamma + beta > 1)
-        return false;
+	scalar t, beta, gamma;
+	if (!TriangleKernel::intersect(ray, a, b, c, watertight, &t, &beta, &gamma))
+		return false;
     
     rec->t = t;
 	rec->point = ray.intersectionPoint(rec->t);
@@ -316,6 +470,12 @@ bool Triangle::intersect(Ray& ray, IntersectRecord* rec) {
     
 }
 
+bool Triangle::intersectAny(Ray& ray) {
+
+	scalar t, beta, gamma;
+	return TriangleKernel::intersect(ray, a, b, c, watertight, &t, &beta, &gamma);
+}
+
 BoundingBox Triangle::getBoundingBox() {
 
 	vec3 min(DBL_MAX, DBL_MAX, DBL_MAX);
@@ -353,6 +513,12 @@ vec2 Triangle::getTextureCoordinate(const vec3& point) {
 
 }
 
+void Triangle::addMemoryUsage(MemoryUsage& usage) {
+
+	usage.geometry += sizeof(Triangle);
+	usage.triangles++;
+}
+
 void Triangle::getNormal(Ray& ray, IntersectRecord* rec) {
     vec3 normal = (b - a) ^ (b - c);
     normal.normalize();
@@ -370,7 +536,7 @@ void Triangle::getNormal(Ray& ray, IntersectRecord* rec) {
 /*	     MeshTriangle       */
 /****************************/
 
-MeshTriangle::MeshTriangle(Mesh* mesh, int vertI[], int normI[], int texI[]) {
+MeshTriangle::MeshTriangle(Mesh* mesh, int vertI[], int normI[], int texI[], bool watertight) {
 
 	this->mesh = mesh;
 	this->vertI[0] = vertI[0];
@@ -385,56 +551,36 @@ MeshTriangle::MeshTriangle(Mesh* mesh, int vertI[], int normI[], int texI[]) {
 
 	barycentricFinder = mat3(mesh->vertices[vertI[0]], mesh->vertices[vertI[1]], mesh->vertices[vertI[2]]);
 	barycentricFinder = barycentricFinder.transpose().inverse();
+	kernel = TriangleKernel(mesh->vertices[vertI[0]], mesh->vertices[vertI[1]], mesh->vertices[vertI[2]], watertight);
 }
 
 
 bool MeshTriangle::intersect(Ray& ray, IntersectRecord* rec) {
 
-	// Get vertices
-	vec3 a = mesh->vertices[vertI[0]];
-	vec3 b = mesh->vertices[vertI[1]];
-	vec3 c = mesh->vertices[vertI[2]];
-
-	vec3 origin = ray.getOrigin();
-    vec3 direction = ray.getDirection();
-
-    vec3 row1 = vec3(a[0] - b[0], a[0] - c[0], direction[0]);
-    vec3 row2 = vec3(a[1] - b[1], a[1] - c[1], direction[1]);
-    vec3 row3 = vec3(a[2] - b[2], a[2] - c[2], direction[2]);
-    mat3 linearEq = mat3(row1, row2, row3);
-
-    if (fabs(linearEq.determinant()) < 0.000001) 
-        return false;
-    
-    mat3 inverse = linearEq.inverse();
-    mat3 idenity = inverse * linearEq;
-    
-    vec3 answer = a - origin;
-    vec3 solution = inverse * answer;
-    double t = solution[2];
-    double gamma = solution[1];
-    double beta = solution[0];
-    
-    if (!ray.isWithinBounds(t))
-        return false;
-    
-    if (gamma < 0 || beta < 0 || gamma + beta > 1)
-        return false;
+	scalar t, beta, gamma;
+	if (!kernel.intersect(ray, &t, &beta, &gamma))
+		return false;
     
     rec->t = t;
 	rec->point = ray.intersectionPoint(rec->t);
-    getNormal(ray, rec);
+    getNormal(beta, gamma, rec);
     return true;
 
 }
 
-void MeshTriangle::getNormal(Ray& ray, IntersectRecord* rec) {
+bool MeshTriangle::intersectAny(Ray& ray) {
+
+	scalar t, beta, gamma;
+	return kernel.intersect(ray, &t, &beta, &gamma);
+}
+
+// Interpolates the vertex normals with the barycentric coordinates of the hit.
+void MeshTriangle::getNormal(scalar beta, scalar gamma, IntersectRecord* rec) {
 
-	vec3 abg = barycentricFinder * rec->point;
 	rec->surfaceNormal = 
-		abg[0]*mesh->normals[normI[0]] +
-		abg[1]*mesh->normals[normI[1]] +
-		abg[2]*mesh->normals[normI[2]];
+		(1 - beta - gamma)*mesh->normals[normI[0]] +
+		beta*mesh->normals[normI[1]] +
+		gamma*mesh->normals[normI[2]];
 	rec->surfaceNormal.normalize();
 }
 
@@ -484,46 +630,32 @@ vec2 MeshTriangle::getTextureCoordinate(const vec3& point) {
 
 }
 
+// The mesh's vertex arrays are counted by its MeshPrimitive.
+void MeshTriangle::addMemoryUsage(MemoryUsage& usage) {
+
+	usage.geometry += sizeof(MeshTriangle);
+	usage.triangles++;
+}
+
+void MeshTriangle::getVertices(vec3 vertices[3]) {
+
+	for (int k = 0; k < 3; k++)
+		vertices[k] = mesh->vertices[vertI[k]];
+}
+
 
 /****************************/
 /*	   WireframeTriangle    */
 /****************************/
 
-WireframeTriangle::WireframeTriangle(Mesh* mesh, int vertI[], int normI[], int texI[])
-: MeshTriangle(mesh, vertI, normI, texI) {}
+WireframeTriangle::WireframeTriangle(Mesh* mesh, int vertI[], int normI[], int texI[], bool watertight)
+: MeshTriangle(mesh, vertI, normI, texI, watertight) {}
 
 bool WireframeTriangle::intersect(Ray& ray, IntersectRecord* rec) {
 
-		// Get vertices
-	vec3 a = mesh->vertices[vertI[0]];
-	vec3 b = mesh->vertices[vertI[1]];
-	vec3 c = mesh->vertices[vertI[2]];
-
-	vec3 origin = ray.getOrigin();
-    vec3 direction = ray.getDirection();
-
-    vec3 row1 = vec3(a[0] - b[0], a[0] - c[0], direction[0]);
-    vec3 row2 = vec3(a[1] - b[1], a[1] - c[1], direction[1]);
-    vec3 row3 = vec3(a[2] - b[2], a[2] - c[2], direction[2]);
-    mat3 linearEq = mat3(row1, row2, row3);
-
-    if (fabs(linearEq.determinant()) < 0.000001) 
-        return false;
-    
-    mat3 inverse = linearEq.inverse();
-    mat3 idenity = inverse * linearEq;
-    
-    vec3 answer = a - origin;
-    vec3 solution = inverse * answer;
-    double t = solution[2];
-    double gamma = solution[1];
-    double beta = solution[0];
-    
-    if (!ray.isWithinBounds(t))
-        return false;
-    
-    if (gamma < 0 || beta < 0 || gamma + beta > 1)
-        return false;
+	scalar t, beta, gamma;
+	if (!kernel.intersect(ray, &t, &beta, &gamma))
+		return false;
 
 	// Wireframe constraints
 	if (!(gamma < WIREFRAME_THRESHOLD || beta < WIREFRAME_THRESHOLD ||
@@ -532,7 +664,16 @@ bool WireframeTriangle::intersect(Ray& ray, IntersectRecord* rec) {
     
     rec->t = t;
 	rec->point = ray.intersectionPoint(rec->t);
-    getNormal(ray, rec);
+    getNormal(beta, gamma, rec);
     return true;
 
+}
+
+bool WireframeTriangle::intersectAny(Ray& ray) {
+
+	scalar t, beta, gamma;
+	if (!kernel.intersect(ray, &t, &beta, &gamma))
+		return false;
+	return gamma < WIREFRAME_THRESHOLD || beta < WIREFRAME_THRESHOLD ||
+		gamma + beta > 1 - WIREFRAME_THRESHOLD;
 }
\ No newline at end of file
@@ -24,6 +24,22 @@ using namespace std;
 class BoundingBox;
 typedef struct intersect_record_struct IntersectRecord;
 
+// Width of the edge band a wireframe triangle is hit in, in barycentrics.
+#define WIREFRAME_THRESHOLD 0.01
+
+
+/* Bytes a scene's primitives take up, split between the geometry itself
+   (shapes, vertices) and the acceleration structures over it (hierarchy
+   nodes, leaf lists), and the number of triangles they hold. */
+typedef struct memory_usage_struct {
+
+	unsigned long long geometry;
+	unsigned long long acceleration;
+	unsigned long long triangles;
+
+} MemoryUsage;
+
+
 class Shape {
 
     public:
@@ -33,10 +49,15 @@ class Shape {
         virtual ~Shape();
         // If object intersects with a ray, return true.
         virtual bool intersect(Ray& ray, IntersectRecord* rec) = 0;
+        // True if the ray hits this shape anywhere within its bounds. Cheaper
+        // than intersect(): no hit point or normal is computed.
+        virtual bool intersectAny(Ray& ray);
 		// Get the bounding box for this shape
 		virtual BoundingBox getBoundingBox() = 0;
 		// Get the texture coordinate for this shape given a point on the shape.
 		virtual vec2 getTextureCoordinate(const vec3& point) = 0;
+		// Add the bytes this shape takes up to "usage".
+		virtual void addMemoryUsage(MemoryUsage& usage) = 0;
 
 };
 
@@ -49,9 +70,11 @@ public:
 	bool intersect(Ray& ray, IntersectRecord* rec);
 	BoundingBox getBoundingBox();
 	vec2 getTextureCoordinate(const vec3& point);
+	void addMemoryUsage(MemoryUsage& usage);
 	void transform(const mat4& transformMatrix);
-	double minCoordinate(int axis);
-	double maxCoordinate(int axis);
+	scalar minCoordinate(int axis);
+	scalar maxCoordinate(int axis);
+	scalar surfaceArea();
 
 	static BoundingBox combine(const BoundingBox& box1, const BoundingBox& box2);
 
@@ -65,20 +88,22 @@ private:
 class Sphere : public Shape {
 
     public:
-        Sphere(double radius, const vec3& center);
+        Sphere(scalar radius, const vec3& center);
         bool intersect(Ray& ray, IntersectRecord* rec);
+        bool intersectAny(Ray& ray);
 		BoundingBox getBoundingBox();
 		vec2 getTextureCoordinate(const vec3& point);
+		void addMemoryUsage(MemoryUsage& usage);
 
 		static Sphere unitSphere;
 
     private:
-        double getDiscriminant(const vec3& origin, const vec3& direction);
+        scalar getDiscriminant(const vec3& origin, const vec3& direction);
 		void getNormal(Ray& ray, IntersectRecord* rec);
     
     private:
 		vec3 center;
-        double radius;
+        scalar radius;
         
 };
 
@@ -88,8 +113,10 @@ class TransformedShape : public Shape {
 public:
 	TransformedShape(Shape* shape, const mat4& transform);
 	bool intersect(Ray& ray, IntersectRecord* rec);
+	bool intersectAny(Ray& ray);
 	BoundingBox getBoundingBox();
 	vec2 getTextureCoordinate(const vec3& point);
+	void addMemoryUsage(MemoryUsage& usage);
 
 protected:
 	vec3 transformNormal(const vec3& normal);
@@ -108,13 +135,47 @@ public:
 };
 
 
+/* Ray/triangle intersection shared by all the triangle shapes, so a test
+   is a handful of dot and cross products with no matrix inversion. The
+   default mode is Moller-Trumbore; watertight mode (Woop, Benthin and
+   Wald 2013) never lets a ray slip through the shared edge of two
+   triangles, at a slightly higher cost per test. A kernel object keeps
+   only what its mode reads: the first vertex and the two edges from it
+   for Moller-Trumbore, the three vertices for the watertight test. Shapes
+   that keep their own vertices use the static test instead. */
+class TriangleKernel {
+
+public:
+	TriangleKernel();
+	TriangleKernel(const vec3& a, const vec3& b, const vec3& c, bool watertight);
+	// On a hit within the ray's bounds, returns the t-value and the
+	// barycentric weights of vertices b and c.
+	bool intersect(Ray& ray, scalar* t, scalar* beta, scalar* gamma);
+	// The same test for a triangle that isn't kept in a kernel.
+	static bool intersect(Ray& ray, const vec3& a, const vec3& b, const vec3& c, bool watertight,
+						  scalar* t, scalar* beta, scalar* gamma);
+
+private:
+	static bool intersectFast(Ray& ray, const vec3& a, const vec3& edge1, const vec3& edge2,
+							  scalar* t, scalar* beta, scalar* gamma);
+	static bool intersectWatertight(Ray& ray, const vec3& a, const vec3& b, const vec3& c,
+									scalar* t, scalar* beta, scalar* gamma);
+	vec3 a;
+	vec3 u;				// edge b - a, or vertex b when watertight
+	vec3 v;				// edge c - a, or vertex c when watertight
+	bool watertight;
+};
+
+
 class Triangle : public Shape {
 
     public:
-        Triangle (const vec3& a, const vec3& b, const vec3& c);
+        Triangle (const vec3& a, const vec3& b, const vec3& c, bool watertight);
         bool intersect(Ray& ray, IntersectRecord* rec);
+        bool intersectAny(Ray& ray);
 		BoundingBox getBoundingBox();
 		vec2 getTextureCoordinate(const vec3& point);
+		void addMemoryUsage(MemoryUsage& usage);
 
     private:
 		void getNormal(Ray& ray, IntersectRecord* rec);
@@ -122,6 +183,7 @@ class Triangle : public Shape {
         vec3 b;
         vec3 c;
 		mat3 barycentricFinder;
+		bool watertight;
         
 };
 
@@ -139,19 +201,23 @@ class MeshTriangle : public Shape {
 
 public:
 
-	MeshTriangle(Mesh* mesh, int vertI[], int normI[], int texI[]);
+	MeshTriangle(Mesh* mesh, int vertI[], int normI[], int texI[], bool watertight);
 	virtual bool intersect(Ray& ray, IntersectRecord* rec);
+	virtual bool intersectAny(Ray& ray);
 	BoundingBox getBoundingBox();
 	vec2 getTextureCoordinate(const vec3& point);
+	void addMemoryUsage(MemoryUsage& usage);
+	void getVertices(vec3 vertices[3]);
 
 protected:
 
-	void getNormal(Ray& ray, IntersectRecord* rec);
+	void getNormal(scalar beta, scalar gamma, IntersectRecord* rec);
 	Mesh* mesh;
 	int vertI[3];
 	int normI[3];
 	int texI[3];
 	mat3 barycentricFinder;
+	TriangleKernel kernel;
 
 };
 
@@ -160,8 +226,9 @@ class WireframeTriangle : public MeshTriangle {
 
 public:
 
-	WireframeTriangle(Mesh* mesh, int vertI[], int normI[], int texI[]);
+	WireframeTriangle(Mesh* mesh, int vertI[], int normI[], int texI[], bool watertight);
 	bool intersect(Ray& ray, IntersectRecord* rec);
+	bool intersectAny(Ray& ray);
 };
 
 
@@ -0,0 +1,215 @@
+#include "TileScheduler.h"
+#include "WallClock.h"
+#include "algebra3.h"
+#include <algorithm>
+
+// A tile is split for the next pass if it took more than this fraction
+// of one thread's share of the last pass.
+#define SPLIT_FRACTION 0.25
+// Tiles are never split below this width/height in pixels.
+#define MIN_TILE_SIZE 4
+
+
+/* Orders tile indices by decreasing cost. */
+class CostOrder {
+
+public:
+
+	CostOrder(const vector<double>& costs) : costs(costs) {}
+	bool operator () (unsigned int a, unsigned int b) const {
+		return costs[a] > costs[b] || (costs[a] == costs[b] && a < b);
+	}
+
+private:
+
+	const vector<double>& costs;
+
+};
+
+
+/* Constructors */
+
+TileScheduler::TileScheduler(const RenderSettings& settings) {
+
+	pixelWidth = settings.pixelWidth;
+	pixelHeight = settings.pixelHeight;
+
+	unsigned int size = settings.tileSize;
+	if (size == 0)
+		size = MAX(pixelWidth, pixelHeight);
+
+	// Start out with tileSize x tileSize blocks in scanline order. Tiles
+	// along the right and top edges may be smaller.
+	for (unsigned int y = 0; y < pixelHeight; y += size)
+		for (unsigned int x = 0; x < pixelWidth; x += size) {
+			RenderTile tile;
+			tile.x0 = x;
+			tile.y0 = y;
+			tile.x1 = MIN(x + size, pixelWidth);
+			tile.y1 = MIN(y + size, pixelHeight);
+			tiles.push_back(tile);
+		}
+	costs.assign(tiles.size(), 0.0);
+
+}
+
+
+/* Destructor */
+
+TileScheduler::~TileScheduler() {
+
+	destroyLocks();
+
+}
+
+
+/* Instance methods */
+
+// Whether this scheduler's tiling can be reused for the given settings.
+bool TileScheduler::covers(const RenderSettings& settings) {
+
+	return pixelWidth == settings.pixelWidth && pixelHeight == settings.pixelHeight;
+}
+
+// Prepares the queues for a pass over every tile. Tiles are handed out
+// most expensive first (by last pass's timings), dealt round-robin so each
+// thread starts with a similar load. Must not be called while a pass is
+// still running.
+void TileScheduler::beginPass(unsigned int numThreads) {
+
+	numThreads = MAX(numThreads, 1);
+	splitExpensiveTiles(numThreads);
+
+	vector<unsigned int> order(tiles.size());
+	for (unsigned int i = 0; i < order.size(); i++)
+		order[i] = i;
+	stable_sort(order.begin(), order.end(), CostOrder(costs));
+
+	destroyLocks();
+	queues.assign(numThreads, deque<unsigned int>());
+	locks.resize(numThreads);
+	for (unsigned int i = 0; i < numThreads; i++)
+		pthread_mutex_init(&locks[i], NULL);
+
+	for (unsigned int i = 0; i < order.size(); i++)
+		queues[i % numThreads].push_back(order[i]);
+}
+
+// Gets the next tile for THREAD to render: first from its own queue, then
+// by stealing from another thread's. Returns false once every tile of the
+// pass has been handed out.
+bool TileScheduler::nextTile(unsigned int thread, unsigned int* tileIndex) {
+
+	return popOwn(thread, tileIndex) || steal(thread, tileIndex);
+}
+
+// Records how long a tile took; safe to call from any thread since each
+// tile is rendered by exactly one of them.
+void TileScheduler::recordCost(unsigned int tileIndex, double seconds) {
+
+	costs[tileIndex] = seconds;
+}
+
+const RenderTile& TileScheduler::getTile(unsigned int tileIndex) {
+
+	return tiles[tileIndex];
+}
+
+unsigned int TileScheduler::getTileCount() {
+
+	return tiles.size();
+}
+
+// Queues are sorted by decreasing cost, so owners and thieves both take from
+// the front: whichever thread goes idle picks up the most expensive tile that
+// is left, as in longest-processing-time-first scheduling.
+bool TileScheduler::popOwn(unsigned int thread, unsigned int* tileIndex) {
+
+	bool found = false;
+	pthread_mutex_lock(&locks[thread]);
+	if (!queues[thread].empty()) {
+		*tileIndex = queues[thread].front();
+		queues[thread].pop_front();
+		found = true;
+	}
+	pthread_mutex_unlock(&locks[thread]);
+	return found;
+}
+
+bool TileScheduler::steal(unsigned int thread, unsigned int* tileIndex) {
+
+	unsigned int numThreads = queues.size();
+	for (unsigned int k = 1; k < numThreads; k++) {
+		unsigned int victim = (thread + k) % numThreads;
+		bool found = false;
+		pthread_mutex_lock(&locks[victim]);
+		if (!queues[victim].empty()) {
+			*tileIndex = queues[victim].front();
+			queues[victim].pop_front();
+			found = true;
+		}
+		pthread_mutex_unlock(&locks[victim]);
+		if (found)
+			return true;
+	}
+	return false;
+}
+
+// Splits tiles that took much longer than average last pass into quarters.
+// Each quarter is assumed to cost a quarter of its parent until measured.
+void TileScheduler::splitExpensiveTiles(unsigned int numThreads) {
+
+	double total = 0;
+	for (unsigned int i = 0; i < costs.size(); i++)
+		total += costs[i];
+	if (total <= 0)
+		return;
+
+	double threshold = SPLIT_FRACTION * total / numThreads;
+	vector<RenderTile> newTiles;
+	vector<double> newCosts;
+
+	for (unsigned int i = 0; i < tiles.size(); i++) {
+		RenderTile tile = tiles[i];
+		unsigned int width = tile.x1 - tile.x0;
+		unsigned int height = tile.y1 - tile.y0;
+		if (costs[i] <= threshold || width < 2 * MIN_TILE_SIZE || height < 2 * MIN_TILE_SIZE) {
+			newTiles.push_back(tile);
+			newCosts.push_back(costs[i]);
+			continue;
+		}
+		unsigned int midX = tile.x0 + width / 2;
+		unsigned int midY = tile.y0 + height / 2;
+		unsigned int xs[3] = { tile.x0, midX, tile.x1 };
+		unsigned int ys[3] = { tile.y0, midY, tile.y1 };
+		for (int b = 0; b < 2; b++)
+			for (int a = 0; a < 2; a++) {
+				RenderTile quarter;
+				quarter.x0 = xs[a];
+				quarter.x1 = xs[a+1];
+				quarter.y0 = ys[b];
+				quarter.y1 = ys[b+1];
+				newTiles.push_back(quarter);
+				newCosts.push_back(costs[i] / 4);
+			}
+	}
+
+	tiles = newTiles;
+	costs = newCosts;
+}
+
+void TileScheduler::destroyLocks() {
+
+	for (unsigned int i = 0; i < locks.size(); i++)
+		pthread_mutex_destroy(&locks[i]);
+	locks.clear();
+}
+
+
+/* Static methods */
+
+// Wall-clock time in seconds.
+double TileScheduler::currentTime() {
+
+	return wallClockTime();
+}
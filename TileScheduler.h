@@ -0,0 +1,57 @@
+#ifndef TILESCHEDULERH
+#define TILESCHEDULERH
+
+#include "Sampler.h"
+#include "RenderSettings.h"
+#include <pthread.h>
+#include <deque>
+#include <vector>
+
+using namespace std;
+
+/* TileSchedulers hand out render tiles to worker threads. Every thread
+   owns a queue of tiles and steals from the others once its own runs dry.
+   The scheduler remembers how long each tile took, and on the next pass
+   (or frame) it splits the most expensive tiles and starts the costly
+   ones first, so no thread is left with a long tile at the end. */
+class TileScheduler {
+
+private:
+
+	/* Instance vars */
+	unsigned int pixelWidth;				// Image size this tiling covers
+	unsigned int pixelHeight;
+	vector<RenderTile> tiles;				// Current tiling of the image
+	vector<double> costs;					// Seconds spent on each tile last pass
+	vector< deque<unsigned int> > queues;	// Per-thread tile queues
+	vector<pthread_mutex_t> locks;			// One lock per queue
+
+	/* Instance methods */
+	void splitExpensiveTiles(unsigned int numThreads);
+	bool popOwn(unsigned int thread, unsigned int* tileIndex);
+	bool steal(unsigned int thread, unsigned int* tileIndex);
+	void destroyLocks();
+
+public:
+
+	/* Constructors */
+	TileScheduler(const RenderSettings& settings);
+
+	/* Destructor */
+	~TileScheduler();
+
+	/* Instance methods */
+	bool covers(const RenderSettings& settings);
+	void beginPass(unsigned int numThreads);
+	bool nextTile(unsigned int thread, unsigned int* tileIndex);
+	void recordCost(unsigned int tileIndex, double seconds);
+	const RenderTile& getTile(unsigned int tileIndex);
+	unsigned int getTileCount();
+
+	/* Static methods */
+	static double currentTime();
+
+};
+
+
+#endif
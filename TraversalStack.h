@@ -0,0 +1,50 @@
+#ifndef TRAVERSALSTACKH
+#define TRAVERSALSTACKH
+
+#define TRAVERSAL_STACK 64			// Default entries a TraversalStack holds without the heap
+
+
+/* The nodes still to visit during an iterative tree traversal. A tree
+   works out from its depth, once built, the most entries a traversal of
+   it can have pushed at once, and passes that in as "capacity". Up to
+   "localSize" entries are kept in the object itself; deeper trees (a
+   midpoint split of clustered objects can go a hundred levels down) get a
+   heap array of the size they need. */
+template <class T, unsigned int localSize = TRAVERSAL_STACK>
+class TraversalStack {
+
+public:
+
+	/* Constructor */
+	TraversalStack(unsigned int capacity) {
+
+		entries = capacity > localSize ? new T[capacity] : local;
+		size = 0;
+	}
+
+	~TraversalStack() {
+
+		if (entries != local)
+			delete[] entries;
+	}
+
+	/* Instance methods */
+	inline void push(const T& entry) { entries[size++] = entry; }
+	inline T pop() { return entries[--size]; }
+	inline bool empty() const { return size == 0; }
+
+private:
+
+	/* Not copyable */
+	TraversalStack(const TraversalStack& other);
+	TraversalStack& operator=(const TraversalStack& other);
+
+	/* Instance vars */
+	T local[localSize];
+	T* entries;
+	unsigned int size;
+
+};
+
+
+#endif
@@ -0,0 +1,239 @@
+#include "TriangleGroup.h"
+#include "algebra3f.h"
+#include <cfloat>
+#include <cmath>
+
+// Error allowed for in the float test, relative to the sizes of the vectors
+// each quantity is built from: over a hundred times the rounding error of
+// the handful of float operations involved.
+#define FILTER_ERROR 1e-5f
+
+
+/* Constructors */
+
+// Takes up to TRIANGLE_GROUP_SIZE primitives, each a GeoPrimitive around a
+// MeshTriangle (see gather()). The group owns them from now on.
+TriangleGroup::TriangleGroup(const vector<Primitive*>& triangles) {
+
+	vector<vec3> vertices;
+	for (unsigned int i = 0; i < triangles.size(); i++) {
+		vec3 corners[3];
+		getVertices(triangles[i], corners);
+		for (int k = 0; k < 3; k++)
+			vertices.push_back(corners[k]);
+	}
+	members = triangles;
+	setLanes(vertices);
+}
+
+// For instances: the members are transformed copies, so their vertices are
+// given already transformed.
+TriangleGroup::TriangleGroup(const vector<Primitive*>& triangles, const vector<vec3>& vertices) {
+
+	members = triangles;
+	setLanes(vertices);
+}
+
+TriangleGroup::~TriangleGroup() {
+
+	for (unsigned int i = 0; i < members.size(); i++)
+		delete members[i];
+}
+
+// Fills in the lanes from three vertices per member. Lanes without a
+// member are zeroed; mayHit() never reports them.
+void TriangleGroup::setLanes(const vector<vec3>& vertices) {
+
+	for (int i = 0; i < TRIANGLE_GROUP_SIZE; i++) {
+		vec3 a(0, 0, 0), b(0, 0, 0), c(0, 0, 0);
+		if (i < (int)members.size()) {
+			a = vertices[3 * i];
+			b = vertices[3 * i + 1];
+			c = vertices[3 * i + 2];
+		}
+		vec3 e1 = b - a, e2 = c - a;
+		vertexSize[i] = edge1Size[i] = edge2Size[i] = 0;
+		for (int k = 0; k < 3; k++) {
+			vertex[k][i] = (float)a[k];
+			edge1[k][i] = (float)e1[k];
+			edge2[k][i] = (float)e2[k];
+			vertexSize[i] += (float)fabs(a[k]);
+			edge1Size[i] += (float)fabs(e1[k]);
+			edge2Size[i] += (float)fabs(e2[k]);
+		}
+	}
+
+	box = members[0]->getBoundingBox();
+	for (unsigned int i = 1; i < members.size(); i++)
+		box = BoundingBox::combine(box, members[i]->getBoundingBox());
+}
+
+
+/* Instance methods */
+
+bool TriangleGroup::intersect(Ray& ray, IntersectRecord* rec) {
+
+	int lanes = mayHit(ray);
+	if (lanes == 0)
+		return false;
+
+	scalar tMin = ray.getLowerBound();
+	scalar oldMax = ray.getUpperBound();
+	bool hit = false;
+	for (unsigned int i = 0; i < members.size(); i++)
+		if ((lanes & (1 << i)) && members[i]->intersect(ray, rec)) {
+			hit = true;
+			ray.setBounds(tMin, rec->t);
+		}
+	ray.setBounds(tMin, oldMax);		// Reset ray bounds before returning
+	return hit;
+}
+
+bool TriangleGroup::intersectAny(Ray& ray) {
+
+	int lanes = mayHit(ray);
+	for (unsigned int i = 0; i < members.size(); i++)
+		if ((lanes & (1 << i)) && members[i]->intersectAny(ray))
+			return true;
+	return false;
+}
+
+// Returns a bitmask of the members the ray might hit within its bounds.
+// This is Moller-Trumbore in float on all lanes at once, kept in
+// unnormalized form (u, v and t still multiplied by det): the exact test
+// can only hit where 0 <= u, 0 <= v, u + v <= det and tMin*det <= t <=
+// tMax*det, for det > 0. A lane is ruled out only when one of these fails
+// by more than its error bound. Each bound is FILTER_ERROR times the
+// largest any term of the quantity can be, from the sizes of the vectors
+// involved; tvec's size is taken as that of the origin plus the vertex,
+// since subtracting them is where its error comes from.
+int TriangleGroup::mayHit(Ray& ray) {
+
+	vec3 origin = ray.getOrigin();
+	vec3 direction = ray.getDirection();
+	float originSize = (float)(fabs(origin[VX]) + fabs(origin[VY]) + fabs(origin[VZ]));
+	float directionSize = (float)(fabs(direction[VX]) + fabs(direction[VY]) + fabs(direction[VZ]));
+	float tMin = (float)ray.getLowerBound();
+	float tMax = ray.getUpperBound() > FLT_MAX ? FLT_MAX : (float)ray.getUpperBound();
+
+	float4 dx((float)direction[VX]), dy((float)direction[VY]), dz((float)direction[VZ]);
+	float4 e1x = float4::load(edge1[VX]), e1y = float4::load(edge1[VY]), e1z = float4::load(edge1[VZ]);
+	float4 e2x = float4::load(edge2[VX]), e2y = float4::load(edge2[VY]), e2z = float4::load(edge2[VZ]);
+
+	// pvec = direction ^ edge2, det = edge1 * pvec
+	float4 px = dy * e2z - dz * e2y;
+	float4 py = dz * e2x - dx * e2z;
+	float4 pz = dx * e2y - dy * e2x;
+	float4 det = e1x * px + e1y * py + e1z * pz;
+
+	// tvec = origin - vertex, u = tvec * pvec
+	float4 tx = float4((float)origin[VX]) - float4::load(vertex[VX]);
+	float4 ty = float4((float)origin[VY]) - float4::load(vertex[VY]);
+	float4 tz = float4((float)origin[VZ]) - float4::load(vertex[VZ]);
+	float4 u = tx * px + ty * py + tz * pz;
+
+	// qvec = tvec ^ edge1, v = direction * qvec, t = edge2 * qvec
+	float4 qx = ty * e1z - tz * e1y;
+	float4 qy = tz * e1x - tx * e1z;
+	float4 qz = tx * e1y - ty * e1x;
+	float4 v = dx * qx + dy * qy + dz * qz;
+	float4 t = e2x * qx + e2y * qy + e2z * qz;
+
+	float4 tvecSize = float4(originSize) + float4::load(vertexSize);
+	float4 e1Size = float4::load(edge1Size), e2Size = float4::load(edge2Size);
+	float4 detError = float4(FILTER_ERROR * directionSize) * e1Size * e2Size;
+	float4 uError = float4(FILTER_ERROR * directionSize) * tvecSize * e2Size;
+	float4 vError = float4(FILTER_ERROR * directionSize) * tvecSize * e1Size;
+	float4 tError = float4(FILTER_ERROR) * tvecSize * e1Size * e2Size;
+
+	// Fold det's sign into u, v and t. Where det is within its error of
+	// zero the sign isn't known, so those lanes are never ruled out.
+	float4 zero(0.0f);
+	float4 sign = select(det < zero, float4(-1.0f), float4(1.0f));
+	det = vabs(det);
+	u = u * sign;
+	v = v * sign;
+	t = t * sign;
+
+	float4 miss = (u < zero - uError) | (v < zero - vError) | (u + v - det > uError + vError + detError) |
+		(t < float4(tMin) * det - tError - float4(fabsf(tMin)) * detError) |
+		(t > float4(tMax) * det + tError + float4(tMax) * detError);
+	miss = miss & (det > detError);
+	return ~movemask(miss) & ((1 << members.size()) - 1);
+}
+
+Reflectance TriangleGroup::getReflectance(const vec3& point) {
+
+	// This should never be called; hits are reported by the members.
+	throw "TriangleGroup does not implement this method.";
+}
+
+BoundingBox TriangleGroup::getBoundingBox() {
+
+	return box;
+}
+
+// The float copies of the vertices only speed up intersection, so they
+// count as acceleration; the members are the geometry.
+void TriangleGroup::addMemoryUsage(MemoryUsage& usage) {
+
+	usage.acceleration += sizeof(TriangleGroup) + members.capacity() * sizeof(Primitive*);
+	for (unsigned int i = 0; i < members.size(); i++)
+		members[i]->addMemoryUsage(usage);
+}
+
+Primitive* TriangleGroup::instance(const mat4& transform, Material* mat) {
+
+	vector<Primitive*> copies;
+	vector<vec3> vertices;
+	for (unsigned int i = 0; i < members.size(); i++) {
+		copies.push_back(members[i]->instance(transform, mat));
+		vec3 corners[3];
+		getVertices(members[i], corners);
+		for (int k = 0; k < 3; k++)
+			vertices.push_back(vec3(transform * vec4(corners[k], 1.0)));
+	}
+	return new TriangleGroup(copies, vertices);
+}
+
+
+/* Static methods */
+
+// True if "prim" is a mesh triangle, i.e. a GeoPrimitive around a
+// MeshTriangle; its corners are then returned in "vertices".
+bool TriangleGroup::getVertices(Primitive* prim, vec3 vertices[3]) {
+
+	GeoPrimitive* geo = dynamic_cast<GeoPrimitive*>(prim);
+	if (geo == NULL)
+		return false;
+	MeshTriangle* triangle = dynamic_cast<MeshTriangle*>(geo->getShape());
+	if (triangle == NULL)
+		return false;
+	triangle->getVertices(vertices);
+	return true;
+}
+
+// Collects the primitives under "tree" into "triangles" if they all fit in
+// one group: at most TRIANGLE_GROUP_SIZE mesh triangles, no more than two
+// levels down (so the check stays cheap when made at every node).
+bool TriangleGroup::gather(Primitive* tree, vector<Primitive*>& triangles) {
+
+	triangles.clear();
+	return gatherLevels(tree, triangles, 2);
+}
+
+bool TriangleGroup::gatherLevels(Primitive* prim, vector<Primitive*>& triangles, int levels) {
+
+	BoundingBoxTree* tree = dynamic_cast<BoundingBoxTree*>(prim);
+	if (tree == NULL) {
+		vec3 vertices[3];
+		if (triangles.size() == TRIANGLE_GROUP_SIZE || !getVertices(prim, vertices))
+			return false;
+		triangles.push_back(prim);
+		return true;
+	}
+	if (levels == 0)
+		return false;
+	return (tree->low == NULL || gatherLevels(tree->low, triangles, levels - 1)) &&
+		(tree->high == NULL || gatherLevels(tree->high, triangles, levels - 1));
+}
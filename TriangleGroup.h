@@ -0,0 +1,67 @@
+#ifndef TRIANGLEGROUPH
+#define TRIANGLEGROUPH
+
+#include "Primitives.h"
+#include "Ray.h"
+#include "IntersectRecord.h"
+#include <vector>
+
+using namespace std;
+
+#define TRIANGLE_GROUP_SIZE 4			// Triangles tested at once (one per SSE lane)
+
+
+/* A leaf's worth of mesh triangles, with their vertex and edges stored as
+   rows of four floats so one SIMD kernel can test a ray against all of
+   them. The float test only rejects: it allows for its own rounding error,
+   and the triangles it can't rule out are intersected exactly by their
+   own primitives. Hits, and so images, are the same as testing every
+   triangle in turn; most triangles a ray reaches are misses, and those
+   cost a fraction of a test each with no virtual calls. */
+class TriangleGroup : public Primitive {
+
+public:
+
+	/* Constructor */
+	TriangleGroup(const vector<Primitive*>& triangles);
+
+	~TriangleGroup();
+
+	/* Instance methods */
+	bool intersect(Ray& ray, IntersectRecord* rec);
+	bool intersectAny(Ray& ray);
+	Reflectance getReflectance(const vec3& point);
+	BoundingBox getBoundingBox();
+	void addMemoryUsage(MemoryUsage& usage);
+	Primitive* instance(const mat4& transform, Material* mat);
+
+	/* Static methods */
+	static bool getVertices(Primitive* prim, vec3 vertices[3]);
+	static bool gather(Primitive* tree, vector<Primitive*>& triangles);
+
+private:
+
+	/* Constructor */
+	TriangleGroup(const vector<Primitive*>& triangles, const vector<vec3>& vertices);
+
+	/* Instance methods */
+	void setLanes(const vector<vec3>& vertices);
+	int mayHit(Ray& ray);
+
+	/* Static methods */
+	static bool gatherLevels(Primitive* prim, vector<Primitive*>& triangles, int levels);
+
+	/* Instance vars */
+	vector<Primitive*> members;			// The triangles, one per lane
+	float vertex[3][4];					// First vertex, by axis then lane
+	float edge1[3][4];					// Second vertex minus first
+	float edge2[3][4];					// Third vertex minus first
+	float vertexSize[4];				// Sums of absolute coordinates, which
+	float edge1Size[4];					// bound the float test's rounding error
+	float edge2Size[4];
+	BoundingBox box;
+
+};
+
+
+#endif
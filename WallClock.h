@@ -0,0 +1,19 @@
+#ifndef WALLCLOCKH
+#define WALLCLOCKH
+
+#include <sys/time.h>
+#include <cstddef>
+
+
+/* Seconds since the epoch, to the microsecond. Kept apart from the
+   renderer so the standalone benchmarks can time themselves without
+   linking it. */
+inline double wallClockTime() {
+
+	struct timeval tv;
+	gettimeofday(&tv, NULL);
+	return tv.tv_sec + tv.tv_usec / 1000000.0;
+}
+
+
+#endif
@@ -0,0 +1,221 @@
+#include "WavefrontTracer.h"
+#include "Lights.h"
+#include <cfloat>
+
+
+/* Constructors */
+
+WavefrontTracer::WavefrontTracer(Scene* scene, RayTracer* tracer, const RenderSettings& settings) {
+
+	tracingScene = scene;
+	shader = tracer;
+	usePackets = settings.packetRays;
+	current = 0;
+	packet.reserve(PACKET_SIZE);
+
+}
+
+
+/* Instance methods */
+
+// Publicly accessible. The camera stage: each viewing ray starts a path
+// of the next batch.
+void WavefrontTracer::addViewingRay(Ray& ray) {
+
+	PathQueue& paths = queues[current];
+	pushRay(paths.rays, ray, samples.size());
+	paths.throughputs.push_back(rgb(1,1,1));
+	paths.depths.push_back(shader->recursionDepth);
+	samples.push_back(ray.getSample());
+}
+
+// Publicly accessible. Traces every path of the batch to its end and sets
+// colors[i] to the color of the i'th viewing ray added, then empties the
+// batch. Each pass of the loop is one bounce of every path still going.
+void WavefrontTracer::traceBatch(vector<rgb>& colors) {
+
+	colors.assign(samples.size(), rgb::black);
+	rouletteDraws.assign(samples.size(), 0);
+
+	while (queues[current].rays.owners.size() > 0) {
+		intersectPaths();
+		shadeHits();
+		traceShadows();
+		lightHits(colors);
+
+		PathQueue& done = queues[current];
+		clearRays(done.rays);
+		done.throughputs.clear();
+		done.depths.clear();
+		current = 1 - current;
+	}
+	samples.clear();
+}
+
+// The closest-hit stage: finds where each path ray hits, keeping only
+// those that hit something.
+void WavefrontTracer::intersectPaths() {
+
+	PathQueue& paths = queues[current];
+	Primitive* hierarchy = tracingScene->getHierarchy();
+	unsigned int count = paths.rays.owners.size();
+	hits.rays.clear();
+	hits.records.clear();
+
+	if (!usePackets) {
+		for (unsigned int k = 0; k < count; k++) {
+			Ray ray = getRay(paths.rays, k, samples[paths.rays.owners[k]]);
+			IntersectRecord rec;
+			if (hierarchy->intersect(ray, &rec)) {
+				hits.rays.push_back(k);
+				hits.records.push_back(rec);
+			}
+		}
+		return;
+	}
+
+	// Neighbouring rays come from neighbouring samples (or share a
+	// parent), so the queue is close enough to coherent to cut into packets.
+	IntersectRecord recs[PACKET_SIZE];
+	RayPacket rayPacket;
+	for (unsigned int first = 0; first < count; first += PACKET_SIZE) {
+		packet.clear();
+		rayPacket.size = MIN(PACKET_SIZE, count - first);
+		for (unsigned int k = 0; k < rayPacket.size; k++)
+			packet.push_back(getRay(paths.rays, first + k, samples[paths.rays.owners[first + k]]));
+		for (unsigned int k = 0; k < rayPacket.size; k++) {
+			rayPacket.rays[k] = &packet[k];
+			rayPacket.records[k] = &recs[k];
+		}
+
+		unsigned int all = rayPacket.size == 32 ? ~0u : (1u << rayPacket.size) - 1;
+		unsigned int found = hierarchy->intersectPacket(rayPacket, all);
+		for (unsigned int k = 0; k < rayPacket.size; k++)
+			if (found & (1u << k)) {
+				hits.rays.push_back(first + k);
+				hits.records.push_back(recs[k]);
+			}
+	}
+}
+
+// The shading stage: evaluates the material at each hit and queues a
+// shadow ray from it towards every light.
+void WavefrontTracer::shadeHits() {
+
+	PathQueue& paths = queues[current];
+	vector<Light*> lights = tracingScene->getLights();
+	clearRays(shadows.rays);
+	shadows.lights.clear();
+	hits.reflectances.resize(hits.rays.size());
+
+	for (unsigned int h = 0; h < hits.rays.size(); h++) {
+		unsigned int k = hits.rays[h];
+		const IntersectRecord& rec = hits.records[h];
+		Ray ray = getRay(paths.rays, k, samples[paths.rays.owners[k]]);
+
+		shader->stats.hitsShaded++;
+		hits.reflectances[h] = shader->evaluateMaterial(rec);
+		for (unsigned int i = 0; i < lights.size(); i++) {
+			Ray shadowRay = lights[i]->getShadowRay(rec.point, shader->rayBias, ray);
+			pushRay(shadows.rays, shadowRay, h);
+			shadows.lights.push_back(i);
+		}
+	}
+}
+
+// The shadow stage: tests every shadow ray for an occluder.
+void WavefrontTracer::traceShadows() {
+
+	PathQueue& paths = queues[current];
+	Primitive* hierarchy = tracingScene->getHierarchy();
+	unsigned int count = shadows.rays.owners.size();
+	occluded.resize(count);
+
+	for (unsigned int s = 0; s < count; s++) {
+		unsigned int path = paths.rays.owners[hits.rays[shadows.rays.owners[s]]];
+		Ray shadowRay = getRay(shadows.rays, s, samples[path]);
+		occluded[s] = hierarchy->intersectAny(shadowRay);
+	}
+}
+
+// The bounce stage: adds the ambient light and the light of every
+// unshadowed light at each hit to its path, and queues the hit's
+// reflection and refraction rays for the next pass.
+void WavefrontTracer::lightHits(vector<rgb>& colors) {
+
+	PathQueue& paths = queues[current];
+	PathQueue& next = queues[1 - current];
+	vector<Light*> lights = tracingScene->getLights();
+	unsigned int s = 0;
+
+	for (unsigned int h = 0; h < hits.rays.size(); h++) {
+		unsigned int k = hits.rays[h];
+		unsigned int path = paths.rays.owners[k];
+		const IntersectRecord& rec = hits.records[h];
+		const Reflectance& refl = hits.reflectances[h];
+		Ray ray = getRay(paths.rays, k, samples[path]);
+
+		rgb pointColor = refl.kA;
+		for (; s < shadows.rays.owners.size() && shadows.rays.owners[s] == h; s++) {
+			if (occluded[s])
+				continue;
+			vec3 lightIncidence = shadows.rays.directions[s];
+			lightIncidence.normalize();
+			rgb lightColor = lights[shadows.lights[s]]->getColor();
+			if (refl.kD != rgb::black)
+				pointColor += shader->diffComp(rec, refl, lightIncidence, lightColor);
+			if (refl.kS != rgb::black)
+				pointColor += shader->specComp(rec, refl, lightIncidence, lightColor, ray);
+		}
+		colors[path] += paths.throughputs[k] * pointColor;
+
+		Bounce found[2];
+		unsigned int count = shader->findBounces(rec, refl, ray, paths.throughputs[k], paths.depths[k], found);
+		if (count == 0)
+			continue;
+		if (shader->termination == rouletteTermination) {
+			shader->seedRoulette(samples[path]);
+			shader->rouletteDraws = rouletteDraws[path];
+		}
+		for (unsigned int i = 0; i < count; i++) {
+			rgb throughput = found[i].throughput;
+			if (!shader->keepBounce(throughput))
+				continue;
+			Ray bounceRay(found[i].origin, shader->rayBias, DBL_MAX, found[i].direction, samples[path], found[i].lastHit);
+			pushRay(next.rays, bounceRay, path);
+			next.throughputs.push_back(throughput);
+			next.depths.push_back(found[i].depth);
+			shader->stats.bouncesTraced++;
+		}
+		if (shader->termination == rouletteTermination)
+			rouletteDraws[path] = shader->rouletteDraws;
+	}
+}
+
+
+/* Static methods */
+
+void WavefrontTracer::pushRay(RayQueue& queue, Ray& ray, unsigned int owner) {
+
+	queue.origins.push_back(ray.getOrigin());
+	queue.directions.push_back(ray.getDirection());
+	queue.tMins.push_back(ray.getLowerBound());
+	queue.tMaxes.push_back(ray.getUpperBound());
+	queue.lastHits.push_back(ray.getLastHitPrim());
+	queue.owners.push_back(owner);
+}
+
+Ray WavefrontTracer::getRay(const RayQueue& queue, unsigned int k, const Sample& samp) {
+
+	return Ray(queue.origins[k], queue.tMins[k], queue.tMaxes[k], queue.directions[k], samp, queue.lastHits[k]);
+}
+
+void WavefrontTracer::clearRays(RayQueue& queue) {
+
+	queue.origins.clear();
+	queue.directions.clear();
+	queue.tMins.clear();
+	queue.tMaxes.clear();
+	queue.lastHits.clear();
+	queue.owners.clear();
+}
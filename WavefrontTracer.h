@@ -0,0 +1,110 @@
+#ifndef WAVEFRONTTRACERH
+#define WAVEFRONTTRACERH
+
+#include "algebra3.h"
+#include "Scene.h"
+#include "Ray.h"
+#include "Primitives.h"
+#include "IntersectRecord.h"
+#include "Material.h"
+#include "RenderSettings.h"
+#include "RayTracer.h"
+#include <vector>
+
+using namespace std;
+
+
+/* Rays waiting for a wavefront stage, stored field by field so that each
+   stage streams through just the arrays it needs. Ray k belongs to
+   owners[k]: a path for camera and bounce rays, a hit for shadow rays. */
+typedef struct ray_queue_struct {
+
+	vector<vec3> origins;
+	vector<vec3> directions;
+	vector<double> tMins;
+	vector<double> tMaxes;
+	vector<Primitive*> lastHits;
+	vector<unsigned int> owners;
+
+} RayQueue;
+
+/* Camera or bounce rays, with each one's weight in its path's color and
+   the number of bounces it has left. */
+typedef struct path_queue_struct {
+
+	RayQueue rays;
+	vector<rgb> throughputs;
+	vector<unsigned int> depths;
+
+} PathQueue;
+
+/* Shadow rays, each towards lights[k] from the hit owners[k]. */
+typedef struct shadow_queue_struct {
+
+	RayQueue rays;
+	vector<unsigned int> lights;
+
+} ShadowQueue;
+
+/* Closest hits of a PathQueue, one per ray that hit something. */
+typedef struct hit_queue_struct {
+
+	vector<unsigned int> rays;				// Index of the ray in the PathQueue
+	vector<IntersectRecord> records;
+	vector<Reflectance> reflectances;		// Material at each hit
+
+} HitQueue;
+
+
+/* WavefrontTracers trace a batch of viewing rays one stage at a time
+   rather than one path at a time: every camera or bounce ray of the batch
+   is intersected, then every hit shaded, then every shadow ray traced,
+   and so on until no bounces are left. Each stage runs over its whole
+   queue, so the same code and data stay hot throughout.
+
+   The per-ray math (cameras, lights, materials, bounce directions and
+   termination) is RayTracer's; a WavefrontTracer shades through the
+   RayTracer it is given, whose stats count its work. Colors match
+   RayTracer's up to the order in which bounces are summed, and roulette
+   draws are taken in stage order rather than path order. */
+class WavefrontTracer {
+
+private:
+
+	/* Instance vars */
+	Scene* tracingScene;
+	RayTracer* shader;						// Supplies the shading math
+	bool usePackets;						// Intersect path rays in packets
+	vector<Sample> samples;					// Sample of each path in the batch
+	vector<uint32> rouletteDraws;			// Roulette numbers each path has drawn
+	PathQueue queues[2];					// Rays of this stage, and bounces for the next
+	unsigned int current;					// Which queue is this stage's
+	vector<Ray> packet;						// Scratch for one packet of rays
+	HitQueue hits;
+	ShadowQueue shadows;
+	vector<unsigned char> occluded;			// Result per shadow ray
+
+	/* Instance methods */
+	void intersectPaths();
+	void shadeHits();
+	void traceShadows();
+	void lightHits(vector<rgb>& colors);
+
+	/* Static methods */
+	static void pushRay(RayQueue& queue, Ray& ray, unsigned int owner);
+	static Ray getRay(const RayQueue& queue, unsigned int k, const Sample& samp);
+	static void clearRays(RayQueue& queue);
+
+public:
+
+	/* Constructors */
+	WavefrontTracer(Scene* scene, RayTracer* tracer, const RenderSettings& settings);
+
+	/* Instance methods */
+	void addViewingRay(Ray& ray);
+	void traceBatch(vector<rgb>& colors);
+
+};
+
+
+#endif
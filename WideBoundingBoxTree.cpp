@@ -0,0 +1,346 @@
+#include "WideBoundingBoxTree.h"
+#include "TriangleGroup.h"
+#include "algebra3f.h"
+#include <cfloat>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+
+// Stack entries kept without the heap; enough for trees 85 levels deep.
+#define WIDE_TRAVERSAL_STACK 256
+
+/* A child waiting to be visited, with the distance at which the ray enters
+   its box. */
+typedef struct wide_stack_entry_struct {
+
+	unsigned int child;
+	unsigned int count;
+	float t;
+
+} WideStackEntry;
+
+
+// Converts the ray to the single-precision form the box tests use.
+static inline void setupRay(Ray& ray, float org[3], float inv[3], int dirIsNeg[3]) {
+
+	vec3 origin = ray.getOrigin();
+	vec3 inverse = ray.getInverseDirection();
+	for (int k = 0; k < 3; k++) {
+		org[k] = (float)origin[k];
+		inv[k] = (float)inverse[k];
+		dirIsNeg[k] = ray.getSign(k);
+	}
+}
+
+// Ray bounds are doubles and may be DBL_MAX, which has no float equivalent.
+static inline float toFloat(double t) {
+
+	return t > FLT_MAX ? FLT_MAX : (float)t;
+}
+
+
+/* Constructors */
+
+// Collapses an existing binary tree. The new tree takes over the old
+// tree's primitives and deletes its nodes; "tree" must not be used
+// afterwards.
+WideBoundingBoxTree::WideBoundingBoxTree(BoundingBoxTree* tree) {
+
+	nodes = NULL;
+	nodeCount = nodeCapacity = 0;
+	box = tree->getBoundingBox();
+
+	collapse(tree);
+	depth = treeDepth();
+	tree->releasePrimitives();
+	delete tree;
+}
+
+WideBoundingBoxTree::~WideBoundingBoxTree() {
+
+	for (unsigned int i = 0; i < primitives.size(); i++)
+		delete primitives[i];
+	free(nodes);
+}
+
+
+/* Instance methods */
+
+bool WideBoundingBoxTree::intersect(Ray& ray, IntersectRecord* rec) {
+
+	double tMin = ray.getLowerBound();
+	double oldMax = ray.getUpperBound();
+
+	float org[3], inv[3];
+	int dirIsNeg[3];
+	setupRay(ray, org, inv, dirIsNeg);
+
+	rec->t = oldMax;
+	bool hit = false;
+	TraversalStack<WideStackEntry, WIDE_TRAVERSAL_STACK> stack(1 + 3 * depth);
+	WideStackEntry root = { 0, 0, (float)tMin };
+	stack.push(root);
+
+	while (!stack.empty()) {
+		WideStackEntry entry = stack.pop();
+		// CASE: Something nearer than this box was hit since it was pushed.
+		if (entry.t > ray.getUpperBound())
+			continue;
+
+		if (entry.count > 0) {
+			for (unsigned int i = entry.child; i < entry.child + entry.count; i++)
+				if (primitives[i]->intersect(ray, rec)) {
+					hit = true;
+					ray.setBounds(tMin, rec->t);
+				}
+			continue;
+		}
+
+		const WideNode& node = nodes[entry.child];
+		float tNear[4];
+		int mask = intersectChildren(node, org, inv, dirIsNeg, (float)tMin, toFloat(ray.getUpperBound()), tNear);
+
+		// Sort the hit children by entry distance, farthest first, and push
+		// them in that order so the nearest is visited next.
+		int order[4];
+		int hits = 0;
+		for (int i = 0; i < 4; i++) {
+			if (!(mask & (1 << i)))
+				continue;
+			int j = hits++;
+			while (j > 0 && tNear[order[j-1]] < tNear[i]) {
+				order[j] = order[j-1];
+				j--;
+			}
+			order[j] = i;
+		}
+		for (int j = 0; j < hits; j++) {
+			WideStackEntry child = { node.child[order[j]], node.count[order[j]], tNear[order[j]] };
+			stack.push(child);
+		}
+	}
+
+	ray.setBounds(tMin, oldMax);		// Reset ray bounds before returning
+	return hit;
+}
+
+// Same traversal as intersect(), but stops at the first occluder. The
+// order children are visited in doesn't matter, so they aren't sorted.
+bool WideBoundingBoxTree::intersectAny(Ray& ray) {
+
+	float org[3], inv[3];
+	int dirIsNeg[3];
+	setupRay(ray, org, inv, dirIsNeg);
+
+	float tMin = (float)ray.getLowerBound();
+	float tMax = toFloat(ray.getUpperBound());
+	TraversalStack<WideStackEntry, WIDE_TRAVERSAL_STACK> stack(1 + 3 * depth);
+	WideStackEntry root = { 0, 0, tMin };
+	stack.push(root);
+
+	while (!stack.empty()) {
+		WideStackEntry entry = stack.pop();
+
+		if (entry.count > 0) {
+			for (unsigned int i = entry.child; i < entry.child + entry.count; i++)
+				if (primitives[i]->intersectAny(ray))
+					return true;
+			continue;
+		}
+
+		const WideNode& node = nodes[entry.child];
+		float tNear[4];
+		int mask = intersectChildren(node, org, inv, dirIsNeg, tMin, tMax, tNear);
+		for (int i = 0; i < 4; i++)
+			if (mask & (1 << i)) {
+				WideStackEntry child = { node.child[i], node.count[i], tNear[i] };
+				stack.push(child);
+			}
+	}
+	return false;
+}
+
+Reflectance WideBoundingBoxTree::getReflectance(const vec3& point) {
+
+	// This should never be called.
+	throw "WideBoundingBoxTree does not implement this method.";
+}
+
+BoundingBox WideBoundingBoxTree::getBoundingBox() {
+
+	return box;
+}
+
+void WideBoundingBoxTree::addMemoryUsage(MemoryUsage& usage) {
+
+	usage.acceleration += sizeof(WideBoundingBoxTree) + nodeCapacity * sizeof(WideNode) +
+		primitives.capacity() * sizeof(Primitive*);
+	for (unsigned int i = 0; i < primitives.size(); i++)
+		primitives[i]->addMemoryUsage(usage);
+}
+
+Primitive* WideBoundingBoxTree::instance(const mat4& transform, Material* mat) {
+
+	vector<Primitive*> copies;
+	for (unsigned int i = 0; i < primitives.size(); i++)
+		copies.push_back(primitives[i]->instance(transform, mat));
+	return new WideBoundingBoxTree(new BoundingBoxTree(copies, VZ, sahSplit));
+}
+
+unsigned int WideBoundingBoxTree::getNodeCount() {
+
+	return nodeCount;
+}
+
+// Slab tests the ray against all four child boxes of "node". Returns a
+// bitmask of the children hit within [tMin, tMax], and the distance at
+// which the ray enters each box in tNear. The far distances are padded a
+// few ulps so rounding can't make us miss a box the ray grazes.
+int WideBoundingBoxTree::intersectChildren(const WideNode& node, const float org[3], const float inv[3],
+										   const int dirIsNeg[3], float tMin, float tMax, float tNear[4]) {
+
+	float4 t0(tMin);
+	float4 t1(tMax);
+	float4 pad(1.0000004f);
+	for (int k = 0; k < 3; k++) {
+		float4 o(org[k]);
+		float4 iv(inv[k]);
+		float4 nearPlane = float4::load(node.bounds[dirIsNeg[k] ? k + 3 : k]);
+		float4 farPlane = float4::load(node.bounds[dirIsNeg[k] ? k : k + 3]);
+		// The computed value goes first: if it's NaN (the ray lies in the
+		// plane), vmax/vmin return the running bound instead.
+		t0 = vmax((nearPlane - o) * iv, t0);
+		t1 = vmin((farPlane - o) * iv * pad, t1);
+	}
+	t0.store(tNear);
+	return movemask(t0 <= t1);
+}
+
+// Emits the node for "tree" and everything below it, returning its index.
+// A node's children are found by repeatedly opening the subtree with the
+// largest surface area, until there are four or only primitives are left.
+unsigned int WideBoundingBoxTree::collapse(BoundingBoxTree* tree) {
+
+	vector<Primitive*> slots;
+	if (tree->low != NULL)
+		slots.push_back(tree->low);
+	if (tree->high != NULL)
+		slots.push_back(tree->high);
+
+	while (slots.size() < 4) {
+		int largest = -1;
+		double largestArea = -1;
+		for (unsigned int i = 0; i < slots.size(); i++) {
+			BoundingBoxTree* subtree = dynamic_cast<BoundingBoxTree*>(slots[i]);
+			if (subtree != NULL && subtree->box.surfaceArea() > largestArea) {
+				largest = i;
+				largestArea = subtree->box.surfaceArea();
+			}
+		}
+		if (largest < 0)
+			break;
+		BoundingBoxTree* opened = (BoundingBoxTree*)slots[largest];
+		slots.erase(slots.begin() + largest);
+		if (opened->low != NULL)
+			slots.push_back(opened->low);
+		if (opened->high != NULL)
+			slots.push_back(opened->high);
+	}
+
+	unsigned int index = allocateNode();
+	for (unsigned int i = 0; i < slots.size(); i++) {
+		BoundingBoxTree* subtree = dynamic_cast<BoundingBoxTree*>(slots[i]);
+		// CASE: A lone primitive
+		if (subtree == NULL) {
+			setChildBounds(index, i, slots[i]->getBoundingBox());
+			nodes[index].child[i] = primitives.size();
+			nodes[index].count[i] = 1;
+			primitives.push_back(slots[i]);
+			continue;
+		}
+		setChildBounds(index, i, subtree->box);
+		// CASE: A few mesh triangles become a leaf holding one TriangleGroup.
+		vector<Primitive*> triangles;
+		if (TriangleGroup::gather(subtree, triangles) && triangles.size() > 1) {
+			nodes[index].child[i] = primitives.size();
+			nodes[index].count[i] = 1;
+			primitives.push_back(new TriangleGroup(triangles));
+		}
+		// CASE: A subtree holding only primitives becomes a leaf.
+		else if (dynamic_cast<BoundingBoxTree*>(subtree->low) == NULL &&
+			dynamic_cast<BoundingBoxTree*>(subtree->high) == NULL) {
+			nodes[index].child[i] = primitives.size();
+			if (subtree->low != NULL)
+				primitives.push_back(subtree->low);
+			if (subtree->high != NULL)
+				primitives.push_back(subtree->high);
+			nodes[index].count[i] = primitives.size() - nodes[index].child[i];
+		} else {
+			unsigned int child = collapse(subtree);
+			nodes[index].child[i] = child;
+			nodes[index].count[i] = 0;
+		}
+	}
+	return index;
+}
+
+// Number of nodes on the longest path from the root. Visiting a node pops
+// one stack entry and pushes at most four, so a traversal never holds more
+// than 1 + 3 * depth entries. Collapse allocates children after their
+// parent, so one pass in order finds every node's level.
+unsigned int WideBoundingBoxTree::treeDepth() {
+
+	vector<unsigned int> level(nodeCount, 1);
+	unsigned int deepest = 0;
+	for (unsigned int i = 0; i < nodeCount; i++) {
+		deepest = MAX(deepest, level[i]);
+		for (int j = 0; j < 4; j++)
+			// Unused slots also have count 0, but child 0 is the root.
+			if (nodes[i].count[j] == 0 && nodes[i].child[j] != 0)
+				level[nodes[i].child[j]] = level[i] + 1;
+	}
+	return deepest;
+}
+
+// Appends a node whose four slots are all empty.
+unsigned int WideBoundingBoxTree::allocateNode() {
+
+	if (nodeCount == nodeCapacity) {
+		unsigned int capacity = MAX(64, 2 * nodeCapacity);
+		void* memory;
+		if (posix_memalign(&memory, 64, capacity * sizeof(WideNode)) != 0)
+			throw "WideBoundingBoxTree could not allocate nodes.";
+		if (nodes != NULL) {
+			memcpy(memory, nodes, nodeCount * sizeof(WideNode));
+			free(nodes);
+		}
+		nodes = (WideNode*)memory;
+		nodeCapacity = capacity;
+	}
+
+	WideNode& node = nodes[nodeCount];
+	for (int i = 0; i < 4; i++) {
+		for (int k = 0; k < 3; k++) {
+			node.bounds[k][i] = FLT_MAX;
+			node.bounds[k+3][i] = -FLT_MAX;
+		}
+		node.child[i] = 0;
+		node.count[i] = 0;
+	}
+	return nodeCount++;
+}
+
+// Stores a child's bounds, rounded outwards to floats.
+void WideBoundingBoxTree::setChildBounds(unsigned int node, int slot, BoundingBox bounds) {
+
+	for (int k = 0; k < 3; k++) {
+		float lo = (float)bounds.minCoordinate(k);
+		float hi = (float)bounds.maxCoordinate(k);
+		if (lo > bounds.minCoordinate(k))
+			lo = nextafterf(lo, -FLT_MAX);
+		if (hi < bounds.maxCoordinate(k))
+			hi = nextafterf(hi, FLT_MAX);
+		nodes[node].bounds[k][slot] = lo;
+		nodes[node].bounds[k+3][slot] = hi;
+	}
+}
@@ -0,0 +1,70 @@
+#ifndef WIDEBOUNDINGBOXTREEH
+#define WIDEBOUNDINGBOXTREEH
+
+#include "Primitives.h"
+#include "Ray.h"
+#include "IntersectRecord.h"
+#include "TraversalStack.h"
+#include <vector>
+
+using namespace std;
+
+
+/* One node of a WideBoundingBoxTree: the bounds of up to four children,
+   stored as six rows of four floats (min x, y, z, then max x, y, z) so a
+   single SSE instruction handles one plane of all four boxes. A child with
+   count 0 is an interior node whose index is in "child"; otherwise it is a
+   leaf holding primitives[child, child + count). Unused slots have empty
+   (inverted) bounds, which no ray can hit. 128 bytes, i.e. two cache lines. */
+typedef struct wide_node_struct {
+
+	float bounds[6][4];
+	unsigned int child[4];
+	unsigned int count[4];
+
+} WideNode;
+
+
+/* A 4-wide bounding volume hierarchy, collapsed from a binary
+   BoundingBoxTree. Every node tests its four child boxes against the ray
+   at once and visits the ones that are hit nearest first. */
+class WideBoundingBoxTree : public Primitive {
+
+public:
+
+	/* Constructor */
+	WideBoundingBoxTree(BoundingBoxTree* tree);
+
+	~WideBoundingBoxTree();
+
+	/* Instance methods */
+	bool intersect(Ray& ray, IntersectRecord* rec);
+	bool intersectAny(Ray& ray);
+	Reflectance getReflectance(const vec3& point);
+	BoundingBox getBoundingBox();
+	void addMemoryUsage(MemoryUsage& usage);
+	Primitive* instance(const mat4& transform, Material* mat);
+	unsigned int getNodeCount();
+
+private:
+
+	/* Instance methods */
+	unsigned int collapse(BoundingBoxTree* tree);
+	unsigned int treeDepth();
+	unsigned int allocateNode();
+	void setChildBounds(unsigned int node, int slot, BoundingBox bounds);
+	int intersectChildren(const WideNode& node, const float org[3], const float inv[3],
+						  const int dirIsNeg[3], float tMin, float tMax, float tNear[4]);
+
+	/* Instance vars */
+	WideNode* nodes;				// 64-byte aligned node array
+	unsigned int nodeCount;
+	unsigned int nodeCapacity;
+	vector<Primitive*> primitives;	// Leaf primitives, grouped by leaf
+	BoundingBox box;				// Exact (double) bounds of the whole tree
+	unsigned int depth;				// Most nodes on any path from the root
+
+};
+
+
+#endif
@@ -29,6 +29,15 @@
 // double and takes as argument a double
 typedef double (*V_FCT_PTR)(double);
 
+// The scalar type of every vector and matrix. Double by default; defining
+// ALGEBRA3FLOAT builds them in single precision instead, for renderers that
+// trade large-world accuracy for speed.
+#ifdef ALGEBRA3FLOAT
+typedef float scalar;
+#else
+typedef double scalar;
+#endif
+
 // min-max macros
 #define MIN(A,B) ((A) < (B) ? (A) : (B))
 #define MAX(A,B) ((A) > (B) ? (A) : (B))
@@ -71,15 +80,15 @@ class vec2
 {
 protected:
 
- double n[2];
+ scalar n[2];
 
 public:
 
 // Constructors
 
 vec2();
-vec2(const double x, const double y);
-vec2(const double d);
+vec2(const scalar x, const scalar y);
+vec2(const scalar d);
 vec2(const vec2& v);				// copy constructor
 vec2(const vec3& v);				// cast v3 to v2
 vec2(const vec3& v, int dropAxis);	// cast v3 to v2
@@ -89,15 +98,15 @@ vec2(const vec3& v, int dropAxis);	// cast v3 to v2
 vec2& operator	= ( const vec2& v );	// assignment of a vec2
 vec2& operator += ( const vec2& v );	// incrementation by a vec2
 vec2& operator -= ( const vec2& v );	// decrementation by a vec2
-vec2& operator *= ( const double d );	// multiplication by a constant
-vec2& operator /= ( const double d );	// division by a constant
-double& operator [] ( int i);			// indexing
-double vec2::operator [] ( int i) const;// read-only indexing
+vec2& operator *= ( const scalar d );	// multiplication by a constant
+vec2& operator /= ( const scalar d );	// division by a constant
+scalar& operator [] ( int i);			// indexing
+scalar vec2::operator [] ( int i) const;// read-only indexing
 
 // special functions
 
-double length() const;			// length of a vec2
-double length2() const;			// squared length of a vec2
+scalar length() const;			// length of a vec2
+scalar length2() const;			// squared length of a vec2
 vec2& normalize() ;				// normalize a vec2 in place
 vec2& apply(V_FCT_PTR fct);		// apply a func. to each component
 
@@ -106,12 +115,12 @@ vec2& apply(V_FCT_PTR fct);		// apply a func. to each component
 friend vec2 operator - (const vec2& v);						// -v1
 friend vec2 operator + (const vec2& a, const vec2& b);	    // v1 + v2
 friend vec2 operator - (const vec2& a, const vec2& b);	    // v1 - v2
-friend vec2 operator * (const vec2& a, const double d);	    // v1 * 3.0
-friend vec2 operator * (const double d, const vec2& a);	    // 3.0 * v1
+friend vec2 operator * (const vec2& a, const scalar d);	    // v1 * 3.0
+friend vec2 operator * (const scalar d, const vec2& a);	    // 3.0 * v1
 friend vec2 operator * (const mat3& a, const vec2& v);	    // M . v
 friend vec2 operator * (const vec2& v, const mat3& a);		// v . M
-friend double operator * (const vec2& a, const vec2& b);    // dot product
-friend vec2 operator / (const vec2& a, const double d);	    // v1 / 3.0
+friend scalar operator * (const vec2& a, const vec2& b);    // dot product
+friend vec2 operator / (const vec2& a, const scalar d);	    // v1 / 3.0
 friend vec3 operator ^ (const vec2& a, const vec2& b);	    // cross product
 friend int operator == (const vec2& a, const vec2& b);	    // v1 == v2 ?
 friend int operator != (const vec2& a, const vec2& b);	    // v1 != v2 ?
@@ -141,18 +150,18 @@ class vec3
 {
 protected:
 
- double n[3];
+ scalar n[3];
 
 public:
 
 // Constructors
 
 vec3();
-vec3(const double x, const double y, const double z);
-vec3(const double d);
+vec3(const scalar x, const scalar y, const scalar z);
+vec3(const scalar d);
 vec3(const vec3& v);					// copy constructor
 vec3(const vec2& v);					// cast v2 to v3
-vec3(const vec2& v, double d);		    // cast v2 to v3
+vec3(const vec2& v, scalar d);		    // cast v2 to v3
 vec3(const vec4& v);					// cast v4 to v3
 vec3(const vec4& v, int dropAxis);	    // cast v4 to v3
 
@@ -161,15 +170,15 @@ vec3(const vec4& v, int dropAxis);	    // cast v4 to v3
 vec3& operator	= ( const vec3& v );	    // assignment of a vec3
 vec3& operator += ( const vec3& v );	    // incrementation by a vec3
 vec3& operator -= ( const vec3& v );	    // decrementation by a vec3
-vec3& operator *= ( const double d );	    // multiplication by a constant
-vec3& operator /= ( const double d );	    // division by a constant
-double& operator [] ( int i);				// indexing
-double operator[] (int i) const;			// read-only indexing
+vec3& operator *= ( const scalar d );	    // multiplication by a constant
+vec3& operator /= ( const scalar d );	    // division by a constant
+scalar& operator [] ( int i);				// indexing
+scalar operator[] (int i) const;			// read-only indexing
 
 // special functions
 
-double length() const;				// length of a vec3
-double length2() const;				// squared length of a vec3
+scalar length() const;				// length of a vec3
+scalar length2() const;				// squared length of a vec3
 vec3& normalize();					// normalize a vec3 in place
 vec3& apply(V_FCT_PTR fct);		    // apply a func. to each component
 
@@ -178,12 +187,12 @@ vec3& apply(V_FCT_PTR fct);		    // apply a func. to each component
 friend vec3 operator - (const vec3& v);						// -v1
 friend vec3 operator + (const vec3& a, const vec3& b);	    // v1 + v2
 friend vec3 operator - (const vec3& a, const vec3& b);	    // v1 - v2
-friend vec3 operator * (const vec3& a, const double d);	    // v1 * 3.0
-friend vec3 operator * (const double d, const vec3& a);	    // 3.0 * v1
+friend vec3 operator * (const vec3& a, const scalar d);	    // v1 * 3.0
+friend vec3 operator * (const scalar d, const vec3& a);	    // 3.0 * v1
 friend vec3 operator * (const mat4& a, const vec3& v);	    // M . v
 friend vec3 operator * (const vec3& v, const mat4& a);		// v . M
-friend double operator * (const vec3& a, const vec3& b);    // dot product
-friend vec3 operator / (const vec3& a, const double d);	    // v1 / 3.0
+friend scalar operator * (const vec3& a, const vec3& b);    // dot product
+friend vec3 operator / (const vec3& a, const scalar d);	    // v1 / 3.0
 friend vec3 operator ^ (const vec3& a, const vec3& b);	    // cross product
 friend int operator == (const vec3& a, const vec3& b);	    // v1 == v2 ?
 friend int operator != (const vec3& a, const vec3& b);	    // v1 != v2 ?
@@ -218,33 +227,33 @@ class vec4
 {
 protected:
 
- double n[4];
+ scalar n[4];
 
 public:
 
 // Constructors
 
 vec4();
-vec4(const double x, const double y, const double z, const double w);
-vec4(const double d);
+vec4(const scalar x, const scalar y, const scalar z, const scalar w);
+vec4(const scalar d);
 vec4(const vec4& v);			    // copy constructor
 vec4(const vec3& v);			    // cast vec3 to vec4
-vec4(const vec3& v, const double d);	    // cast vec3 to vec4
+vec4(const vec3& v, const scalar d);	    // cast vec3 to vec4
 
 // Assignment operators
 
 vec4& operator	= ( const vec4& v );	    // assignment of a vec4
 vec4& operator += ( const vec4& v );	    // incrementation by a vec4
 vec4& operator -= ( const vec4& v );	    // decrementation by a vec4
-vec4& operator *= ( const double d );	    // multiplication by a constant
-vec4& operator /= ( const double d );	    // division by a constant
-double& operator [] ( int i);				// indexing
-double operator[] (int i) const;			// read-only indexing
+vec4& operator *= ( const scalar d );	    // multiplication by a constant
+vec4& operator /= ( const scalar d );	    // division by a constant
+scalar& operator [] ( int i);				// indexing
+scalar operator[] (int i) const;			// read-only indexing
 
 // special functions
 
-double length() const;			// length of a vec4
-double length2() const;			// squared length of a vec4
+scalar length() const;			// length of a vec4
+scalar length2() const;			// squared length of a vec4
 vec4& normalize();			    // normalize a vec4 in place
 vec4& apply(V_FCT_PTR fct);		// apply a func. to each component
 
@@ -253,12 +262,12 @@ vec4& apply(V_FCT_PTR fct);		// apply a func. to each component
 friend vec4 operator - (const vec4& v);						// -v1
 friend vec4 operator + (const vec4& a, const vec4& b);	    // v1 + v2
 friend vec4 operator - (const vec4& a, const vec4& b);	    // v1 - v2
-friend vec4 operator * (const vec4& a, const double d);	    // v1 * 3.0
-friend vec4 operator * (const double d, const vec4& a);	    // 3.0 * v1
+friend vec4 operator * (const vec4& a, const scalar d);	    // v1 * 3.0
+friend vec4 operator * (const scalar d, const vec4& a);	    // 3.0 * v1
 friend vec4 operator * (const mat4& a, const vec4& v);	    // M . v
 friend vec4 operator * (const vec4& v, const mat4& a);	    // v . M
-friend double operator * (const vec4& a, const vec4& b);    // dot product
-friend vec4 operator / (const vec4& a, const double d);	    // v1 / 3.0
+friend scalar operator * (const vec4& a, const vec4& b);    // dot product
+friend vec4 operator / (const vec4& a, const scalar d);	    // v1 / 3.0
 friend int operator == (const vec4& a, const vec4& b);	    // v1 == v2 ?
 friend int operator != (const vec4& a, const vec4& b);	    // v1 != v2 ?
 
@@ -298,7 +307,7 @@ public:
 
 mat3();
 mat3(const vec3& v0, const vec3& v1, const vec3& v2);
-mat3(const double d);
+mat3(const scalar d);
 mat3(const mat3& m);
 
 // Assignment operators
@@ -306,8 +315,8 @@ mat3(const mat3& m);
 mat3& operator	= ( const mat3& m );	    // assignment of a mat3
 mat3& operator += ( const mat3& m );	    // incrementation by a mat3
 mat3& operator -= ( const mat3& m );	    // decrementation by a mat3
-mat3& operator *= ( const double d );	    // multiplication by a constant
-mat3& operator /= ( const double d );	    // division by a constant
+mat3& operator *= ( const scalar d );	    // multiplication by a constant
+mat3& operator /= ( const scalar d );	    // division by a constant
 vec3& operator [] ( int i);					// indexing
 const vec3& operator [] ( int i) const;		// read-only indexing
 
@@ -316,8 +325,8 @@ const vec3& operator [] ( int i) const;		// read-only indexing
 mat3 transpose() const;			    // transpose
 mat3 inverse() const;				// inverse
 mat3& apply(V_FCT_PTR fct);		    // apply a func. to each element
-double determinant();               // for matrix [row][col]
-double determinantCol();            // for matrix [col][row]
+scalar determinant();               // for matrix [row][col]
+scalar determinantCol();            // for matrix [col][row]
 
 // friends
 
@@ -325,9 +334,9 @@ friend mat3 operator - (const mat3& a);						// -m1
 friend mat3 operator + (const mat3& a, const mat3& b);	    // m1 + m2
 friend mat3 operator - (const mat3& a, const mat3& b);	    // m1 - m2
 friend mat3 operator * (const mat3& a, const mat3& b);		// m1 * m2
-friend mat3 operator * (const mat3& a, const double d);	    // m1 * 3.0
-friend mat3 operator * (const double d, const mat3& a);	    // 3.0 * m1
-friend mat3 operator / (const mat3& a, const double d);	    // m1 / 3.0
+friend mat3 operator * (const mat3& a, const scalar d);	    // m1 * 3.0
+friend mat3 operator * (const scalar d, const mat3& a);	    // 3.0 * m1
+friend mat3 operator / (const mat3& a, const scalar d);	    // m1 / 3.0
 friend int operator == (const mat3& a, const mat3& b);	    // m1 == m2 ?
 friend int operator != (const mat3& a, const mat3& b);	    // m1 != m2 ?
 
@@ -362,7 +371,7 @@ public:
 
 mat4();
 mat4(const vec4& v0, const vec4& v1, const vec4& v2, const vec4& v3);
-mat4(const double d);
+mat4(const scalar d);
 mat4(const mat4& m);
 
 // Assignment operators
@@ -370,8 +379,8 @@ mat4(const mat4& m);
 mat4& operator	= ( const mat4& m );	    // assignment of a mat4
 mat4& operator += ( const mat4& m );	    // incrementation by a mat4
 mat4& operator -= ( const mat4& m );	    // decrementation by a mat4
-mat4& operator *= ( const double d );	    // multiplication by a constant
-mat4& operator /= ( const double d );	    // division by a constant
+mat4& operator *= ( const scalar d );	    // multiplication by a constant
+mat4& operator /= ( const scalar d );	    // division by a constant
 vec4& operator [] ( int i);					// indexing
 const vec4& operator [] ( int i) const;		// read-only indexing
 
@@ -387,9 +396,9 @@ friend mat4 operator - (const mat4& a);						// -m1
 friend mat4 operator + (const mat4& a, const mat4& b);	    // m1 + m2
 friend mat4 operator - (const mat4& a, const mat4& b);	    // m1 - m2
 friend mat4 operator * (const mat4& a, const mat4& b);		// m1 * m2
-friend mat4 operator * (const mat4& a, const double d);	    // m1 * 4.0
-friend mat4 operator * (const double d, const mat4& a);	    // 4.0 * m1
-friend mat4 operator / (const mat4& a, const double d);	    // m1 / 3.0
+friend mat4 operator * (const mat4& a, const scalar d);	    // m1 * 4.0
+friend mat4 operator * (const scalar d, const mat4& a);	    // 4.0 * m1
+friend mat4 operator / (const mat4& a, const scalar d);	    // m1 / 3.0
 friend int operator == (const mat4& a, const mat4& b);	    // m1 == m2 ?
 friend int operator != (const mat4& a, const mat4& b);	    // m1 != m2 ?
 
@@ -414,13 +423,13 @@ friend vec3 operator * (const mat4& a, const vec3& v);	    // linear transform
 
 mat3 identity2D();								// identity 2D
 mat3 translation2D(const vec2& v);				// translation 2D
-mat3 rotation2D(const vec2& Center, const double angleDeg);	// rotation 2D
+mat3 rotation2D(const vec2& Center, const scalar angleDeg);	// rotation 2D
 mat3 scaling2D(const vec2& scaleVector);		// scaling 2D
 mat4 identity3D();								// identity 3D
 mat4 translation3D(const vec3& v);				// translation 3D
-mat4 rotation3D(vec3 Axis, const double angleDeg);// rotation 3D
+mat4 rotation3D(vec3 Axis, const scalar angleDeg);// rotation 3D
 mat4 scaling3D(const vec3& scaleVector);		// scaling 3D
-mat4 perspective3D(const double d);			    // perspective 3D
+mat4 perspective3D(const scalar d);			    // perspective 3D
 
 //
 //	Implementation
@@ -436,10 +445,10 @@ mat4 perspective3D(const double d);			    // perspective 3D
 
 inline vec2::vec2() {}
 
-inline vec2::vec2(const double x, const double y)
+inline vec2::vec2(const scalar x, const scalar y)
 { n[VX] = x; n[VY] = y; }
 
-inline vec2::vec2(const double d)
+inline vec2::vec2(const scalar d)
 { n[VX] = n[VY] = d; }
 
 inline vec2::vec2(const vec2& v)
@@ -468,18 +477,18 @@ inline vec2& vec2::operator += ( const vec2& v )
 inline vec2& vec2::operator -= ( const vec2& v )
 { n[VX] -= v.n[VX]; n[VY] -= v.n[VY]; return *this; }
 
-inline vec2& vec2::operator *= ( const double d )
+inline vec2& vec2::operator *= ( const scalar d )
 { n[VX] *= d; n[VY] *= d; return *this; }
 
-inline vec2& vec2::operator /= ( const double d )
-{ double d_inv = 1./d; n[VX] *= d_inv; n[VY] *= d_inv; return *this; }
+inline vec2& vec2::operator /= ( const scalar d )
+{ scalar d_inv = 1./d; n[VX] *= d_inv; n[VY] *= d_inv; return *this; }
 
-inline double& vec2::operator [] ( int i) {
+inline scalar& vec2::operator [] ( int i) {
     assert(!(i < VX || i > VY));		// subscript check
     return n[i];
 }
 
-inline double vec2::operator [] ( int i) const {
+inline scalar vec2::operator [] ( int i) const {
     assert(!(i < VX || i > VY));
     return n[i];
 }
@@ -487,10 +496,10 @@ inline double vec2::operator [] ( int i) const {
 
 // SPECIAL FUNCTIONS
 
-inline double vec2::length() const
+inline scalar vec2::length() const
 { return sqrt(length2()); }
 
-inline double vec2::length2() const
+inline scalar vec2::length2() const
 { return n[VX]*n[VX] + n[VY]*n[VY]; }
 
 inline vec2& vec2::normalize() // it is up to caller to avoid divide-by-zero
@@ -511,10 +520,10 @@ inline vec2 operator + (const vec2& a, const vec2& b)
 inline vec2 operator - (const vec2& a, const vec2& b)
 { return vec2(a.n[VX]-b.n[VX], a.n[VY]-b.n[VY]); }
 
-inline vec2 operator * (const vec2& a, const double d)
+inline vec2 operator * (const vec2& a, const scalar d)
 { return vec2(d*a.n[VX], d*a.n[VY]); }
 
-inline vec2 operator * (const double d, const vec2& a)
+inline vec2 operator * (const scalar d, const vec2& a)
 { return a*d; }
 
 inline vec2 operator * (const mat3& a, const vec2& v) {
@@ -529,11 +538,11 @@ inline vec2 operator * (const mat3& a, const vec2& v) {
 inline vec2 operator * (const vec2& v, const mat3& a)
 { return a.transpose() * v; }
 
-inline double operator * (const vec2& a, const vec2& b)
+inline scalar operator * (const vec2& a, const vec2& b)
 { return (a.n[VX]*b.n[VX] + a.n[VY]*b.n[VY]); }
 
-inline vec2 operator / (const vec2& a, const double d)
-{ double d_inv = 1./d; return vec2(a.n[VX]*d_inv, a.n[VY]*d_inv); }
+inline vec2 operator / (const vec2& a, const scalar d)
+{ scalar d_inv = 1./d; return vec2(a.n[VX]*d_inv, a.n[VY]*d_inv); }
 
 inline vec3 operator ^ (const vec2& a, const vec2& b)
 { return vec3(0.0, 0.0, a.n[VX] * b.n[VY] - b.n[VX] * a.n[VY]); }
@@ -592,10 +601,10 @@ inline vec2 prod(const vec2& a, const vec2& b)
 
 inline vec3::vec3() {}
 
-inline vec3::vec3(const double x, const double y, const double z)
+inline vec3::vec3(const scalar x, const scalar y, const scalar z)
 { n[VX] = x; n[VY] = y; n[VZ] = z; }
 
-inline vec3::vec3(const double d)
+inline vec3::vec3(const scalar d)
 { n[VX] = n[VY] = n[VZ] = d; }
 
 inline vec3::vec3(const vec3& v)
@@ -604,7 +613,7 @@ inline vec3::vec3(const vec3& v)
 inline vec3::vec3(const vec2& v)
 { n[VX] = v.n[VX]; n[VY] = v.n[VY]; n[VZ] = 1.0; }
 
-inline vec3::vec3(const vec2& v, double d)
+inline vec3::vec3(const vec2& v, scalar d)
 { n[VX] = v.n[VX]; n[VY] = v.n[VY]; n[VZ] = d; }
 
 inline vec3::vec3(const vec4& v) // it is up to caller to avoid divide-by-zero
@@ -632,19 +641,19 @@ inline vec3& vec3::operator += ( const vec3& v )
 inline vec3& vec3::operator -= ( const vec3& v )
 { n[VX] -= v.n[VX]; n[VY] -= v.n[VY]; n[VZ] -= v.n[VZ]; return *this; }
 
-inline vec3& vec3::operator *= ( const double d )
+inline vec3& vec3::operator *= ( const scalar d )
 { n[VX] *= d; n[VY] *= d; n[VZ] *= d; return *this; }
 
-inline vec3& vec3::operator /= ( const double d )
-{ double d_inv = 1./d; n[VX] *= d_inv; n[VY] *= d_inv; n[VZ] *= d_inv;
+inline vec3& vec3::operator /= ( const scalar d )
+{ scalar d_inv = 1./d; n[VX] *= d_inv; n[VY] *= d_inv; n[VZ] *= d_inv;
   return *this; }
 
-inline double& vec3::operator [] ( int i) {
+inline scalar& vec3::operator [] ( int i) {
     assert(! (i < VX || i > VZ));
     return n[i];
 }
 
-inline double vec3::operator [] ( int i) const {
+inline scalar vec3::operator [] ( int i) const {
     assert(! (i < VX || i > VZ));
     return n[i];
 }
@@ -652,10 +661,10 @@ inline double vec3::operator [] ( int i) const {
 
 // SPECIAL FUNCTIONS
 
-inline double vec3::length() const
+inline scalar vec3::length() const
 {  return sqrt(length2()); }
 
-inline double vec3::length2() const
+inline scalar vec3::length2() const
 {  return n[VX]*n[VX] + n[VY]*n[VY] + n[VZ]*n[VZ]; }
 
 inline vec3& vec3::normalize() // it is up to caller to avoid divide-by-zero
@@ -677,10 +686,10 @@ inline vec3 operator + (const vec3& a, const vec3& b)
 inline vec3 operator - (const vec3& a, const vec3& b)
 { return vec3(a.n[VX]-b.n[VX], a.n[VY]-b.n[VY], a.n[VZ]-b.n[VZ]); }
 
-inline vec3 operator * (const vec3& a, const double d)
+inline vec3 operator * (const vec3& a, const scalar d)
 { return vec3(d*a.n[VX], d*a.n[VY], d*a.n[VZ]); }
 
-inline vec3 operator * (const double d, const vec3& a)
+inline vec3 operator * (const scalar d, const vec3& a)
 { return a*d; }
 
 inline vec3 operator * (const mat3& a, const vec3& v) {
@@ -696,11 +705,11 @@ inline vec3 operator * (const mat4& a, const vec3& v)
 inline vec3 operator * (const vec3& v, const mat4& a)
 { return a.transpose() * v; }
 
-inline double operator * (const vec3& a, const vec3& b)
+inline scalar operator * (const vec3& a, const vec3& b)
 { return (a.n[VX]*b.n[VX] + a.n[VY]*b.n[VY] + a.n[VZ]*b.n[VZ]); }
 
-inline vec3 operator / (const vec3& a, const double d)
-{ double d_inv = 1./d; return vec3(a.n[VX]*d_inv, a.n[VY]*d_inv,
+inline vec3 operator / (const vec3& a, const scalar d)
+{ scalar d_inv = 1./d; return vec3(a.n[VX]*d_inv, a.n[VY]*d_inv,
   a.n[VZ]*d_inv); }
 
 inline vec3 operator ^ (const vec3& a, const vec3& b) {
@@ -768,10 +777,10 @@ inline vec3 prod(const vec3& a, const vec3& b)
 
 inline vec4::vec4() {}
 
-inline vec4::vec4(const double x, const double y, const double z, const double w)
+inline vec4::vec4(const scalar x, const scalar y, const scalar z, const scalar w)
 { n[VX] = x; n[VY] = y; n[VZ] = z; n[VW] = w; }
 
-inline vec4::vec4(const double d)
+inline vec4::vec4(const scalar d)
 {  n[VX] = n[VY] = n[VZ] = n[VW] = d; }
 
 inline vec4::vec4(const vec4& v)
@@ -780,7 +789,7 @@ inline vec4::vec4(const vec4& v)
 inline vec4::vec4(const vec3& v)
 { n[VX] = v.n[VX]; n[VY] = v.n[VY]; n[VZ] = v.n[VZ]; n[VW] = 1.0; }
 
-inline vec4::vec4(const vec3& v, const double d)
+inline vec4::vec4(const vec3& v, const scalar d)
 { n[VX] = v.n[VX]; n[VY] = v.n[VY]; n[VZ] = v.n[VZ];  n[VW] = d; }
 
 
@@ -798,29 +807,29 @@ inline vec4& vec4::operator -= ( const vec4& v )
 { n[VX] -= v.n[VX]; n[VY] -= v.n[VY]; n[VZ] -= v.n[VZ]; n[VW] -= v.n[VW];
 return *this; }
 
-inline vec4& vec4::operator *= ( const double d )
+inline vec4& vec4::operator *= ( const scalar d )
 { n[VX] *= d; n[VY] *= d; n[VZ] *= d; n[VW] *= d; return *this; }
 
-inline vec4& vec4::operator /= ( const double d )
-{ double d_inv = 1./d; n[VX] *= d_inv; n[VY] *= d_inv; n[VZ] *= d_inv;
+inline vec4& vec4::operator /= ( const scalar d )
+{ scalar d_inv = 1./d; n[VX] *= d_inv; n[VY] *= d_inv; n[VZ] *= d_inv;
   n[VW] *= d_inv; return *this; }
 
-inline double& vec4::operator [] ( int i) {
+inline scalar& vec4::operator [] ( int i) {
     assert(! (i < VX || i > VW));
     return n[i];
 }
 
-inline double vec4::operator [] ( int i) const {
+inline scalar vec4::operator [] ( int i) const {
     assert(! (i < VX || i > VW));
     return n[i];
 }
 
 // SPECIAL FUNCTIONS
 
-inline double vec4::length() const
+inline scalar vec4::length() const
 { return sqrt(length2()); }
 
-inline double vec4::length2() const
+inline scalar vec4::length2() const
 { return n[VX]*n[VX] + n[VY]*n[VY] + n[VZ]*n[VZ] + n[VW]*n[VW]; }
 
 inline vec4& vec4::normalize() // it is up to caller to avoid divide-by-zero
@@ -844,10 +853,10 @@ inline vec4 operator - (const vec4& a, const vec4& b)
 {  return vec4(a.n[VX] - b.n[VX], a.n[VY] - b.n[VY], a.n[VZ] - b.n[VZ],
    a.n[VW] - b.n[VW]); }
 
-inline vec4 operator * (const vec4& a, const double d)
+inline vec4 operator * (const vec4& a, const scalar d)
 { return vec4(d*a.n[VX], d*a.n[VY], d*a.n[VZ], d*a.n[VW] ); }
 
-inline vec4 operator * (const double d, const vec4& a)
+inline vec4 operator * (const scalar d, const vec4& a)
 { return a*d; }
 
 inline vec4 operator * (const mat4& a, const vec4& v) {
@@ -860,12 +869,12 @@ inline vec4 operator * (const mat4& a, const vec4& v) {
 inline vec4 operator * (const vec4& v, const mat4& a)
 { return a.transpose() * v; }
 
-inline double operator * (const vec4& a, const vec4& b)
+inline scalar operator * (const vec4& a, const vec4& b)
 { return (a.n[VX]*b.n[VX] + a.n[VY]*b.n[VY] + a.n[VZ]*b.n[VZ] +
   a.n[VW]*b.n[VW]); }
 
-inline vec4 operator / (const vec4& a, const double d)
-{ double d_inv = 1./d; return vec4(a.n[VX]*d_inv, a.n[VY]*d_inv, a.n[VZ]*d_inv,
+inline vec4 operator / (const vec4& a, const scalar d)
+{ scalar d_inv = 1./d; return vec4(a.n[VX]*d_inv, a.n[VY]*d_inv, a.n[VZ]*d_inv,
   a.n[VW]*d_inv); }
 
 inline int operator == (const vec4& a, const vec4& b)
@@ -932,7 +941,7 @@ inline mat3::mat3() {}
 inline mat3::mat3(const vec3& v0, const vec3& v1, const vec3& v2)
 { v[0] = v0; v[1] = v1; v[2] = v2; }
 
-inline mat3::mat3(const double d)
+inline mat3::mat3(const scalar d)
 { v[0] = v[1] = v[2] = vec3(d); }
 
 inline mat3::mat3(const mat3& m)
@@ -950,10 +959,10 @@ inline mat3& mat3::operator += ( const mat3& m )
 inline mat3& mat3::operator -= ( const mat3& m )
 { v[0] -= m.v[0]; v[1] -= m.v[1]; v[2] -= m.v[2]; return *this; }
 
-inline mat3& mat3::operator *= ( const double d )
+inline mat3& mat3::operator *= ( const scalar d )
 { v[0] *= d; v[1] *= d; v[2] *= d; return *this; }
 
-inline mat3& mat3::operator /= ( const double d )
+inline mat3& mat3::operator /= ( const scalar d )
 { v[0] /= d; v[1] /= d; v[2] /= d; return *this; }
 
 inline vec3& mat3::operator [] ( int i) {
@@ -1014,13 +1023,13 @@ inline mat3& mat3::apply(V_FCT_PTR fct) {
     return *this;
 }
 
-inline double mat3::determinant() {
-    double scalarA = v[0][0]*v[1][1]*v[2][2] + v[0][1]*v[1][2]*v[2][0] + v[0][2]*v[1][0]*v[2][1];
-    double scalarB = v[2][0]*v[1][1]*v[0][2] + v[2][1]*v[1][2]*v[0][0] + v[2][2]*v[1][0]*v[0][1];
+inline scalar mat3::determinant() {
+    scalar scalarA = v[0][0]*v[1][1]*v[2][2] + v[0][1]*v[1][2]*v[2][0] + v[0][2]*v[1][0]*v[2][1];
+    scalar scalarB = v[2][0]*v[1][1]*v[0][2] + v[2][1]*v[1][2]*v[0][0] + v[2][2]*v[1][0]*v[0][1];
     return scalarA - scalarB;
 }
 
-inline double mat3::determinantCol() {
+inline scalar mat3::determinantCol() {
     return v[0][0] * (v[1][1] * v[2][2] - v[2][1] * v[1][2]) -
            v[1][0] * (v[0][1] * v[2][2] - v[2][1] * v[0][2]) +
            v[2][0] * (v[0][1] * v[1][2] - v[0][2] * v[1][1]);
@@ -1046,13 +1055,13 @@ inline mat3 operator * (const mat3& a, const mat3& b) {
     #undef ROWCOL // (i, j)
 }
 
-inline mat3 operator * (const mat3& a, const double d)
+inline mat3 operator * (const mat3& a, const scalar d)
 { return mat3(a.v[0] * d, a.v[1] * d, a.v[2] * d); }
 
-inline mat3 operator * (const double d, const mat3& a)
+inline mat3 operator * (const scalar d, const mat3& a)
 { return a*d; }
 
-inline mat3 operator / (const mat3& a, const double d)
+inline mat3 operator / (const mat3& a, const scalar d)
 { return mat3(a.v[0] / d, a.v[1] / d, a.v[2] / d); }
 
 inline int operator == (const mat3& a, const mat3& b)
@@ -1092,7 +1101,7 @@ inline mat4::mat4() {}
 inline mat4::mat4(const vec4& v0, const vec4& v1, const vec4& v2, const vec4& v3)
 { v[0] = v0; v[1] = v1; v[2] = v2; v[3] = v3; }
 
-inline mat4::mat4(const double d)
+inline mat4::mat4(const scalar d)
 { v[0] = v[1] = v[2] = v[3] = vec4(d); }
 
 inline mat4::mat4(const mat4& m)
@@ -1113,10 +1122,10 @@ inline mat4& mat4::operator -= ( const mat4& m )
 { v[0] -= m.v[0]; v[1] -= m.v[1]; v[2] -= m.v[2]; v[3] -= m.v[3];
 return *this; }
 
-inline mat4& mat4::operator *= ( const double d )
+inline mat4& mat4::operator *= ( const scalar d )
 { v[0] *= d; v[1] *= d; v[2] *= d; v[3] *= d; return *this; }
 
-inline mat4& mat4::operator /= ( const double d )
+inline mat4& mat4::operator /= ( const scalar d )
 { v[0] /= d; v[1] /= d; v[2] /= d; v[3] /= d; return *this; }
 
 inline vec4& mat4::operator [] ( int i) {
@@ -1201,13 +1210,13 @@ inline mat4 operator * (const mat4& a, const mat4& b) {
 	#undef ROWCOL
 }
 
-inline mat4 operator * (const mat4& a, const double d)
+inline mat4 operator * (const mat4& a, const scalar d)
 { return mat4(a.v[0] * d, a.v[1] * d, a.v[2] * d, a.v[3] * d); }
 
-inline mat4 operator * (const double d, const mat4& a)
+inline mat4 operator * (const scalar d, const mat4& a)
 { return a*d; }
 
-inline mat4 operator / (const mat4& a, const double d)
+inline mat4 operator / (const mat4& a, const scalar d)
 { return mat4(a.v[0] / d, a.v[1] / d, a.v[2] / d, a.v[3] / d); }
 
 inline int operator == (const mat4& a, const mat4& b)
@@ -1252,8 +1261,8 @@ inline mat3 translation2D(const vec2& v)
 		vec3(0.0, 1.0, v[VY]),
 		vec3(0.0, 0.0, 1.0)); }
 
-inline mat3 rotation2D(const vec2& Center, const double angleDeg) {
-    double  angleRad = angleDeg * M_PI / 180.0,
+inline mat3 rotation2D(const vec2& Center, const scalar angleDeg) {
+    scalar  angleRad = angleDeg * M_PI / 180.0,
 	    c = cos(angleRad),
 	    s = sin(angleRad);
 
@@ -1279,8 +1288,8 @@ inline mat4 translation3D(const vec3& v)
 		vec4(0.0, 0.0, 1.0, v[VZ]),
 		vec4(0.0, 0.0, 0.0, 1.0)); }
 
-inline mat4 rotation3D(vec3 Axis, const double angleDeg) {
-    double  angleRad = angleDeg * M_PI / 180.0,
+inline mat4 rotation3D(vec3 Axis, const scalar angleDeg) {
+    scalar  angleRad = angleDeg * M_PI / 180.0,
 	    c = cos(angleRad),
 	    s = sin(angleRad),
 	    t = 1.0 - c;
@@ -1307,7 +1316,7 @@ inline mat4 scaling3D(const vec3& scaleVector)
 		vec4(0.0, 0.0, scaleVector[VZ], 0.0),
 		vec4(0.0, 0.0, 0.0, 1.0)); }
 
-inline mat4 perspective3D(const double d)
+inline mat4 perspective3D(const scalar d)
 {   return mat4(vec4(1.0, 0.0, 0.0, 0.0),
 		vec4(0.0, 1.0, 0.0, 0.0),
 		vec4(0.0, 0.0, 1.0, 0.0),
@@ -1315,4 +1324,3 @@ inline mat4 perspective3D(const double d)
 
 
 #endif // ALGEBRA3H
-
@@ -0,0 +1,354 @@
+/*
+ *  algebra3f.h
+ *  RayTracer
+ *
+ *  Single-precision, SIMD-backed counterparts of the algebra3.h types, for
+ *  the render hot paths. float4 keeps four floats in one SSE register (or a
+ *  plain array where SSE isn't available) and does lane-wise arithmetic;
+ *  vec3f, vec4f and mat4f are built on it, and box3f holds the slab test
+ *  the trees use.
+ *
+ *  Scenes are still loaded and built in double precision with algebra3.h.
+ *  Conversions to these types are explicit (vec3f(const vec3&), toVec3()
+ *  and so on), so precision is only dropped where the code says so.
+ *
+ *  Only the box and triangle tests of the trees, TriangleGroup and
+ *  CompactMesh use these types. Ray, BoundingBox, the Shapes and rgb stay
+ *  on algebra3.h's scalar: switching that to float (-DALGEBRA3FLOAT) is
+ *  how they are made single precision, and the default double build keeps
+ *  renders identical to earlier versions.
+ */
+
+#ifndef ALGEBRA3FH
+#define ALGEBRA3FH
+
+#include "algebra3.h"
+#include <cstring>
+#ifdef __SSE__
+#include <xmmintrin.h>
+#endif
+
+class float4;
+class vec3f;
+class vec4f;
+class mat4f;
+class box3f;
+
+
+/* Four floats operated on lane by lane. Comparisons give masks with all
+   bits of a lane set or clear, for select(), movemask() and the bitwise
+   operators. vmin()/vmax() follow SSE: if either lane is NaN the second
+   argument's lane is returned. */
+class float4 {
+
+public:
+
+#ifdef __SSE__
+	__m128 v;
+
+	inline float4() {}
+	inline float4(__m128 m) : v(m) {}
+	inline explicit float4(float f) : v(_mm_set1_ps(f)) {}
+	inline float4(float x, float y, float z, float w) : v(_mm_setr_ps(x, y, z, w)) {}
+	static inline float4 load(const float* p) { return float4(_mm_loadu_ps(p)); }
+	inline void store(float* p) const { _mm_storeu_ps(p, v); }
+#else
+	float v[4];
+
+	inline float4() {}
+	inline explicit float4(float f) { v[0] = v[1] = v[2] = v[3] = f; }
+	inline float4(float x, float y, float z, float w) { v[0] = x; v[1] = y; v[2] = z; v[3] = w; }
+	static inline float4 load(const float* p) { return float4(p[0], p[1], p[2], p[3]); }
+	inline void store(float* p) const { p[0] = v[0]; p[1] = v[1]; p[2] = v[2]; p[3] = v[3]; }
+#endif
+
+	inline float operator [] (int i) const { float f[4]; store(f); return f[i]; }
+
+	friend float4 operator + (const float4& a, const float4& b);
+	friend float4 operator - (const float4& a, const float4& b);
+	friend float4 operator * (const float4& a, const float4& b);
+	friend float4 operator / (const float4& a, const float4& b);
+	friend float4 operator < (const float4& a, const float4& b);
+	friend float4 operator <= (const float4& a, const float4& b);
+	friend float4 operator > (const float4& a, const float4& b);
+	friend float4 operator >= (const float4& a, const float4& b);
+	friend float4 operator & (const float4& a, const float4& b);
+	friend float4 operator | (const float4& a, const float4& b);
+	friend float4 vmin(const float4& a, const float4& b);
+	friend float4 vmax(const float4& a, const float4& b);
+	friend float4 vabs(const float4& a);
+	friend float4 select(const float4& mask, const float4& a, const float4& b);	// mask ? a : b
+	friend int movemask(const float4& mask);									// Bit i set if lane i is
+	friend float4 rotate(const float4& a);										// (y, z, x, w)
+};
+
+
+/* 3-vector of floats. The fourth lane is kept at zero. */
+class vec3f {
+
+public:
+
+	float4 v;
+
+	inline vec3f() {}
+	inline vec3f(float x, float y, float z) : v(x, y, z, 0) {}
+	inline explicit vec3f(const float4& f) : v(f) {}
+	inline explicit vec3f(const vec3& d) : v((float)d[VX], (float)d[VY], (float)d[VZ], 0) {}
+
+	inline vec3 toVec3() const { float f[4]; v.store(f); return vec3(f[VX], f[VY], f[VZ]); }
+	inline float operator [] (int i) const { return v[i]; }
+
+	inline vec3f& operator += (const vec3f& a) { v = v + a.v; return *this; }
+	inline vec3f& operator -= (const vec3f& a) { v = v - a.v; return *this; }
+	inline vec3f& operator *= (float d) { v = v * float4(d); return *this; }
+
+	inline float length2() const;
+	inline float length() const { return sqrtf(length2()); }
+	inline vec3f& normalize() { return *this *= 1 / length(); }
+
+	friend vec3f operator - (const vec3f& a);							// -v1
+	friend vec3f operator + (const vec3f& a, const vec3f& b);			// v1 + v2
+	friend vec3f operator - (const vec3f& a, const vec3f& b);			// v1 - v2
+	friend vec3f operator * (const vec3f& a, float d);					// v1 * 3.0
+	friend vec3f operator * (float d, const vec3f& a);					// 3.0 * v1
+	friend float operator * (const vec3f& a, const vec3f& b);			// dot product
+	friend vec3f operator ^ (const vec3f& a, const vec3f& b);			// cross product
+	friend vec3f prod(const vec3f& a, const vec3f& b);					// term by term *
+};
+
+
+/* 4-vector of floats. */
+class vec4f {
+
+public:
+
+	float4 v;
+
+	inline vec4f() {}
+	inline vec4f(float x, float y, float z, float w) : v(x, y, z, w) {}
+	inline explicit vec4f(const float4& f) : v(f) {}
+	inline explicit vec4f(const vec4& d) : v((float)d[VX], (float)d[VY], (float)d[VZ], (float)d[VW]) {}
+	inline vec4f(const vec3f& a, float w) : v(a[VX], a[VY], a[VZ], w) {}
+
+	inline vec4 toVec4() const { float f[4]; v.store(f); return vec4(f[VX], f[VY], f[VZ], f[VW]); }
+	inline float operator [] (int i) const { return v[i]; }
+
+	friend vec4f operator + (const vec4f& a, const vec4f& b);
+	friend vec4f operator - (const vec4f& a, const vec4f& b);
+	friend vec4f operator * (const vec4f& a, float d);
+	friend float operator * (const vec4f& a, const vec4f& b);			// dot product
+};
+
+
+/* 4x4 matrix of floats, stored by column so that a matrix-vector product
+   is four multiply-adds of whole columns. */
+class mat4f {
+
+public:
+
+	float4 c[4];
+
+	inline mat4f() {}
+	inline explicit mat4f(const mat4& m) {
+		for (int j = 0; j < 4; j++)
+			c[j] = float4((float)m[0][j], (float)m[1][j], (float)m[2][j], (float)m[3][j]);
+	}
+
+	inline vec3f transformPoint(const vec3f& p) const;					// w = 1
+	inline vec3f transformVector(const vec3f& d) const;				// w = 0
+
+	friend vec4f operator * (const mat4f& a, const vec4f& v);			// M . v
+};
+
+
+/* Axis-aligned box of floats. */
+class box3f {
+
+public:
+
+	vec3f lo;
+	vec3f hi;
+
+	inline box3f() {}
+	inline box3f(const vec3f& low, const vec3f& high) : lo(low), hi(high) {}
+
+	// Slab test: does the ray from org, given by its inverse direction, meet
+	// the box for some t with tMin < t < tMax? The far distance is padded a
+	// few ulps so rounding can't make it miss a box the ray grazes. Lanes
+	// beyond z are ignored, so lo and hi may be loaded with stray fourth
+	// lanes.
+	inline bool hit(const vec3f& org, const vec3f& inv, float tMin, float tMax) const;
+
+	// The distances at which the ray enters and leaves the box, unclipped;
+	// tNear > tFar if it misses. The far distance is padded as in hit().
+	inline void slabs(const vec3f& org, const vec3f& inv, float& tNear, float& tFar) const;
+};
+
+
+/****************************************************************
+*																*
+*		    float4 member functions								*
+*																*
+****************************************************************/
+
+#ifdef __SSE__
+
+inline float4 operator + (const float4& a, const float4& b) { return _mm_add_ps(a.v, b.v); }
+inline float4 operator - (const float4& a, const float4& b) { return _mm_sub_ps(a.v, b.v); }
+inline float4 operator * (const float4& a, const float4& b) { return _mm_mul_ps(a.v, b.v); }
+inline float4 operator / (const float4& a, const float4& b) { return _mm_div_ps(a.v, b.v); }
+inline float4 operator < (const float4& a, const float4& b) { return _mm_cmplt_ps(a.v, b.v); }
+inline float4 operator <= (const float4& a, const float4& b) { return _mm_cmple_ps(a.v, b.v); }
+inline float4 operator > (const float4& a, const float4& b) { return _mm_cmpgt_ps(a.v, b.v); }
+inline float4 operator >= (const float4& a, const float4& b) { return _mm_cmpge_ps(a.v, b.v); }
+inline float4 operator & (const float4& a, const float4& b) { return _mm_and_ps(a.v, b.v); }
+inline float4 operator | (const float4& a, const float4& b) { return _mm_or_ps(a.v, b.v); }
+inline float4 vmin(const float4& a, const float4& b) { return _mm_min_ps(a.v, b.v); }
+inline float4 vmax(const float4& a, const float4& b) { return _mm_max_ps(a.v, b.v); }
+inline float4 vabs(const float4& a) { return _mm_andnot_ps(_mm_set1_ps(-0.0f), a.v); }
+inline int movemask(const float4& mask) { return _mm_movemask_ps(mask.v); }
+inline float4 rotate(const float4& a) { return _mm_shuffle_ps(a.v, a.v, _MM_SHUFFLE(3, 0, 2, 1)); }
+
+inline float4 select(const float4& mask, const float4& a, const float4& b) {
+	return _mm_or_ps(_mm_and_ps(mask.v, a.v), _mm_andnot_ps(mask.v, b.v));
+}
+
+#else
+
+// Lane masks are all-ones or all-zeros bit patterns stored in floats.
+static inline float maskLane(bool set) {
+	unsigned int bits = set ? 0xffffffffu : 0;
+	float f;
+	memcpy(&f, &bits, sizeof(f));
+	return f;
+}
+
+static inline unsigned int laneBits(float f) {
+	unsigned int bits;
+	memcpy(&bits, &f, sizeof(bits));
+	return bits;
+}
+
+static inline float bitsLane(unsigned int bits) {
+	float f;
+	memcpy(&f, &bits, sizeof(f));
+	return f;
+}
+
+#define FLOAT4_LANES(EXPR) float4 r; for (int i = 0; i < 4; i++) r.v[i] = (EXPR); return r;
+
+inline float4 operator + (const float4& a, const float4& b) { FLOAT4_LANES(a.v[i] + b.v[i]) }
+inline float4 operator - (const float4& a, const float4& b) { FLOAT4_LANES(a.v[i] - b.v[i]) }
+inline float4 operator * (const float4& a, const float4& b) { FLOAT4_LANES(a.v[i] * b.v[i]) }
+inline float4 operator / (const float4& a, const float4& b) { FLOAT4_LANES(a.v[i] / b.v[i]) }
+inline float4 operator < (const float4& a, const float4& b) { FLOAT4_LANES(maskLane(a.v[i] < b.v[i])) }
+inline float4 operator <= (const float4& a, const float4& b) { FLOAT4_LANES(maskLane(a.v[i] <= b.v[i])) }
+inline float4 operator > (const float4& a, const float4& b) { FLOAT4_LANES(maskLane(a.v[i] > b.v[i])) }
+inline float4 operator >= (const float4& a, const float4& b) { FLOAT4_LANES(maskLane(a.v[i] >= b.v[i])) }
+inline float4 operator & (const float4& a, const float4& b) { FLOAT4_LANES(bitsLane(laneBits(a.v[i]) & laneBits(b.v[i]))) }
+inline float4 operator | (const float4& a, const float4& b) { FLOAT4_LANES(bitsLane(laneBits(a.v[i]) | laneBits(b.v[i]))) }
+inline float4 vmin(const float4& a, const float4& b) { FLOAT4_LANES(a.v[i] < b.v[i] ? a.v[i] : b.v[i]) }
+inline float4 vmax(const float4& a, const float4& b) { FLOAT4_LANES(a.v[i] > b.v[i] ? a.v[i] : b.v[i]) }
+inline float4 vabs(const float4& a) { FLOAT4_LANES(fabsf(a.v[i])) }
+inline float4 select(const float4& mask, const float4& a, const float4& b) {
+	FLOAT4_LANES(bitsLane((laneBits(mask.v[i]) & laneBits(a.v[i])) | (~laneBits(mask.v[i]) & laneBits(b.v[i]))))
+}
+
+inline int movemask(const float4& mask) {
+	int bits = 0;
+	for (int i = 0; i < 4; i++)
+		bits |= (laneBits(mask.v[i]) >> 31) << i;
+	return bits;
+}
+
+inline float4 rotate(const float4& a) { return float4(a.v[1], a.v[2], a.v[0], a.v[3]); }
+
+#undef FLOAT4_LANES
+
+#endif
+
+
+/****************************************************************
+*																*
+*		    vec3f member functions								*
+*																*
+****************************************************************/
+
+// Sum of the first three lanes.
+static inline float sum3(const float4& a) {
+	float4 r = rotate(a);
+	return (a + r + rotate(r))[0];
+}
+
+inline float vec3f::length2() const { return *this * *this; }
+
+inline vec3f operator - (const vec3f& a) { return vec3f(float4(0.0f) - a.v); }
+inline vec3f operator + (const vec3f& a, const vec3f& b) { return vec3f(a.v + b.v); }
+inline vec3f operator - (const vec3f& a, const vec3f& b) { return vec3f(a.v - b.v); }
+inline vec3f operator * (const vec3f& a, float d) { return vec3f(a.v * float4(d)); }
+inline vec3f operator * (float d, const vec3f& a) { return vec3f(a.v * float4(d)); }
+inline float operator * (const vec3f& a, const vec3f& b) { return sum3(a.v * b.v); }
+inline vec3f prod(const vec3f& a, const vec3f& b) { return vec3f(a.v * b.v); }
+
+// a ^ b = a.yzx * b.zxy - a.zxy * b.yzx, computed as (a * b.yzx - a.yzx * b).yzx
+inline vec3f operator ^ (const vec3f& a, const vec3f& b) {
+	return vec3f(rotate(a.v * rotate(b.v) - rotate(a.v) * b.v));
+}
+
+
+/****************************************************************
+*																*
+*		    vec4f and mat4f member functions					*
+*																*
+****************************************************************/
+
+inline vec4f operator + (const vec4f& a, const vec4f& b) { return vec4f(a.v + b.v); }
+inline vec4f operator - (const vec4f& a, const vec4f& b) { return vec4f(a.v - b.v); }
+inline vec4f operator * (const vec4f& a, float d) { return vec4f(a.v * float4(d)); }
+
+inline float operator * (const vec4f& a, const vec4f& b) {
+	float4 p = a.v * b.v;
+	return p[0] + p[1] + p[2] + p[3];
+}
+
+inline vec4f operator * (const mat4f& a, const vec4f& v) {
+	return vec4f(a.c[0] * float4(v[VX]) + a.c[1] * float4(v[VY]) + a.c[2] * float4(v[VZ]) + a.c[3] * float4(v[VW]));
+}
+
+inline vec3f mat4f::transformPoint(const vec3f& p) const {
+	float4 r = c[0] * float4(p[VX]) + c[1] * float4(p[VY]) + c[2] * float4(p[VZ]) + c[3];
+	return vec3f(r[VX], r[VY], r[VZ]);
+}
+
+inline vec3f mat4f::transformVector(const vec3f& d) const {
+	float4 r = c[0] * float4(d[VX]) + c[1] * float4(d[VY]) + c[2] * float4(d[VZ]);
+	return vec3f(r[VX], r[VY], r[VZ]);
+}
+
+
+/****************************************************************
+*																*
+*		    box3f member functions								*
+*																*
+****************************************************************/
+
+inline void box3f::slabs(const vec3f& org, const vec3f& inv, float& tNear, float& tFar) const {
+
+	float4 t0 = (lo.v - org.v) * inv.v;
+	float4 t1 = (hi.v - org.v) * inv.v;
+	float4 nearT = vmin(t0, t1);
+	float4 farT = vmax(t0, t1);
+	float4 r = rotate(nearT), s = rotate(farT);
+	tNear = vmax(nearT, vmax(r, rotate(r)))[0];
+	tFar = vmin(farT, vmin(s, rotate(s)))[0] * 1.0000004f;
+}
+
+inline bool box3f::hit(const vec3f& org, const vec3f& inv, float tMin, float tMax) const {
+
+	float tNear, tFar;
+	slabs(org, inv, tNear, tFar);
+	return tNear <= tFar && tNear < tMax && tFar > tMin;
+}
+
+
+#endif
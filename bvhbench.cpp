@@ -0,0 +1,189 @@
+/*
+ *  bvhbench.cpp
+ *  RayTracer
+ *
+ *  Benchmark for the tree layouts: loads an OBJ mesh, builds its hierarchy
+ *  once per layout, and times the same random closest-hit and occlusion
+ *  queries against each one, then against the mesh loaded as a CompactMesh.
+ *  Hit counts are printed too; they should agree across layouts (the
+ *  compact mesh's float vertices may shift a few). A last pass times
+ *  pinhole camera rays traced one at a time against the same rays traced
+ *  in 4x4 packets on the linear layout.
+ *
+ *  Not part of the raytrace target. Build it from the raytracer sources
+ *  minus raytrace.cpp and the random-library examples, e.g.
+ *    g++ -O2 -o bvhbench bvhbench.cpp Camera.cpp CounterRNG.cpp Film.cpp
+ *      Lights.cpp LinearBoundingBoxTree.cpp Material.cpp Primitives.cpp
+ *      Ray.cpp RayTracer.cpp SampleGenerator.cpp Sampler.cpp Scene.cpp
+ *      Shapes.cpp TileScheduler.cpp WideBoundingBoxTree.cpp mersenne.cpp
+ *      objParser.cpp rgb.cpp TriangleGroup.cpp WavefrontTracer.cpp
+ *      CompactMesh.cpp -lfreeimage -lpthread
+ *
+ *  Usage: bvhbench mesh.obj [rays] [resolution]
+ */
+
+#include "Primitives.h"
+#include "Material.h"
+#include "Ray.h"
+#include "IntersectRecord.h"
+#include "TileScheduler.h"
+#include "objParser.h"
+#include "randomc.h"
+#include "algebra3.h"
+#include <iostream>
+#include <cfloat>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+
+/* Random segments from a sphere around the scene to points inside its box. */
+static void makeRays(const BoundingBox& box, unsigned int count, vector<vec3>* starts, vector<vec3>* ends) {
+
+	BoundingBox bounds = box;
+	vec3 min(bounds.minCoordinate(0), bounds.minCoordinate(1), bounds.minCoordinate(2));
+	vec3 max(bounds.maxCoordinate(0), bounds.maxCoordinate(1), bounds.maxCoordinate(2));
+	vec3 center = (min + max) / 2;
+	double radius = (max - min).length();
+
+	CRandomMersenne rng(1);
+	for (unsigned int i = 0; i < count; i++) {
+		vec3 dir;
+		do {
+			dir = vec3(2 * rng.Random() - 1, 2 * rng.Random() - 1, 2 * rng.Random() - 1);
+		} while (dir.length2() > 1 || dir.length2() < 0.0001);
+		dir.normalize();
+		starts->push_back(center + radius * dir);
+		ends->push_back(vec3(min[0] + rng.Random() * (max[0] - min[0]),
+							 min[1] + rng.Random() * (max[1] - min[1]),
+							 min[2] + rng.Random() * (max[2] - min[2])));
+	}
+}
+
+/* Pinhole camera rays over a resolution x resolution image of the whole box,
+ * ordered in 4x4 pixel blocks the way Scene::renderBlock issues them. */
+static void makeCameraRays(const BoundingBox& box, unsigned int resolution, vec3* eye, vector<vec3>* dirs) {
+
+	BoundingBox bounds = box;
+	vec3 min(bounds.minCoordinate(0), bounds.minCoordinate(1), bounds.minCoordinate(2));
+	vec3 max(bounds.maxCoordinate(0), bounds.maxCoordinate(1), bounds.maxCoordinate(2));
+	vec3 center = (min + max) / 2;
+	double radius = (max - min).length() / 2;
+	*eye = center + vec3(0, 0, 2.5 * radius);
+
+	for (unsigned int by = 0; by < resolution; by += 4)
+		for (unsigned int bx = 0; bx < resolution; bx += 4)
+			for (unsigned int y = by; y < MIN(by + 4, resolution); y++)
+				for (unsigned int x = bx; x < MIN(bx + 4, resolution); x++) {
+					double u = ((x + 0.5) / resolution - 0.5) * 2 * radius;
+					double v = ((y + 0.5) / resolution - 0.5) * 2 * radius;
+					dirs->push_back(center + vec3(u, v, 0) - *eye);
+				}
+}
+
+static Primitive* buildScene(const string& filename, Material* mat, TreeLayout layout, MeshFormat format) {
+
+	ObjParser parser(filename, mat, identity3D(), false, false, false, sahSplit, format);
+	vector<Primitive*> objects = parser.getObjects();
+	for (unsigned int i = 0; i < objects.size(); i++) {
+		MeshPrimitive* mesh = dynamic_cast<MeshPrimitive*>(objects[i]);
+		if (mesh != NULL)
+			mesh->flatten(layout);
+	}
+	return BoundingBoxTree::compile(new BoundingBoxTree(objects, VZ, sahSplit), layout);
+}
+
+int main(int argc, char* argv[]) {
+
+	if (argc < 2) {
+		cerr << "Usage: bvhbench mesh.obj [rays]" << endl;
+		exit(1);
+	}
+	string filename = argv[1];
+	unsigned int count = argc > 2 ? atoi(argv[2]) : 1000000;
+	unsigned int resolution = argc > 3 ? atoi(argv[3]) : 1024;
+
+	const char* names[4] = { "tree", "linear", "bvh4", "compact" };
+	TreeLayout layouts[4] = { pointerLayout, linearLayout, wideLayout, linearLayout };
+	MeshFormat formats[4] = { objectMesh, objectMesh, objectMesh, compactMesh };
+	Material mat;
+	Sample samp = Sample();
+	vector<vec3> starts, ends;
+	double baseline[2] = { 0, 0 };
+
+	for (int l = 0; l < 4; l++) {
+		Primitive* hierarchy = buildScene(filename, &mat, layouts[l], formats[l]);
+		if (starts.empty())
+			makeRays(hierarchy->getBoundingBox(), count, &starts, &ends);
+
+		unsigned int hits = 0;
+		double start = TileScheduler::currentTime();
+		for (unsigned int i = 0; i < count; i++) {
+			Ray ray(starts[i], 0, DBL_MAX, ends[i] - starts[i], samp, NULL);
+			IntersectRecord rec;
+			if (hierarchy->intersect(ray, &rec))
+				hits++;
+		}
+		double closest = TileScheduler::currentTime() - start;
+
+		unsigned int occluded = 0;
+		start = TileScheduler::currentTime();
+		for (unsigned int i = 0; i < count; i++) {
+			Ray ray(starts[i], 0, 1, ends[i] - starts[i], samp, NULL);
+			if (hierarchy->intersectAny(ray))
+				occluded++;
+		}
+		double any = TileScheduler::currentTime() - start;
+
+		if (l == 0) {
+			baseline[0] = closest;
+			baseline[1] = any;
+		}
+		cout << names[l] << ":\tclosest " << count / closest / 1e6 << " Mrays/s (" << hits << " hits, "
+			<< baseline[0] / closest << "x)\tocclusion " << count / any / 1e6 << " Mrays/s ("
+			<< occluded << " occluded, " << baseline[1] / any << "x)" << endl;
+		delete hierarchy;
+	}
+
+	Primitive* hierarchy = buildScene(filename, &mat, linearLayout, objectMesh);
+	vec3 eye;
+	vector<vec3> dirs;
+	makeCameraRays(hierarchy->getBoundingBox(), resolution, &eye, &dirs);
+
+	unsigned int hits = 0;
+	double start = TileScheduler::currentTime();
+	for (unsigned int i = 0; i < dirs.size(); i++) {
+		Ray ray(eye, 0, DBL_MAX, dirs[i], samp, NULL);
+		IntersectRecord rec;
+		if (hierarchy->intersect(ray, &rec))
+			hits++;
+	}
+	double single = TileScheduler::currentTime() - start;
+
+	unsigned int packetHits = 0;
+	start = TileScheduler::currentTime();
+	for (unsigned int i = 0; i < dirs.size(); i += PACKET_SIZE) {
+		vector<Ray> rays;
+		IntersectRecord records[PACKET_SIZE];
+		RayPacket packet;
+		packet.size = MIN(PACKET_SIZE, dirs.size() - i);
+		for (unsigned int k = 0; k < packet.size; k++)
+			rays.push_back(Ray(eye, 0, DBL_MAX, dirs[i + k], samp, NULL));
+		for (unsigned int k = 0; k < packet.size; k++) {
+			packet.rays[k] = &rays[k];
+			packet.records[k] = &records[k];
+		}
+		unsigned int mask = hierarchy->intersectPacket(packet, (1u << packet.size) - 1);
+		for (unsigned int k = 0; k < packet.size; k++)
+			if (mask & (1u << k))
+				packetHits++;
+	}
+	double packets = TileScheduler::currentTime() - start;
+
+	cout << "primary:	single " << dirs.size() / single / 1e6 << " Mrays/s (" << hits << " hits)	packet "
+		<< dirs.size() / packets / 1e6 << " Mrays/s (" << packetHits << " hits, " << single / packets << "x)" << endl;
+	delete hierarchy;
+	return 0;
+}
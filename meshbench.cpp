@@ -0,0 +1,218 @@
+/*
+ *  meshbench.cpp
+ *  RayTracer
+ *
+ *  Benchmark for the mesh formats: loads an OBJ mesh as a MeshPrimitive, a
+ *  CompactMesh and a quantized CompactMesh, and reports for each the bytes
+ *  per triangle of geometry and acceleration structure. The two compact
+ *  forms are then timed on the same random closest-hit queries, and each
+ *  renders a simple image (a checkerboard in texture space, lit by the
+ *  shading normal) so the cost of decoding the quantized vertices and the
+ *  error it brings can be read off against the float one. Timings are the
+ *  best of several rounds, alternating between the two forms.
+ *
+ *  Not part of the raytrace target. Build it from the raytracer sources
+ *  minus raytrace.cpp and the random-library examples, as for bvhbench.
+ *
+ *  Usage: meshbench mesh.obj [rays] [resolution] [rounds]
+ */
+
+#include "Primitives.h"
+#include "CompactMesh.h"
+#include "Material.h"
+#include "Ray.h"
+#include "IntersectRecord.h"
+#include "TileScheduler.h"
+#include "objParser.h"
+#include "randomc.h"
+#include "algebra3.h"
+#include <iostream>
+#include <cfloat>
+#include <cmath>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+#define CHECKER_SQUARES 16			// Checkerboard squares across the texture
+
+
+/* A material whose diffuse color is a checkerboard over the texture
+   coordinate, so errors in the decoded UVs show up in the image. */
+class CheckerMaterial : public Material {
+
+public:
+
+	Reflectance getReflectance(const vec2& textureCoordinate) {
+
+		Reflectance reflectance = myReflectance;
+		int u = (int)floor(textureCoordinate[0] * CHECKER_SQUARES);
+		int v = (int)floor(textureCoordinate[1] * CHECKER_SQUARES);
+		reflectance.kD = (u + v) % 2 == 0 ? rgb(1, 1, 1) : rgb(0.25, 0.25, 0.25);
+		return reflectance;
+	}
+
+};
+
+
+/* Random segments from a sphere around the mesh to points inside its box. */
+static void makeRays(const BoundingBox& box, unsigned int count, vector<vec3>* starts, vector<vec3>* ends) {
+
+	BoundingBox bounds = box;
+	vec3 min(bounds.minCoordinate(0), bounds.minCoordinate(1), bounds.minCoordinate(2));
+	vec3 max(bounds.maxCoordinate(0), bounds.maxCoordinate(1), bounds.maxCoordinate(2));
+	vec3 center = (min + max) / 2;
+	double radius = (max - min).length();
+
+	CRandomMersenne rng(1);
+	for (unsigned int i = 0; i < count; i++) {
+		vec3 dir;
+		do {
+			dir = vec3(2 * rng.Random() - 1, 2 * rng.Random() - 1, 2 * rng.Random() - 1);
+		} while (dir.length2() > 1 || dir.length2() < 0.0001);
+		dir.normalize();
+		starts->push_back(center + radius * dir);
+		ends->push_back(vec3(min[0] + rng.Random() * (max[0] - min[0]),
+							 min[1] + rng.Random() * (max[1] - min[1]),
+							 min[2] + rng.Random() * (max[2] - min[2])));
+	}
+}
+
+static Primitive* loadMesh(const string& filename, Material* mat, MeshFormat format) {
+
+	ObjParser parser(filename, mat, identity3D(), false, false, false, sahSplit, format);
+	vector<Primitive*> objects = parser.getObjects();
+	if (objects.size() != 1) {
+		cerr << "Error: " << filename << " has no normals or texture coordinates" << endl;
+		exit(1);
+	}
+	MeshPrimitive* mesh = dynamic_cast<MeshPrimitive*>(objects[0]);
+	if (mesh != NULL)
+		mesh->flatten(linearLayout);
+	return objects[0];
+}
+
+// Renders the mesh head-on into "image", one gray level per pixel: the
+// checker color times the cosine to a light over the viewer's shoulder.
+// Returns the time taken.
+static double render(Primitive* mesh, unsigned int resolution, vector<unsigned char>* image) {
+
+	BoundingBox bounds = mesh->getBoundingBox();
+	vec3 min(bounds.minCoordinate(0), bounds.minCoordinate(1), bounds.minCoordinate(2));
+	vec3 max(bounds.maxCoordinate(0), bounds.maxCoordinate(1), bounds.maxCoordinate(2));
+	vec3 center = (min + max) / 2;
+	double radius = (max - min).length() / 2;
+	vec3 eye = center + vec3(0, 0, 2.5 * radius);
+	vec3 light(1, 1, 2);
+	light.normalize();
+	Sample samp = Sample();
+
+	image->assign(resolution * resolution, 0);
+	double start = TileScheduler::currentTime();
+	for (unsigned int y = 0; y < resolution; y++)
+		for (unsigned int x = 0; x < resolution; x++) {
+			double u = ((x + 0.5) / resolution - 0.5) * 2 * radius;
+			double v = ((y + 0.5) / resolution - 0.5) * 2 * radius;
+			Ray ray(eye, 0, DBL_MAX, center + vec3(u, v, 0) - eye, samp, NULL);
+			IntersectRecord rec;
+			if (!mesh->intersect(ray, &rec))
+				continue;
+			Reflectance reflectance = rec.leafPrimitive->getHitReflectance(rec);
+			double shade = reflectance.kD[0] * MAX(0.0, rec.surfaceNormal * light);
+			(*image)[y * resolution + x] = (unsigned char)MIN(255.0, floor(shade * 255 + 0.5));
+		}
+	return TileScheduler::currentTime() - start;
+}
+
+// Times "count" closest-hit queries along the given segments; returns the
+// time taken and sets "hits".
+static double closestHits(Primitive* mesh, const vector<vec3>& starts, const vector<vec3>& ends,
+						  unsigned int* hits) {
+
+	Sample samp = Sample();
+	*hits = 0;
+	double start = TileScheduler::currentTime();
+	for (unsigned int i = 0; i < starts.size(); i++) {
+		Ray ray(starts[i], 0, DBL_MAX, ends[i] - starts[i], samp, NULL);
+		IntersectRecord rec;
+		if (mesh->intersect(ray, &rec))
+			(*hits)++;
+	}
+	return TileScheduler::currentTime() - start;
+}
+
+int main(int argc, char* argv[]) {
+
+	if (argc < 2) {
+		cerr << "Usage: meshbench mesh.obj [rays] [resolution] [rounds]" << endl;
+		exit(1);
+	}
+	string filename = argv[1];
+	unsigned int count = argc > 2 ? atoi(argv[2]) : 1000000;
+	unsigned int resolution = argc > 3 ? atoi(argv[3]) : 1024;
+	unsigned int rounds = argc > 4 ? atoi(argv[4]) : 5;
+
+	const char* names[3] = { "objects", "compact", "quantized" };
+	MeshFormat formats[3] = { objectMesh, compactMesh, quantizedMesh };
+	CheckerMaterial mat;
+	Primitive* meshes[3] = { NULL, NULL, NULL };
+	unsigned long long bytes[3] = { 0, 0, 0 };
+
+	for (int f = 0; f < 3; f++) {
+		Primitive* mesh = loadMesh(filename, &mat, formats[f]);
+		MemoryUsage usage = { 0, 0, 0 };
+		mesh->addMemoryUsage(usage);
+		bytes[f] = usage.geometry + usage.acceleration;
+		cout << names[f] << ":\t" << (double)usage.geometry / usage.triangles << " bytes/triangle geometry, "
+			<< (double)usage.acceleration / usage.triangles << " bytes/triangle acceleration, "
+			<< bytes[f] / 1048576.0 << " MB";
+		if (formats[f] == quantizedMesh)
+			cout << " (" << 100.0 * (bytes[compactMesh] - bytes[f]) / bytes[compactMesh] << "% less than compact)";
+		cout << endl;
+		if (formats[f] == objectMesh)
+			delete mesh;
+		else
+			meshes[f] = mesh;
+	}
+
+	// Decode overhead: the same queries and image on both compact forms,
+	// alternating between them each round and keeping the fastest time of
+	// each, so a slow moment on the machine doesn't land on one form only.
+	vector<vec3> starts, ends;
+	makeRays(meshes[compactMesh]->getBoundingBox(), count, &starts, &ends);
+	double closest[3] = { DBL_MAX, DBL_MAX, DBL_MAX };
+	double shading[3] = { DBL_MAX, DBL_MAX, DBL_MAX };
+	unsigned int hits[3] = { 0, 0, 0 };
+	vector<unsigned char> images[3];
+	for (unsigned int r = 0; r < rounds; r++)
+		for (int f = compactMesh; f <= quantizedMesh; f++) {
+			closest[f] = MIN(closest[f], closestHits(meshes[f], starts, ends, &hits[f]));
+			shading[f] = MIN(shading[f], render(meshes[f], resolution, &images[f]));
+		}
+
+	for (int f = compactMesh; f <= quantizedMesh; f++) {
+		cout << names[f] << ":\tclosest " << count / closest[f] / 1e6 << " Mrays/s (" << hits[f] << " hits, "
+			<< 100 * (closest[f] / closest[compactMesh] - 1) << "% time over compact)\timage "
+			<< resolution * resolution / shading[f] / 1e6 << " Mpixels/s ("
+			<< 100 * (shading[f] / shading[compactMesh] - 1) << "% time over compact)" << endl;
+		delete meshes[f];
+	}
+
+	// Image difference against the float vertices
+	const vector<unsigned char>& reference = images[compactMesh];
+	const vector<unsigned char>& image = images[quantizedMesh];
+	double squares = 0;
+	int maxDifference = 0;
+	unsigned int differing = 0;
+	for (unsigned int i = 0; i < image.size(); i++) {
+		int difference = (int)image[i] - (int)reference[i];
+		squares += difference * difference;
+		maxDifference = MAX(maxDifference, abs(difference));
+		if (difference != 0)
+			differing++;
+	}
+	cout << "quantized image RMSE " << sqrt(squares / image.size()) << ", max difference " << maxDifference
+		<< ", " << 100.0 * differing / image.size() << "% of pixels differ" << endl;
+	return 0;
+}
@@ -17,7 +17,7 @@
 
 using namespace std;
 
-ObjParser::ObjParser(string filename, Material* mat, mat4 transform, bool phongShade, bool wireframeOnly) {
+ObjParser::ObjParser(string filename, Material* mat, mat4 transform, bool phongShade, bool wireframeOnly, bool watertight, SplitMethod splitMethod, MeshFormat meshFormat) {
     char line[1024];
     ifstream inputFile (filename.c_str(), ifstream::in);
     if (!inputFile) {
@@ -30,6 +30,9 @@ ObjParser::ObjParser(string filename, Material* mat, mat4 transform, bool phongS
 	this->mat = mat;
 	phongShading = phongShade;
 	this->wireframeOnly = wireframeOnly;
+	this->watertight = watertight;
+	this->splitMethod = splitMethod;
+	this->meshFormat = meshFormat;
 	vertsParsed = 0;
 	this->transform = transform;
 	if (transform == identity3D())
@@ -99,7 +102,7 @@ bool ObjParser::parseLine(string line) {
 				// Ignore degenerate triangles
 				if (a == b || a == c || b == c)
 					return true;
-				Triangle* tri = new Triangle(mesh->vertices[a-1],mesh->vertices[b-1],mesh->vertices[c-1]);
+				Triangle* tri = new Triangle(mesh->vertices[a-1],mesh->vertices[b-1],mesh->vertices[c-1],watertight);
 				if (transformIsIdentity)
 					triangles.push_back(tri);
 				else triangles.push_back(new TransformedShape(tri, transform));
@@ -159,10 +162,19 @@ bool ObjParser::parseLine(string line) {
 			if (a == b || a == c || b == c)
 				return true;
 
+			// A compact mesh is built from the corners once they're all in.
+			if (meshFormat != objectMesh) {
+				for (int i = 0; i < 3; i++) {
+					MeshCorner corner = { vertI[i], normI[i], texI[i] };
+					corners.push_back(corner);
+				}
+				return true;
+			}
+
 			MeshTriangle* tri;
 			if (wireframeOnly)
-				tri = new WireframeTriangle(mesh, vertI, normI, texI);
-			else tri = new MeshTriangle(mesh, vertI, normI, texI);
+				tri = new WireframeTriangle(mesh, vertI, normI, texI, watertight);
+			else tri = new MeshTriangle(mesh, vertI, normI, texI, watertight);
 			if (transformIsIdentity)
 				triangles.push_back(tri);
 			else triangles.push_back(new TransformedShape(tri, transform));
@@ -184,7 +196,11 @@ vector<Primitive*> ObjParser::getObjects() {
 	if (mesh->normals.size() == 0 || mesh->textures.size() == 0)
 		for (unsigned int i = 0; i < triangles.size(); i++)
 			objects.push_back(new GeoPrimitive(triangles[i], mat));
-	else objects.push_back(new MeshPrimitive(mesh, triangles, mat));
+	else if (meshFormat != objectMesh) {
+		objects.push_back(new CompactMesh(mesh, corners, transform, mat, wireframeOnly, watertight, meshFormat == quantizedMesh));
+		delete mesh;
+	}
+	else objects.push_back(new MeshPrimitive(mesh, triangles, mat, splitMethod));
 
 	return objects;
 }
\ No newline at end of file
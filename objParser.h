@@ -9,6 +9,7 @@
  */
  
 #include "Primitives.h"
+#include "CompactMesh.h"
 #include "Material.h"
 #include "algebra3.h"
 #include <string>
@@ -19,7 +20,7 @@ using namespace std;
 class ObjParser {
 
     public:
-        ObjParser(string filename, Material* mat, mat4 transform, bool phongShade, bool wireframeOnly);
+        ObjParser(string filename, Material* mat, mat4 transform, bool phongShade, bool wireframeOnly, bool watertight, SplitMethod splitMethod, MeshFormat meshFormat);
         vector<Primitive*> getObjects();
     
     private:
@@ -28,12 +29,16 @@ class ObjParser {
     private:
 		bool phongShading;
 		bool wireframeOnly;
+		bool watertight;
+		SplitMethod splitMethod;
+		MeshFormat meshFormat;
 		int vertsParsed;
 		mat4 transform;
 		bool transformIsIdentity;
 		Mesh* mesh;
 		vector<vec3> phongNormals;
         vector<Shape*> triangles;
+		vector<MeshCorner> corners;		// Faces of a CompactMesh, three corners each
         Material* mat;
 
 };
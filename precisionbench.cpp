@@ -0,0 +1,129 @@
+/*
+ *  precisionbench.cpp
+ *  RayTracer
+ *
+ *  Benchmark for the precision switch in algebra3.h: renders a scene with
+ *  a double-precision and a single-precision build of raytrace, then
+ *  reports how long each took and how far the float image is from the
+ *  double one. Both renderers come from the same sources; the float one is
+ *  compiled with -DALGEBRA3FLOAT.
+ *
+ *  Not part of the raytrace target. Build it with
+ *    g++ -O2 -o precisionbench precisionbench.cpp -lfreeimage
+ *
+ *  Usage: precisionbench raytrace raytrace-float filename [-runs n] [raytrace flags]
+ */
+
+#include "WallClock.h"
+#include "FreeImage.h"
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <cstdio>
+#include <cstdlib>
+#include <cmath>
+
+using namespace std;
+
+
+// The image name the scene file asks for, as Film writes it.
+static string imageName(const string& sceneFile) {
+
+	ifstream in(sceneFile.c_str());
+	string line;
+	while (getline(in, line)) {
+		stringstream ss(line);
+		string op, filename;
+		if (ss >> op && op.compare("name") == 0 && ss >> filename)
+			return filename + ".png";
+	}
+	cerr << "Error: No output name in scene file " << sceneFile << endl;
+	exit(1);
+}
+
+// Renders with "renderer" RUNS times and keeps the last image as "saveAs".
+// Returns the fastest run's time.
+static double render(const string& renderer, const string& arguments, const string& image,
+					 const string& saveAs, int runs) {
+
+	string command = renderer + arguments + " > /dev/null";
+	double best = -1;
+	for (int i = 0; i < runs; i++) {
+		double start = wallClockTime();
+		if (system(command.c_str()) != 0) {
+			cerr << "Error: \"" << command << "\" failed" << endl;
+			exit(1);
+		}
+		double seconds = wallClockTime() - start;
+		if (best < 0 || seconds < best)
+			best = seconds;
+	}
+	if (rename(image.c_str(), saveAs.c_str()) != 0) {
+		cerr << "Error: " << renderer << " didn't write " << image << endl;
+		exit(1);
+	}
+	return best;
+}
+
+int main(int argc, char* argv[]) {
+
+	if (argc < 4) {
+		cerr << "Usage: precisionbench raytrace raytrace-float filename [-runs n] [raytrace flags]" << endl;
+		exit(1);
+	}
+	string sceneFile = argv[3];
+	string arguments = " " + sceneFile;
+	int runs = 3;
+	for (int i = 4; i < argc; i++) {
+		if (string(argv[i]).compare("-runs") == 0 && i + 1 < argc)
+			runs = atoi(argv[++i]);
+		else
+			arguments += string(" ") + argv[i];
+	}
+
+	string image = imageName(sceneFile);
+	string base = image.substr(0, image.size() - 4);
+	string doubleImage = base + "-double.png", floatImage = base + "-float.png";
+	double doubleTime = render(argv[1], arguments, image, doubleImage, runs);
+	double floatTime = render(argv[2], arguments, image, floatImage, runs);
+	cout << "double:\t" << doubleTime << " s" << endl;
+	cout << "float:\t" << floatTime << " s (" << doubleTime / floatTime << "x)" << endl;
+
+	// Compare the float image to the double one, channel by channel
+	FIBITMAP* reference = FreeImage_Load(FIF_PNG, doubleImage.c_str(), 0);
+	FIBITMAP* test = FreeImage_Load(FIF_PNG, floatImage.c_str(), 0);
+	if (reference == NULL || test == NULL) {
+		cerr << "Error: Couldn't read back the rendered images" << endl;
+		exit(1);
+	}
+	unsigned int width = FreeImage_GetWidth(reference), height = FreeImage_GetHeight(reference);
+	if (FreeImage_GetWidth(test) != width || FreeImage_GetHeight(test) != height) {
+		cerr << "Error: The two renders differ in size" << endl;
+		exit(1);
+	}
+	double squares = 0;
+	int maxDifference = 0;
+	unsigned int differing = 0;
+	for (unsigned int i = 0; i < width; i++)
+		for (unsigned int j = 0; j < height; j++) {
+			RGBQUAD a, b;
+			FreeImage_GetPixelColor(reference, i, j, &a);
+			FreeImage_GetPixelColor(test, i, j, &b);
+			int difference[3] = { a.rgbRed - b.rgbRed, a.rgbGreen - b.rgbGreen, a.rgbBlue - b.rgbBlue };
+			bool same = true;
+			for (int k = 0; k < 3; k++) {
+				squares += difference[k] * difference[k];
+				maxDifference = max(maxDifference, abs(difference[k]));
+				same = same && difference[k] == 0;
+			}
+			if (!same)
+				differing++;
+		}
+	FreeImage_Unload(reference);
+	FreeImage_Unload(test);
+
+	cout << "image:\tRMSE " << sqrt(squares / (3.0 * width * height)) << ", max difference " << maxDifference
+		<< ", " << 100.0 * differing / (width * height) << "% of pixels differ" << endl;
+	return 0;
+}
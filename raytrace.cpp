@@ -12,7 +12,11 @@
 #include "ObjParser.h"
 #include "algebra3.h"
 #include "objParser.h"
+#include "TileScheduler.h"
 #include <iostream>
+#include <cstdlib>
+#include <ctime>
+#include <unistd.h>
 
 
 //For file input
@@ -43,6 +47,7 @@ bool parseScene(ifstream &inputFile, Camera *&cam, RenderSettings &settings) {
     // camera coordinates as well as the pixel length and with.
     //      camera eyeX eyeY eyeZ llx lly llz lrx lry lrz urx ury urz ulx uly ulz;
     //      pixel 100 100
+    //      sample 4 [jittered|sobol|halton|cmj]
     //      depth 1
     //      bias .005
     //      name testImage
@@ -99,7 +104,7 @@ bool parseScene(ifstream &inputFile, Camera *&cam, RenderSettings &settings) {
             vec3 LL (llx,lly,llz);
             vec3 UR (urx,ury,urz);
             vec3 LR (lrx,lry,lrz);
-            cam = new LensCamera(point, edge1, edge2, UL, LL, UR, LR, settings.sqrtSamplesPerPixel);
+            cam = new LensCamera(point, edge1, edge2, UL, LL, UR, LR);
             camera = true;
             continue;
         }
@@ -119,6 +124,18 @@ bool parseScene(ifstream &inputFile, Camera *&cam, RenderSettings &settings) {
             if (! (ss >> sampleRate))
                 return false;
             settings.sqrtSamplesPerPixel = sampleRate;
+            settings.samplePattern = jitteredPattern;
+            string pattern;
+            if (ss >> pattern) {
+                if (pattern.compare("sobol") == 0)
+                    settings.samplePattern = sobolPattern;
+                else if (pattern.compare("halton") == 0)
+                    settings.samplePattern = haltonPattern;
+                else if (pattern.compare("cmj") == 0)
+                    settings.samplePattern = multiJitterPattern;
+                else if (pattern.compare("jittered") != 0)
+                    return false;
+            }
             sample = true;
             continue;
         }
@@ -348,13 +365,13 @@ bool parseTriangle(ifstream &inputFile, Shape *&shape) {
 		return false;
 	ss2 >> op;
 	if (op.compare("NONE") == 0) {
-		shape = new Triangle(a,b,c);
+		shape = new Triangle(a,b,c,false);
 		return true;
 	}
 	mat4 transform;
 	if (!parseTransform(inputFile, &transform))
 		return false;
-	shape = new TransformedShape(new Triangle(a,b,c), transform);
+	shape = new TransformedShape(new Triangle(a,b,c,false), transform);
 	return true;
 }
 
@@ -411,7 +428,7 @@ bool parseEllipsoid(ifstream &inputFile, Shape *&shape) {
 	} else return false;
 }
 
-bool parseLighting(stringstream &ss, Light *&light, LightType type, const RenderSettings& settings) {
+bool parseLighting(stringstream &ss, Light *&light, LightType type) {
     double x, y, z, r, g, b;
     if ((ss >> x >> y >> z >> r >> g >> b)) {
         if (type == directionalLight) {
@@ -428,7 +445,7 @@ bool parseLighting(stringstream &ss, Light *&light, LightType type, const Render
 			vec3 e1, e2;
 			if (!(ss >> e1 >> e2))
 				return false;
-			light = new AreaLight(vec3(x,y,z), e1, e2, rgb(r,g,b), settings.sqrtSamplesPerPixel);
+			light = new AreaLight(vec3(x,y,z), e1, e2, rgb(r,g,b));
 			return true;
 		}
     }
@@ -440,8 +457,9 @@ bool parseLighting(stringstream &ss, Light *&light, LightType type, const Render
 //////////////////////////////////////////////////////////////////////////////
 int main(int argc, char* argv[]) {
 
-	if (argc != 2) {
-		cerr << "Usage: raytrace filename" << endl;
+	if (argc < 2 || argc % 2 != 0) {
+		cerr << "Usage: raytrace filename [-threads n] [-seed n] [-split sah|midpoint|morton|morton-sah] [-accel tree|linear|bvh4] [-cutoff t] [-roulette t] [-adaptive error] [-budget spp] [-time seconds] [-noise error] [-packets on|off] [-integrator path|wavefront] [-mesh objects|compact|quantized]" << endl;
+		cerr << "Compact and quantized meshes always split their own triangles by SAH; -split sets how everything else is built." << endl;
 		exit(1);
 	}
 
@@ -461,6 +479,115 @@ int main(int argc, char* argv[]) {
     Camera *cam;
     bool sceneCreated = false;
     string filename = argv[1];
+	SplitMethod splitMethod = sahSplit;
+	TreeLayout layout = linearLayout;
+	MeshFormat meshFormat = objectMesh;
+
+	// Defaults for settings that don't come from the scene file
+	settings.numThreads = (unsigned int)MAX(1L, sysconf(_SC_NPROCESSORS_ONLN));
+	settings.tileSize = 32;
+	settings.seed = (unsigned int)time(NULL);
+	settings.termination = thresholdTermination;
+	settings.throughputCutoff = 0;
+	settings.adaptiveThreshold = 0;
+	settings.sampleBudget = 0;
+	settings.timeBudget = 0;
+	settings.noiseTarget = 0;
+	settings.packetRays = true;
+	settings.integrator = pathIntegrator;
+
+	for (int i = 2; i < argc; i += 2) {
+		string flag = argv[i];
+		if (flag.compare("-threads") == 0)
+			settings.numThreads = MAX(1, atoi(argv[i+1]));
+		else if (flag.compare("-seed") == 0)
+			settings.seed = (unsigned int)strtoul(argv[i+1], NULL, 10);
+		else if (flag.compare("-split") == 0) {
+			string method = argv[i+1];
+			if (method.compare("sah") == 0)
+				splitMethod = sahSplit;
+			else if (method.compare("midpoint") == 0)
+				splitMethod = midpointSplit;
+			else if (method.compare("morton") == 0)
+				splitMethod = mortonSplit;
+			else if (method.compare("morton-sah") == 0)
+				splitMethod = mortonSAHSplit;
+			else {
+				cerr << "Error: Unknown split method " << method << endl;
+				exit(1);
+			}
+		}
+		else if (flag.compare("-cutoff") == 0) {
+			settings.termination = thresholdTermination;
+			settings.throughputCutoff = MAX(0.0, atof(argv[i+1]));
+		}
+		else if (flag.compare("-roulette") == 0) {
+			settings.termination = rouletteTermination;
+			settings.throughputCutoff = MAX(0.0, atof(argv[i+1]));
+		}
+		else if (flag.compare("-adaptive") == 0)
+			settings.adaptiveThreshold = MAX(0.0, atof(argv[i+1]));
+		else if (flag.compare("-budget") == 0)
+			settings.sampleBudget = MAX(0, atoi(argv[i+1]));
+		else if (flag.compare("-time") == 0)
+			settings.timeBudget = MAX(0.0, atof(argv[i+1]));
+		else if (flag.compare("-noise") == 0)
+			settings.noiseTarget = MAX(0.0, atof(argv[i+1]));
+		else if (flag.compare("-packets") == 0) {
+			string packets = argv[i+1];
+			if (packets.compare("on") == 0)
+				settings.packetRays = true;
+			else if (packets.compare("off") == 0)
+				settings.packetRays = false;
+			else {
+				cerr << "Error: Unknown packet setting " << packets << endl;
+				exit(1);
+			}
+		}
+		else if (flag.compare("-integrator") == 0) {
+			string integrator = argv[i+1];
+			if (integrator.compare("path") == 0)
+				settings.integrator = pathIntegrator;
+			else if (integrator.compare("wavefront") == 0)
+				settings.integrator = wavefrontIntegrator;
+			else {
+				cerr << "Error: Unknown integrator " << integrator << endl;
+				exit(1);
+			}
+		}
+		else if (flag.compare("-accel") == 0) {
+			string accel = argv[i+1];
+			if (accel.compare("linear") == 0)
+				layout = linearLayout;
+			else if (accel.compare("tree") == 0)
+				layout = pointerLayout;
+			else if (accel.compare("bvh4") == 0)
+				layout = wideLayout;
+			else {
+				cerr << "Error: Unknown acceleration structure " << accel << endl;
+				exit(1);
+			}
+		}
+		else if (flag.compare("-mesh") == 0) {
+			string format = argv[i+1];
+			if (format.compare("objects") == 0)
+				meshFormat = objectMesh;
+			else if (format.compare("compact") == 0)
+				meshFormat = compactMesh;
+			else if (format.compare("quantized") == 0)
+				meshFormat = quantizedMesh;
+			else {
+				cerr << "Error: Unknown mesh format " << format << endl;
+				exit(1);
+			}
+		}
+		else {
+			cerr << "Error: Unknown option " << flag << endl;
+			exit(1);
+		}
+	}
+
+	BoundingBoxTree::setBuildThreads(settings.numThreads);
 
 	// [START] LOAD FILE
 	cout << "Loading file \"" << filename << "\"...";
@@ -477,6 +604,7 @@ int main(int argc, char* argv[]) {
 	cout << "DONE" << endl;
 	// [START] BUILD SCENE
 	cout << "Building Scene...";
+	double buildStart = TileScheduler::currentTime();
 
 
 	while (!inputFile.eof()) {
@@ -536,9 +664,10 @@ int main(int argc, char* argv[]) {
 
 				string objfile;
 				string shadeType;
-				string wireframe;
+				string option;
 				bool phongShade;
 				bool wireframeOnly = false;
+				bool watertight = false;
 
 				if (!(ss3 >> objfile >> shadeType)) {
 					cout << endl;
@@ -554,11 +683,15 @@ int main(int argc, char* argv[]) {
 					cerr << "Error: Unknown shading type in " << filename << endl;
 					exit(1);
 				}
-				ss3 >> wireframe;
-				if (wireframe.compare("wireframeOnly") == 0)
-					wireframeOnly = true;
+				// Optional flags: wireframeOnly, watertight
+				while (ss3 >> option) {
+					if (option.compare("wireframeOnly") == 0)
+						wireframeOnly = true;
+					else if (option.compare("watertight") == 0)
+						watertight = true;
+				}
 
-				ObjParser parser(objfile, mat, transMat, phongShade, wireframeOnly);
+				ObjParser parser(objfile, mat, transMat, phongShade, wireframeOnly, watertight, splitMethod, meshFormat);
 				vector<Primitive*> temp = parser.getObjects();
 				// If we have a true mesh (MeshPrimitive), then store it in the map.
 				if (temp.size() == 1 && meshname.compare("") != 0)
@@ -599,7 +732,7 @@ int main(int argc, char* argv[]) {
 		}
 
 		if (op.compare("DirectionalLight") == 0 && sceneCreated) {
-			if (!parseLighting(ss, light, directionalLight, settings)) {
+			if (!parseLighting(ss, light, directionalLight)) {
 				cout << endl;
 				cerr << "Error: Incomplete directional light description in " << filename << endl;
 				exit(1);
@@ -609,7 +742,7 @@ int main(int argc, char* argv[]) {
 		}
 
 		if (op.compare("AreaLight") == 0 && sceneCreated) {
-			if (!parseLighting(ss, light, areaLight, settings)) {
+			if (!parseLighting(ss, light, areaLight)) {
 				cout << endl;
 				cerr << "Error: Incomplete area light description in " << filename << endl;
 				exit(1);
@@ -619,7 +752,7 @@ int main(int argc, char* argv[]) {
 		}
 
 		if (op.compare("PointLight") == 0 && sceneCreated) {
-			if (!parseLighting(ss, light, pointLight, settings)) {
+			if (!parseLighting(ss, light, pointLight)) {
 				cout << endl;
 				cerr << "Error: Incomplete point light description in " << filename << endl;
 				exit(1);
@@ -681,11 +814,39 @@ int main(int argc, char* argv[]) {
 	}
 
     inputFile.close();
-    BoundingBoxTree tree = BoundingBoxTree(objects, VZ);
-    mainScene->setHierarchy(&tree);
+    BoundingBoxTree* tree = new BoundingBoxTree(objects, VZ, splitMethod);
+	double buildTime = TileScheduler::currentTime() - buildStart;
+	double cost = tree->traversalCost();
+	Primitive* hierarchy = tree;
+
+	// Compile the trees into flat node arrays once everything is loaded.
+	// This takes over the trees, so it has to come after traversalCost().
+	if (layout != pointerLayout) {
+		for (unsigned int i = 0; i < objects.size(); i++) {
+			MeshPrimitive* mesh = dynamic_cast<MeshPrimitive*>(objects[i]);
+			if (mesh != NULL)
+				mesh->flatten(layout);
+		}
+		hierarchy = BoundingBoxTree::compile(tree, layout);
+	}
+	mainScene->setHierarchy(hierarchy);
 
 	// [END] BUILD SCENE
 	cout << "DONE" << endl;
+	const char* splitNames[] = { "midpoint", "sah", "morton", "morton-sah" };
+	cout << "Hierarchy: " << splitNames[splitMethod] << " split, "
+		<< (layout == linearLayout ? "linear" : (layout == wideLayout ? "bvh4" : "tree")) << " layout, scene built in "
+		<< TileScheduler::currentTime() - buildStart << "s (" << buildTime << "s before flattening), traversal cost " << cost << endl;
+	if (splitMethod != midpointSplit)
+		cout << "Trees built in " << BoundingBoxTree::getBuildTime() << "s on "
+			<< settings.numThreads << " thread" << (settings.numThreads == 1 ? "" : "s") << endl;
+	MemoryUsage usage = { 0, 0, 0 };
+	hierarchy->addMemoryUsage(usage);
+	if (usage.triangles > 0)
+		cout << "Memory: " << usage.triangles << " triangles, " << (double)usage.geometry / usage.triangles
+			<< " bytes/triangle geometry, " << (double)usage.acceleration / usage.triangles << " bytes/triangle acceleration ("
+			<< (usage.geometry + usage.acceleration) / 1048576.0 << " MB in all)" << endl;
 
     mainScene->render(settings);
+    delete hierarchy;
 }
\ No newline at end of file
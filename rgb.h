@@ -8,7 +8,7 @@ class rgb : public vec3 {
 public:
 	// Constructors
 	rgb();															// Default constructor
-	rgb(const double r, const double g, const double b);			// Basic constructor
+	rgb(const scalar r, const scalar g, const scalar b);			// Basic constructor
 	rgb(const rgb& c);												// Copy constructor
 
 	// Operators
@@ -19,9 +19,9 @@ public:
 	friend rgb operator - (const rgb& c);							// -v1
 	friend rgb operator + (const rgb& a, const rgb& b);				// v1 + v2
 	friend rgb operator - (const rgb& a, const rgb& b);				// v1 - v2
-	friend rgb operator * (const rgb& a, const double d);			// v1 * 3.0
-	friend rgb operator * (const double d, const rgb& a);			// 3.0 * v1
-	friend rgb operator / (const rgb& a, const double d);			// v1 / 3.0
+	friend rgb operator * (const rgb& a, const scalar d);			// v1 * 3.0
+	friend rgb operator * (const scalar d, const rgb& a);			// 3.0 * v1
+	friend rgb operator / (const rgb& a, const scalar d);			// v1 / 3.0
 	friend int operator == (const rgb& a, const rgb& b);			// v1 == v2 ?
 	friend int operator != (const rgb& a, const rgb& b);			// v1 != v2 ?
 
@@ -37,7 +37,7 @@ inline rgb::rgb() {
 	n[VX] = n[VY] = n[VZ] = 0.0;
 }
 
-inline rgb::rgb(const double x, const double y, const double z)
+inline rgb::rgb(const scalar x, const scalar y, const scalar z)
 : vec3(x, y, z) {}
 
 inline rgb::rgb(const rgb& v)
@@ -65,14 +65,14 @@ inline rgb operator + (const rgb& a, const rgb& b)
 inline rgb operator - (const rgb& a, const rgb& b)
 { return rgb(a.n[VX]-b.n[VX], a.n[VY]-b.n[VY], a.n[VZ]-b.n[VZ]); }
 
-inline rgb operator * (const rgb& a, const double d)
+inline rgb operator * (const rgb& a, const scalar d)
 { return rgb(d*a.n[VX], d*a.n[VY], d*a.n[VZ]); }
 
-inline rgb operator * (const double d, const rgb& a)
+inline rgb operator * (const scalar d, const rgb& a)
 { return a*d; }
 
-inline rgb operator / (const rgb& a, const double d)
-{ double d_inv = 1.0/d; return rgb(a.n[VX]*d_inv, a.n[VY]*d_inv,
+inline rgb operator / (const rgb& a, const scalar d)
+{ scalar d_inv = 1.0/d; return rgb(a.n[VX]*d_inv, a.n[VY]*d_inv,
   a.n[VZ]*d_inv); }
 
 inline int operator == (const rgb& a, const rgb& b)
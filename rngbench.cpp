@@ -0,0 +1,91 @@
+/*
+ *  rngbench.cpp
+ *  RayTracer
+ *
+ *  Benchmark for the random number generators: times 32-bit words and
+ *  uniform doubles from CRandomMersenne against CounterRNG, one at a time
+ *  and through CounterRNG's batch calls. Each run prints a checksum of
+ *  what it drew, so the loops can't be optimized away.
+ *
+ *  Not part of the raytrace target. Build it with
+ *    g++ -O2 -fpermissive -o rngbench rngbench.cpp CounterRNG.cpp mersenne.cpp
+ *
+ *  Usage: rngbench [millions of numbers]
+ */
+
+#include "CounterRNG.h"
+#include "WallClock.h"
+#include "randomc.h"
+#include <iostream>
+#include <cstdlib>
+
+using namespace std;
+
+#define BENCH_BATCH 256				// Numbers per batch call
+
+
+static void report(const char* name, unsigned int count, double seconds, double baseline, double checksum) {
+
+	cout << name << ":\t" << count / seconds / 1e6 << " M/s (" << baseline / seconds << "x)\tchecksum "
+		<< checksum << endl;
+}
+
+int main(int argc, char* argv[]) {
+
+	unsigned int count = (argc > 1 ? atoi(argv[1]) : 64) * 1000000u;
+	count -= count % BENCH_BATCH;
+	CRandomMersenne mersenne(1);
+	CounterRNG counter(1);
+	uint32 words[BENCH_BATCH];
+	double values[BENCH_BATCH];
+
+	// 32-bit words
+	uint32 sum = 0;
+	double start = wallClockTime();
+	for (unsigned int i = 0; i < count; i++)
+		sum += mersenne.BRandom();
+	double baseline = wallClockTime() - start;
+	report("mersenne bits", count, baseline, baseline, sum);
+
+	sum = 0;
+	start = wallClockTime();
+	for (unsigned int i = 0; i < count; i += 4) {
+		counter.generate(i, 7, 0, 0, words);
+		sum += words[0] + words[1] + words[2] + words[3];
+	}
+	report("philox bits", count, wallClockTime() - start, baseline, sum);
+
+	sum = 0;
+	start = wallClockTime();
+	for (unsigned int i = 0; i < count; i += BENCH_BATCH) {
+		counter.generateBatch(i, 7, 0, words, BENCH_BATCH);
+		for (int k = 0; k < BENCH_BATCH; k++)
+			sum += words[k];
+	}
+	report("philox batch bits", count, wallClockTime() - start, baseline, sum);
+
+	// Uniform doubles
+	double total = 0;
+	start = wallClockTime();
+	for (unsigned int i = 0; i < count; i++)
+		total += mersenne.Random();
+	baseline = wallClockTime() - start;
+	report("mersenne uniform", count, baseline, baseline, total);
+
+	total = 0;
+	start = wallClockTime();
+	for (unsigned int i = 0; i < count; i++)
+		total += counter.uniform(i, 7, 0, 0);
+	report("philox uniform", count, wallClockTime() - start, baseline, total);
+
+	total = 0;
+	start = wallClockTime();
+	for (unsigned int i = 0; i < count; i += BENCH_BATCH) {
+		counter.uniformBatch(i, 7, 0, values, BENCH_BATCH);
+		for (int k = 0; k < BENCH_BATCH; k++)
+			total += values[k];
+	}
+	report("philox batch uniform", count, wallClockTime() - start, baseline, total);
+
+	return 0;
+}
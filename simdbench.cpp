@@ -0,0 +1,175 @@
+/*
+ *  simdbench.cpp
+ *  RayTracer
+ *
+ *  Benchmark for algebra3f.h: times dot products, cross products, 4x4
+ *  matrix-vector products and ray-box slab tests in double precision with
+ *  algebra3.h against single precision with the SIMD types. Each run
+ *  prints a checksum of its results, so the loops can't be optimized away
+ *  and the two precisions can be compared.
+ *
+ *  Not part of the raytrace target. Build it with
+ *    g++ -O2 -fpermissive -o simdbench simdbench.cpp mersenne.cpp
+ *
+ *  Usage: simdbench [millions of operations]
+ */
+
+#include "algebra3.h"
+#include "algebra3f.h"
+#include "WallClock.h"
+#include "randomc.h"
+#include <iostream>
+#include <cfloat>
+#include <cstdlib>
+#include <vector>
+
+using namespace std;
+
+#define BENCH_VECTORS 4096			// Operands cycled through; small enough to stay in cache
+
+
+static void report(const char* name, unsigned int count, double seconds, double baseline, double checksum) {
+
+	cout << name << ":\t" << count / seconds / 1e6 << " M/s (" << baseline / seconds << "x)\tchecksum "
+		<< checksum << endl;
+}
+
+static vec3 randomVector(CRandomMersenne& rng) {
+
+	return vec3(rng.Random() * 2 - 1, rng.Random() * 2 - 1, rng.Random() * 2 - 1);
+}
+
+// The double-precision slab test, as BoundingBox does it.
+static inline bool hitsBox(const vec3 bounds[2], const vec3& org, const vec3& inv, double tMin, double tMax) {
+
+	double tNear = -DBL_MAX, tFar = DBL_MAX;
+	for (int k = 0; k < 3; k++) {
+		double t0 = (bounds[0][k] - org[k]) * inv[k];
+		double t1 = (bounds[1][k] - org[k]) * inv[k];
+		tNear = MAX(tNear, MIN(t0, t1));
+		tFar = MIN(tFar, MAX(t0, t1));
+	}
+	return tNear <= tFar && tNear < tMax && tFar > tMin;
+}
+
+int main(int argc, char* argv[]) {
+
+	unsigned int count = (argc > 1 ? atoi(argv[1]) : 64) * 1000000u;
+	CRandomMersenne rng(1);
+
+	// The same operands in both precisions; conversions happen here, not
+	// in the timed loops.
+	vector<vec3> a, b, inv;
+	vector<vec4> p;
+	vector<vec3f> af, bf, invf;
+	vector<vec4f> pf;
+	vector<box3f> boxesf;
+	vector<vec3> boxes;
+	for (int i = 0; i < BENCH_VECTORS; i++) {
+		a.push_back(randomVector(rng));
+		b.push_back(randomVector(rng));
+		vec3 d = randomVector(rng);
+		inv.push_back(vec3(1 / d[VX], 1 / d[VY], 1 / d[VZ]));
+		p.push_back(vec4(a[i], 1));
+		vec3 c = randomVector(rng) * 4, e = vec3(rng.Random(), rng.Random(), rng.Random());
+		boxes.push_back(c - e);
+		boxes.push_back(c + e);
+
+		af.push_back(vec3f(a[i]));
+		bf.push_back(vec3f(b[i]));
+		invf.push_back(vec3f(inv[i]));
+		pf.push_back(vec4f(p[i]));
+		boxesf.push_back(box3f(vec3f(c - e), vec3f(c + e)));
+	}
+	mat4 m = translation3D(vec3(1, 2, 3)) * rotation3D(vec3(1, 1, 0), 30) * scaling3D(vec3(2, 1, 0.5));
+	mat4f mf(m);
+	unsigned int passes = count / BENCH_VECTORS;
+	count = passes * BENCH_VECTORS;
+
+	// Each pass over the operands is summed on its own and added to a
+	// double total, so long float sums don't swamp the checksums.
+
+	// Dot products
+	double total = 0;
+	double start = wallClockTime();
+	for (unsigned int n = 0; n < passes; n++) {
+		double partial = 0;
+		for (int i = 0; i < BENCH_VECTORS - 1; i++)
+			partial += a[i] * b[i + 1];
+		total += partial;
+	}
+	double baseline = wallClockTime() - start;
+	report("double dot", count, baseline, baseline, total);
+
+	total = 0;
+	start = wallClockTime();
+	for (unsigned int n = 0; n < passes; n++) {
+		float partial = 0;
+		for (int i = 0; i < BENCH_VECTORS - 1; i++)
+			partial += af[i] * bf[i + 1];
+		total += partial;
+	}
+	report("float4 dot", count, wallClockTime() - start, baseline, total);
+
+	// Cross products
+	total = 0;
+	start = wallClockTime();
+	for (unsigned int n = 0; n < passes; n++) {
+		vec3 partial(0, 0, 0);
+		for (int i = 0; i < BENCH_VECTORS - 1; i++)
+			partial += a[i] ^ b[i + 1];
+		total += partial[VX] + partial[VY] + partial[VZ];
+	}
+	baseline = wallClockTime() - start;
+	report("double cross", count, baseline, baseline, total);
+
+	total = 0;
+	start = wallClockTime();
+	for (unsigned int n = 0; n < passes; n++) {
+		vec3f partial(0, 0, 0);
+		for (int i = 0; i < BENCH_VECTORS - 1; i++)
+			partial += af[i] ^ bf[i + 1];
+		total += partial[VX] + partial[VY] + partial[VZ];
+	}
+	report("float4 cross", count, wallClockTime() - start, baseline, total);
+
+	// Matrix-vector products
+	total = 0;
+	start = wallClockTime();
+	for (unsigned int n = 0; n < passes; n++) {
+		vec4 partial(0, 0, 0, 0);
+		for (int i = 0; i < BENCH_VECTORS; i++)
+			partial += m * p[i];
+		total += partial[VX] + partial[VY] + partial[VZ] + partial[VW];
+	}
+	baseline = wallClockTime() - start;
+	report("double mat4*vec4", count, baseline, baseline, total);
+
+	total = 0;
+	start = wallClockTime();
+	for (unsigned int n = 0; n < passes; n++) {
+		vec4f partial(0, 0, 0, 0);
+		for (int i = 0; i < BENCH_VECTORS; i++)
+			partial = partial + mf * pf[i];
+		total += partial[VX] + partial[VY] + partial[VZ] + partial[VW];
+	}
+	report("float4 mat4*vec4", count, wallClockTime() - start, baseline, total);
+
+	// Ray-box slab tests: pass n sends the ray from a[n] through every box
+	unsigned int hits = 0;
+	start = wallClockTime();
+	for (unsigned int n = 0; n < passes; n++)
+		for (int i = 0; i < BENCH_VECTORS; i++)
+			hits += hitsBox(&boxes[2 * i], a[n % BENCH_VECTORS], inv[i], 0, 10);
+	baseline = wallClockTime() - start;
+	report("double box", count, baseline, baseline, hits);
+
+	hits = 0;
+	start = wallClockTime();
+	for (unsigned int n = 0; n < passes; n++)
+		for (int i = 0; i < BENCH_VECTORS; i++)
+			hits += boxesf[i].hit(af[n % BENCH_VECTORS], invf[i], 0, 10);
+	report("float4 box", count, wallClockTime() - start, baseline, hits);
+
+	return 0;
+}